@@ -0,0 +1,31 @@
+#-------------------------------------------------
+#
+# Project created by QtCreator 2018-09-19T21:53:39
+#
+#-------------------------------------------------
+
+QT       += core gui widgets
+
+TARGET = ImageFilters
+TEMPLATE = app
+
+include(imagefilters.pri)
+
+SOURCES += \
+        main.cpp \
+        exportqueue.cpp \
+        filterjobrunner.cpp \
+        mainwindow.cpp
+
+HEADERS += \
+        exportqueue.h \
+        filterjobrunner.h \
+        mainwindow.h
+
+FORMS += \
+        mainwindow.ui
+
+# Default rules for deployment.
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
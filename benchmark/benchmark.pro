@@ -0,0 +1,30 @@
+#-------------------------------------------------
+#
+# imagefilters-benchmark: times every Filter::
+# function on synthetic images and writes results
+# that can be compared between two builds
+#
+#-------------------------------------------------
+
+QT       += core gui
+QT       -= widgets
+
+CONFIG += console
+CONFIG -= app_bundle
+
+TARGET = imagefilters-benchmark
+TEMPLATE = app
+
+include(../imagefilters.pri)
+
+SOURCES += \
+        main.cpp \
+    benchmarkreport.cpp \
+    benchmarksuite.cpp
+
+HEADERS += \
+    benchmarkreport.h \
+    benchmarksuite.h
+
+# peak working set on Windows
+win32: LIBS += -lpsapi
@@ -0,0 +1,159 @@
+#include "benchmarkreport.h"
+#include <QDateTime>
+#include <QFile>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSysInfo>
+#include <QTextStream>
+#include "filter.h"
+
+static const int ReportVersion = 1;
+
+static bool writeFile(const QString& fileName, const QByteArray& contents, QString* errorMessage)
+{
+    QFile file(fileName);
+
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        *errorMessage = QStringLiteral("%1: %2").arg(fileName, file.errorString());
+        return false;
+    }
+
+    if(file.write(contents) != contents.size()) {
+        *errorMessage = QStringLiteral("%1: %2").arg(fileName, file.errorString());
+        return false;
+    }
+
+    return true;
+}
+
+bool BenchmarkReport::writeJson(const QVector<BenchmarkResult> &results, const QString &fileName, QString *errorMessage)
+{
+    QJsonArray entries;
+
+    for(const BenchmarkResult& result : results) {
+        QJsonObject entry;
+        entry.insert(QStringLiteral("name"), result.name);
+        entry.insert(QStringLiteral("format"), result.format);
+        entry.insert(QStringLiteral("width"), result.width);
+        entry.insert(QStringLiteral("height"), result.height);
+        entry.insert(QStringLiteral("iterations"), result.iterations);
+        entry.insert(QStringLiteral("nsPerPixel"), result.medianNsPerPixel);
+        entry.insert(QStringLiteral("bestNsPerPixel"), result.bestNsPerPixel);
+        entry.insert(QStringLiteral("megapixelsPerSecond"), result.megapixelsPerSecond());
+        entry.insert(QStringLiteral("peakRssKb"), static_cast<double>(result.peakRssKb));
+        entries.append(entry);
+    }
+
+    QJsonObject root;
+    root.insert(QStringLiteral("version"), ReportVersion);
+    root.insert(QStringLiteral("date"), QDateTime::currentDateTimeUtc().toString(Qt::ISODate));
+    root.insert(QStringLiteral("qt"), QString::fromLatin1(qVersion()));
+    root.insert(QStringLiteral("abi"), QSysInfo::buildAbi());
+    root.insert(QStringLiteral("host"), QSysInfo::machineHostName());
+    root.insert(QStringLiteral("threads"), Filter::threadCount());
+    root.insert(QStringLiteral("results"), entries);
+
+    return writeFile(fileName, QJsonDocument(root).toJson(), errorMessage);
+}
+
+bool BenchmarkReport::writeCsv(const QVector<BenchmarkResult> &results, const QString &fileName, QString *errorMessage)
+{
+    QByteArray contents;
+    QTextStream stream(&contents);
+
+    stream << "name,format,width,height,iterations,ns_per_pixel,best_ns_per_pixel,mp_per_second,peak_rss_kb\n";
+
+    for(const BenchmarkResult& result : results) {
+        stream << result.name << ',' << result.format << ',' << result.width << ',' << result.height << ','
+               << result.iterations << ',' << QString::number(result.medianNsPerPixel, 'f', 4) << ','
+               << QString::number(result.bestNsPerPixel, 'f', 4) << ','
+               << QString::number(result.megapixelsPerSecond(), 'f', 3) << ',' << result.peakRssKb << '\n';
+    }
+
+    stream.flush();
+
+    return writeFile(fileName, contents, errorMessage);
+}
+
+bool BenchmarkReport::readJson(const QString &fileName, QVector<BenchmarkResult> *results, QString *errorMessage)
+{
+    QFile file(fileName);
+
+    if(!file.open(QIODevice::ReadOnly)) {
+        *errorMessage = QStringLiteral("%1: %2").arg(fileName, file.errorString());
+        return false;
+    }
+
+    QJsonParseError parseError;
+    QJsonDocument document = QJsonDocument::fromJson(file.readAll(), &parseError);
+
+    if(document.isNull()) {
+        *errorMessage = QStringLiteral("%1: %2").arg(fileName, parseError.errorString());
+        return false;
+    }
+
+    QJsonObject root = document.object();
+    if(root.value(QStringLiteral("version")).toInt() != ReportVersion) {
+        *errorMessage = QStringLiteral("%1: not a benchmark report of version %2").arg(fileName).arg(ReportVersion);
+        return false;
+    }
+
+    results->clear();
+
+    for(const QJsonValue& value : root.value(QStringLiteral("results")).toArray()) {
+        QJsonObject entry = value.toObject();
+
+        BenchmarkResult result;
+        result.name = entry.value(QStringLiteral("name")).toString();
+        result.format = entry.value(QStringLiteral("format")).toString();
+        result.width = entry.value(QStringLiteral("width")).toInt();
+        result.height = entry.value(QStringLiteral("height")).toInt();
+        result.iterations = entry.value(QStringLiteral("iterations")).toInt();
+        result.medianNsPerPixel = entry.value(QStringLiteral("nsPerPixel")).toDouble();
+        result.bestNsPerPixel = entry.value(QStringLiteral("bestNsPerPixel")).toDouble();
+        result.peakRssKb = static_cast<qint64>(entry.value(QStringLiteral("peakRssKb")).toDouble());
+        results->append(result);
+    }
+
+    return true;
+}
+
+QString BenchmarkReport::compare(const QVector<BenchmarkResult> &baseline, const QVector<BenchmarkResult> &current, double tolerance, int *regressions)
+{
+    QHash<QString, BenchmarkResult> baselineByKey;
+
+    for(const BenchmarkResult& result : baseline)
+        baselineByKey.insert(result.key(), result);
+
+    QString text;
+    QTextStream stream(&text);
+
+    *regressions = 0;
+
+    for(const BenchmarkResult& result : current) {
+        if(!baselineByKey.contains(result.key()))
+            continue;
+
+        const BenchmarkResult& before = baselineByKey[result.key()];
+        if(before.medianNsPerPixel <= 0)
+            continue;
+
+        // > 1 means the current build is slower
+        double ratio = result.medianNsPerPixel / before.medianNsPerPixel;
+        bool regressed = ratio > 1.0 + tolerance;
+
+        if(regressed)
+            ++*regressions;
+
+        stream << result.key().leftJustified(48) << ' '
+               << QString::number(before.medianNsPerPixel, 'f', 3).rightJustified(10) << " -> "
+               << QString::number(result.medianNsPerPixel, 'f', 3).rightJustified(10) << " ns/px  x"
+               << QString::number(ratio, 'f', 3) << (regressed ? "  REGRESSION" : "") << '\n';
+    }
+
+    stream.flush();
+
+    return text;
+}
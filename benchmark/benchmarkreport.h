@@ -0,0 +1,28 @@
+#ifndef BENCHMARKREPORT_H
+#define BENCHMARKREPORT_H
+
+#include <QString>
+#include <QVector>
+#include "benchmarksuite.h"
+
+/*
+ * Machine readable benchmark results.
+ *
+ * JSON keeps the run metadata next to the results and is what --baseline
+ * reads back; CSV has one row per result for spreadsheets and plotting.
+*/
+namespace BenchmarkReport
+{
+bool writeJson(const QVector<BenchmarkResult>& results, const QString& fileName, QString* errorMessage);
+bool writeCsv(const QVector<BenchmarkResult>& results, const QString& fileName, QString* errorMessage);
+bool readJson(const QString& fileName, QVector<BenchmarkResult>* results, QString* errorMessage);
+
+/*
+ * One line per result found in both runs with the median ns/pixel of each and
+ * their ratio; results more than tolerance (0.05 = 5%) slower are marked.
+ * regressions receives the number of marked results.
+*/
+QString compare(const QVector<BenchmarkResult>& baseline, const QVector<BenchmarkResult>& current, double tolerance, int* regressions);
+};
+
+#endif // BENCHMARKREPORT_H
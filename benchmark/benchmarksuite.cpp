@@ -0,0 +1,401 @@
+#include "benchmarksuite.h"
+#include <QElapsedTimer>
+#include <QFile>
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include "fastfouriertransform.h"
+#include "filter.h"
+#include "integralimage.h"
+#include "luminance.h"
+#include "pipeline.h"
+#include "pointop.h"
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#elif defined(Q_OS_UNIX)
+#include <sys/resource.h>
+#endif
+
+// Lets the peak resident set restart from the current one, so every case reports its own peak (Linux only)
+static void resetPeakRss()
+{
+#if defined(Q_OS_LINUX)
+    QFile clearRefs(QStringLiteral("/proc/self/clear_refs"));
+    if(clearRefs.open(QIODevice::WriteOnly))
+        clearRefs.write("5");
+#endif
+}
+
+static qint64 peakRssKb()
+{
+#if defined(Q_OS_LINUX)
+    QFile status(QStringLiteral("/proc/self/status"));
+    if(status.open(QIODevice::ReadOnly)) {
+        while(!status.atEnd()) {
+            QByteArray line = status.readLine();
+            if(line.startsWith("VmHWM:"))
+                return line.mid(6).trimmed().split(' ').value(0).toLongLong();
+        }
+    }
+    return -1;
+#elif defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS counters;
+    if(GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return static_cast<qint64>(counters.PeakWorkingSetSize / 1024);
+    return -1;
+#elif defined(Q_OS_UNIX)
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) != 0)
+        return -1;
+#if defined(Q_OS_DARWIN)
+    return static_cast<qint64>(usage.ru_maxrss / 1024); // bytes on macOS
+#else
+    return static_cast<qint64>(usage.ru_maxrss);
+#endif
+#else
+    return -1;
+#endif
+}
+
+// Complex copy of the image luminance laid out for FFT2D, which indexes c[x][y]
+struct FFTBuffers
+{
+    std::vector<Complex> storage;
+    std::vector<Complex*> columns;
+};
+
+// Forward and reverse FFT2D, the round trip keeps the data bounded across iterations
+static std::function<void()> prepareFFT2D(const QImage& image)
+{
+    const int width = image.width();
+    const int height = image.height();
+
+    std::shared_ptr<FFTBuffers> buffers = std::make_shared<FFTBuffers>();
+    buffers->storage.assign(static_cast<size_t>(width) * height, Complex());
+    buffers->columns.resize(width);
+
+    for(int x = 0; x < width; ++x)
+        buffers->columns[x] = &buffers->storage[static_cast<size_t>(x) * height];
+
+    for(int y = 0; y < height; ++y)
+        for(int x = 0; x < width; ++x)
+            buffers->columns[x][y].real = qGray(image.pixel(x, y));
+
+    return [buffers, width, height]() {
+        FFT2D(buffers->columns.data(), width, height, 1);
+        FFT2D(buffers->columns.data(), width, height, -1);
+    };
+}
+
+QString BenchmarkResult::key() const
+{
+    return QStringLiteral("%1/%2/%3x%4").arg(name, format).arg(width).arg(height);
+}
+
+double BenchmarkResult::megapixelsPerSecond() const
+{
+    return medianNsPerPixel > 0 ? 1000.0 / medianNsPerPixel : 0;
+}
+
+BenchmarkSuite::BenchmarkSuite() :
+    m_sizes({256, 512, 1024, 2048, 4096, 8192}),
+    m_formats({QStringLiteral("gray8"), QStringLiteral("argb32")}),
+    m_cases(caseNames()),
+    m_minimumTimeMs(500),
+    m_maxIterations(100)
+{
+}
+
+BenchmarkSuite::Case BenchmarkSuite::imageCase(const QString &name, const std::function<void (const QImage &)> &body)
+{
+    Case benchmarkCase;
+    benchmarkCase.name = name;
+    benchmarkCase.usesImage = true;
+    benchmarkCase.prepare = [body](const QImage& image) -> Iteration {
+        return [body, image]() { body(image); };
+    };
+
+    return benchmarkCase;
+}
+
+QVector<BenchmarkSuite::Case> BenchmarkSuite::allCases()
+{
+    QVector<Case> cases;
+
+    cases.append(imageCase(QStringLiteral("crazyFilter"), [](const QImage& image) { Filter::crazyFilter(3, image); }));
+    // the gray filters share a cached luminance plane, drop it so every iteration converts the image
+    cases.append(imageCase(QStringLiteral("sobelFilter"), [](const QImage& image) {
+        Luminance::clearCache();
+        Filter::sobelFilter(image, 0, 255);
+    }));
+    cases.append(imageCase(QStringLiteral("prewittFilter"), [](const QImage& image) {
+        Luminance::clearCache();
+        Filter::prewittFilter(image, 0, 255);
+    }));
+    cases.append(imageCase(QStringLiteral("grayBlurFilter"), [](const QImage& image) {
+        Luminance::clearCache();
+        Filter::grayBlurFilter(image);
+    }));
+
+    // switching edge filters on the same image, the luminance plane is converted once
+    Case cachedLuminance;
+    cachedLuminance.name = QStringLiteral("sobelPrewittCachedLuminance");
+    cachedLuminance.usesImage = true;
+    cachedLuminance.prepare = [](const QImage& image) -> Iteration {
+        Luminance::clearCache();
+        Luminance::plane(image);
+        return [image]() {
+            Filter::sobelFilter(image, 0, 255);
+            Filter::prewittFilter(image, 0, 255);
+        };
+    };
+    cases.append(cachedLuminance);
+
+    // separable running sums, the cost should not depend on the radius
+    cases.append(imageCase(QStringLiteral("boxBlurRadius5"), [](const QImage& image) { Filter::boxBlurFilter(image, 5); }));
+    cases.append(imageCase(QStringLiteral("boxBlurRadius50"), [](const QImage& image) { Filter::boxBlurFilter(image, 50); }));
+    cases.append(imageCase(QStringLiteral("gaussianBlurSigma10"), [](const QImage& image) { Filter::gaussianBlurFilter(image, 10); }));
+    cases.append(imageCase(QStringLiteral("separableFilter5Taps"), [](const QImage& image) {
+        static const QVector<double> kernel = { 1 / 16.0, 4 / 16.0, 6 / 16.0, 4 / 16.0, 1 / 16.0 };
+        Filter::separableFilter(image, kernel, kernel);
+    }));
+    // window filters on the integral image, the first one pays for building the tables
+    cases.append(imageCase(QStringLiteral("integralImage"), [](const QImage& image) {
+        Luminance::clearCache();
+        IntegralImage integral(image);
+    }));
+    cases.append(imageCase(QStringLiteral("localMeanFilter"), [](const QImage& image) {
+        Luminance::clearCache();
+        IntegralImage::clearCache();
+        Filter::localMeanFilter(image, 25);
+    }));
+    cases.append(imageCase(QStringLiteral("adaptiveThresholdFilter"), [](const QImage& image) {
+        Luminance::clearCache();
+        IntegralImage::clearCache();
+        Filter::adaptiveThresholdFilter(image, 25, 5);
+    }));
+    cases.append(imageCase(QStringLiteral("rotationTransform"), [](const QImage& image) { Filter::rotationTransform(30, image, false); }));
+    cases.append(imageCase(QStringLiteral("rotationTransformBilinear"), [](const QImage& image) { Filter::rotationTransform(30, image, true); }));
+
+    // rotation about the center and a slight zoom, one affine resample of the full image
+    for(int sampling = Filter::NearestSampling; sampling <= Filter::BicubicSampling; ++sampling) {
+        static const char* const names[] = { "warpNearest", "warpBilinear", "warpBicubic" };
+        cases.append(imageCase(QLatin1String(names[sampling]), [sampling](const QImage& image) {
+            Filter::Warp warp;
+            warp.rotate(30, QPointF(image.width() / 2.0, image.height() / 2.0)).scale(1.1, 1.1);
+            warp.apply(image, static_cast<Filter::Sampling>(sampling));
+        }));
+    }
+    cases.append(imageCase(QStringLiteral("warpProjective"), [](const QImage& image) {
+        QTransform keystone(1, 0, 0.2 / image.width(), 0, 1, 0, 0, 0, 1);
+        Filter::warpTransform(image, keystone, Filter::BilinearSampling);
+    }));
+
+    // the same edge detection chain as separate calls and as one fused pass
+    cases.append(imageCase(QStringLiteral("chainSequential"), [](const QImage& image) {
+        QImage result = Filter::crazyFilter(3, image);
+        result = Filter::grayBlurFilter(result);
+        result = Filter::sobelFilter(result, 0, 255);
+        result = Filter::grayBlurFilter(result);
+        Filter::prewittFilter(result, 0, 255);
+    }));
+    cases.append(imageCase(QStringLiteral("chainPipeline"), [](const QImage& image) {
+        Filter::Pipeline pipeline;
+        pipeline.crazyFilter(3).grayBlurFilter().sobelFilter(0, 255).grayBlurFilter().prewittFilter(0, 255);
+        pipeline.apply(image);
+    }));
+
+    // a colour correction as one op per call and as one composed table
+    cases.append(imageCase(QStringLiteral("pointOpSequential"), [](const QImage& image) {
+        QImage result = Filter::PointOp::gain(1.2, -10).apply(image);
+        result = Filter::PointOp::gamma(1.8).apply(result);
+        Filter::PointOp::invert().apply(result);
+    }));
+    cases.append(imageCase(QStringLiteral("pointOpComposed"), [](const QImage& image) {
+        Filter::PointOp::gain(1.2, -10).then(Filter::PointOp::gamma(1.8)).then(Filter::PointOp::invert()).apply(image);
+    }));
+
+    // the Fourier filters cache the forward spectrum, drop it so every iteration pays the full cost
+    cases.append(imageCase(QStringLiteral("lowPassFilter"), [](const QImage& image) {
+        Filter::clearSpectrumCache();
+        Luminance::clearCache();
+        Filter::lowPassFilter(image, 40);
+    }));
+    cases.append(imageCase(QStringLiteral("highPassFilter"), [](const QImage& image) {
+        Filter::clearSpectrumCache();
+        Luminance::clearCache();
+        Filter::highPassFilter(image, 20);
+    }));
+    cases.append(imageCase(QStringLiteral("bandPassFilter"), [](const QImage& image) {
+        Filter::clearSpectrumCache();
+        Luminance::clearCache();
+        Filter::bandPassFilter(image, 20, 70);
+    }));
+
+    // a slider move on an image whose spectrum is already cached
+    Case cachedLowPass;
+    cachedLowPass.name = QStringLiteral("lowPassFilterCached");
+    cachedLowPass.usesImage = true;
+    cachedLowPass.prepare = [](const QImage& image) -> Iteration {
+        Filter::clearSpectrumCache();
+        Filter::lowPassFilter(image, 40);
+        return [image]() { Filter::lowPassFilter(image, 40); };
+    };
+    cases.append(cachedLowPass);
+
+    // smooth masks cost the same table pass as the ideal one
+    Case cachedGaussianLowPass = cachedLowPass;
+    cachedGaussianLowPass.name = QStringLiteral("lowPassFilterGaussianCached");
+    cachedGaussianLowPass.prepare = [](const QImage& image) -> Iteration {
+        Filter::clearSpectrumCache();
+        Filter::lowPassFilter(image, 40, Filter::GaussianMask);
+        return [image]() { Filter::lowPassFilter(image, 40, Filter::GaussianMask); };
+    };
+    cases.append(cachedGaussianLowPass);
+
+    cases.append(imageCase(QStringLiteral("highPassFilterMagnitude"), [](const QImage& image) { Filter::highPassFilterMagnitude(image, 5); }));
+
+    Case fft2d;
+    fft2d.name = QStringLiteral("FFT2D");
+    fft2d.usesImage = false;
+    fft2d.prepare = prepareFFT2D;
+    cases.append(fft2d);
+
+    return cases;
+}
+
+QStringList BenchmarkSuite::caseNames()
+{
+    QStringList names;
+
+    for(const Case& benchmarkCase : allCases())
+        names << benchmarkCase.name;
+
+    return names;
+}
+
+void BenchmarkSuite::setSizes(const QVector<int> &sizes)
+{
+    m_sizes = sizes;
+}
+
+void BenchmarkSuite::setFormats(const QStringList &formats)
+{
+    m_formats = formats;
+}
+
+void BenchmarkSuite::setCases(const QStringList &names)
+{
+    m_cases = names;
+}
+
+void BenchmarkSuite::setMinimumTime(int milliseconds)
+{
+    m_minimumTimeMs = qMax(0, milliseconds);
+}
+
+void BenchmarkSuite::setMaxIterations(int iterations)
+{
+    m_maxIterations = qMax(1, iterations);
+}
+
+QImage BenchmarkSuite::syntheticImage(int width, int height, QImage::Format format)
+{
+    QImage image(width, height, QImage::Format_ARGB32);
+
+    // smooth gradients with a fixed pseudo random texture, so edges and every frequency band carry energy
+    quint32 seed = 0x12345678u;
+
+    for(int y = 0; y < height; ++y) {
+        QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(y));
+
+        for(int x = 0; x < width; ++x) {
+            seed = seed * 1664525u + 1013904223u;
+            int noise = static_cast<int>(seed >> 27);
+
+            int red = (x * 255 / qMax(1, width - 1) + noise) & 255;
+            int green = (y * 255 / qMax(1, height - 1) + noise) & 255;
+            int blue = ((x ^ y) + noise) & 255;
+
+            line[x] = qRgba(red, green, blue, 255);
+        }
+    }
+
+    return format == QImage::Format_ARGB32 ? image : image.convertToFormat(format);
+}
+
+BenchmarkResult BenchmarkSuite::runCase(const Case &benchmarkCase, const QImage &image, const QString &format) const
+{
+    BenchmarkResult result;
+    result.name = benchmarkCase.name;
+    result.format = format;
+    result.width = image.width();
+    result.height = image.height();
+
+    const double pixels = static_cast<double>(image.width()) * image.height();
+    std::vector<qint64> samples;
+
+    resetPeakRss();
+
+    Iteration iteration = benchmarkCase.prepare(image);
+
+    QElapsedTimer total;
+    total.start();
+
+    do {
+        QElapsedTimer timer;
+        timer.start();
+        iteration();
+        samples.push_back(timer.nsecsElapsed());
+    } while(total.elapsed() < m_minimumTimeMs && static_cast<int>(samples.size()) < m_maxIterations);
+
+    result.peakRssKb = peakRssKb();
+    iteration = Iteration();
+
+    std::sort(samples.begin(), samples.end());
+    result.iterations = static_cast<int>(samples.size());
+    result.bestNsPerPixel = samples.front() / pixels;
+    result.medianNsPerPixel = samples[samples.size() / 2] / pixels;
+
+    return result;
+}
+
+QVector<BenchmarkResult> BenchmarkSuite::run(const std::function<void (const BenchmarkResult &)> &progress) const
+{
+    QVector<BenchmarkResult> results;
+    const QVector<Case> cases = allCases();
+
+    for(int size : m_sizes) {
+        bool sizeOnlyCasesDone = false;
+
+        for(const QString& format : m_formats) {
+            QImage::Format imageFormat = format == QLatin1String("gray8") ? QImage::Format_Grayscale8 : QImage::Format_ARGB32;
+            QImage image = syntheticImage(size, size, imageFormat);
+
+            for(const Case& benchmarkCase : cases) {
+                if(!m_cases.contains(benchmarkCase.name))
+                    continue;
+
+                if(!benchmarkCase.usesImage) {
+                    if(sizeOnlyCasesDone)
+                        continue;
+
+                    BenchmarkResult result = runCase(benchmarkCase, image, QStringLiteral("complex"));
+                    results.append(result);
+                    progress(result);
+                    continue;
+                }
+
+                BenchmarkResult result = runCase(benchmarkCase, image, format);
+                results.append(result);
+                progress(result);
+            }
+
+            sizeOnlyCasesDone = true;
+        }
+    }
+
+    return results;
+}
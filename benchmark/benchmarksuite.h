@@ -0,0 +1,73 @@
+#ifndef BENCHMARKSUITE_H
+#define BENCHMARKSUITE_H
+
+#include <QImage>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <functional>
+
+struct BenchmarkResult
+{
+    QString name;       // benchmark case, e.g. "sobelFilter"
+    QString format;     // "gray8", "argb32", or "complex" for the raw FFT
+    int width = 0;
+    int height = 0;
+    int iterations = 0;
+    double medianNsPerPixel = 0;
+    double bestNsPerPixel = 0;
+    qint64 peakRssKb = 0; // peak resident set of the process while the case ran, -1 if unknown
+
+    QString key() const;
+    double megapixelsPerSecond() const;
+};
+
+/*
+ * Times Filter:: functions and FFT2D on synthetic images.
+ *
+ * Every case runs at least once and is repeated until minimumTimeMs has
+ * passed (or maxIterations is reached); the median and the best iteration
+ * are reported per pixel of the input image. The inputs are deterministic, so
+ * two builds see exactly the same pixels.
+*/
+class BenchmarkSuite
+{
+public:
+    BenchmarkSuite();
+
+    static QStringList caseNames();
+
+    void setSizes(const QVector<int>& sizes);
+    void setFormats(const QStringList& formats);
+    void setCases(const QStringList& names);
+    void setMinimumTime(int milliseconds);
+    void setMaxIterations(int iterations);
+
+    // Runs every selected case; progress is called after each one
+    QVector<BenchmarkResult> run(const std::function<void(const BenchmarkResult&)>& progress) const;
+
+    static QImage syntheticImage(int width, int height, QImage::Format format);
+
+private:
+    typedef std::function<void()> Iteration;
+
+    struct Case
+    {
+        QString name;
+        bool usesImage; // false for cases that only depend on the size, run once per size
+        std::function<Iteration(const QImage&)> prepare; // untimed, the returned iteration owns what it needs
+    };
+
+    static Case imageCase(const QString& name, const std::function<void(const QImage&)>& body);
+    static QVector<Case> allCases();
+
+    BenchmarkResult runCase(const Case& benchmarkCase, const QImage& image, const QString& format) const;
+
+    QVector<int> m_sizes;
+    QStringList m_formats;
+    QStringList m_cases;
+    int m_minimumTimeMs;
+    int m_maxIterations;
+};
+
+#endif // BENCHMARKSUITE_H
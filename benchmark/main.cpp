@@ -0,0 +1,156 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QTextStream>
+#include "benchmarkreport.h"
+#include "benchmarksuite.h"
+#include "filter.h"
+
+static bool parseList(const QString& value, const QStringList& allowed, QStringList* list, QString* errorMessage)
+{
+    *list = value.split(QLatin1Char(','), QString::SkipEmptyParts);
+
+    for(const QString& item : qAsConst(*list)) {
+        if(!allowed.contains(item)) {
+            *errorMessage = QStringLiteral("Unknown value %1, expected one of: %2").arg(item, allowed.join(QStringLiteral(", ")));
+            return false;
+        }
+    }
+
+    return !list->isEmpty();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("imagefilters-benchmark"));
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Times every ImageFilters filter on synthetic square images.\n\n"
+                                                    "Cases: ") + BenchmarkSuite::caseNames().join(QStringLiteral(", ")));
+    parser.addHelpOption();
+
+    QCommandLineOption sizesOption(QStringList() << QStringLiteral("s") << QStringLiteral("sizes"),
+                                   QStringLiteral("Comma separated image sizes (default: 256,512,1024,2048,4096,8192)."), QStringLiteral("sizes"));
+    QCommandLineOption formatsOption(QStringList() << QStringLiteral("formats"),
+                                     QStringLiteral("Comma separated formats, gray8 and/or argb32 (default: both)."), QStringLiteral("formats"));
+    QCommandLineOption casesOption(QStringList() << QStringLiteral("c") << QStringLiteral("cases"),
+                                   QStringLiteral("Comma separated cases to run (default: all)."), QStringLiteral("cases"));
+    QCommandLineOption minTimeOption(QStringList() << QStringLiteral("min-time"),
+                                     QStringLiteral("Minimum time spent on each case in milliseconds (default: 500)."), QStringLiteral("ms"));
+    QCommandLineOption maxIterationsOption(QStringList() << QStringLiteral("max-iterations"),
+                                           QStringLiteral("Maximum iterations of each case (default: 100)."), QStringLiteral("count"));
+    QCommandLineOption threadsOption(QStringList() << QStringLiteral("j") << QStringLiteral("threads"),
+                                     QStringLiteral("Threads each filter may use (default: one per core)."), QStringLiteral("count"));
+    QCommandLineOption jsonOption(QStringList() << QStringLiteral("json"),
+                                  QStringLiteral("Write the results as JSON."), QStringLiteral("file"));
+    QCommandLineOption csvOption(QStringList() << QStringLiteral("csv"),
+                                 QStringLiteral("Write the results as CSV."), QStringLiteral("file"));
+    QCommandLineOption baselineOption(QStringList() << QStringLiteral("baseline"),
+                                      QStringLiteral("JSON results of an earlier run to compare against."), QStringLiteral("file"));
+    QCommandLineOption toleranceOption(QStringList() << QStringLiteral("tolerance"),
+                                       QStringLiteral("Slowdown in percent reported as a regression (default: 5)."), QStringLiteral("percent"), QStringLiteral("5"));
+
+    parser.addOption(sizesOption);
+    parser.addOption(formatsOption);
+    parser.addOption(casesOption);
+    parser.addOption(minTimeOption);
+    parser.addOption(maxIterationsOption);
+    parser.addOption(threadsOption);
+    parser.addOption(jsonOption);
+    parser.addOption(csvOption);
+    parser.addOption(baselineOption);
+    parser.addOption(toleranceOption);
+    parser.process(app);
+
+    QString errorMessage;
+    BenchmarkSuite suite;
+
+    if(parser.isSet(sizesOption)) {
+        QVector<int> sizes;
+
+        for(const QString& value : parser.value(sizesOption).split(QLatin1Char(','), QString::SkipEmptyParts)) {
+            bool ok = false;
+            int size = value.toInt(&ok);
+            if(!ok || size < 3) {
+                err << "Invalid image size " << value << endl;
+                return 1;
+            }
+            sizes.append(size);
+        }
+        suite.setSizes(sizes);
+    }
+
+    if(parser.isSet(formatsOption)) {
+        QStringList formats;
+        if(!parseList(parser.value(formatsOption), QStringList() << QStringLiteral("gray8") << QStringLiteral("argb32"), &formats, &errorMessage)) {
+            err << errorMessage << endl;
+            return 1;
+        }
+        suite.setFormats(formats);
+    }
+
+    if(parser.isSet(casesOption)) {
+        QStringList cases;
+        if(!parseList(parser.value(casesOption), BenchmarkSuite::caseNames(), &cases, &errorMessage)) {
+            err << errorMessage << endl;
+            return 1;
+        }
+        suite.setCases(cases);
+    }
+
+    if(parser.isSet(minTimeOption))
+        suite.setMinimumTime(parser.value(minTimeOption).toInt());
+
+    if(parser.isSet(maxIterationsOption))
+        suite.setMaxIterations(parser.value(maxIterationsOption).toInt());
+
+    if(parser.isSet(threadsOption)) {
+        bool ok = false;
+        int threads = parser.value(threadsOption).toInt(&ok);
+        if(!ok || threads < 1) {
+            err << "Invalid thread count " << parser.value(threadsOption) << endl;
+            return 1;
+        }
+        Filter::setThreadCount(threads);
+    }
+
+    QVector<BenchmarkResult> baseline;
+    if(parser.isSet(baselineOption) && !BenchmarkReport::readJson(parser.value(baselineOption), &baseline, &errorMessage)) {
+        err << errorMessage << endl;
+        return 1;
+    }
+
+    out << "Running with " << Filter::threadCount() << " filter threads" << endl;
+
+    QVector<BenchmarkResult> results = suite.run([&out](const BenchmarkResult& result) {
+        out << result.key().leftJustified(48) << ' '
+            << QString::number(result.medianNsPerPixel, 'f', 3).rightJustified(10) << " ns/px "
+            << QString::number(result.megapixelsPerSecond(), 'f', 1).rightJustified(9) << " MP/s "
+            << QString::number(result.peakRssKb / 1024.0, 'f', 1).rightJustified(9) << " MB peak  ("
+            << result.iterations << " iterations)" << endl;
+    });
+
+    if(parser.isSet(jsonOption) && !BenchmarkReport::writeJson(results, parser.value(jsonOption), &errorMessage)) {
+        err << errorMessage << endl;
+        return 1;
+    }
+
+    if(parser.isSet(csvOption) && !BenchmarkReport::writeCsv(results, parser.value(csvOption), &errorMessage)) {
+        err << errorMessage << endl;
+        return 1;
+    }
+
+    if(parser.isSet(baselineOption)) {
+        int regressions = 0;
+        out << endl << "Compared with " << parser.value(baselineOption) << ':' << endl
+            << BenchmarkReport::compare(baseline, results, parser.value(toleranceOption).toDouble() / 100.0, &regressions);
+        out << regressions << " regressions" << endl;
+
+        return regressions == 0 ? 0 : 3;
+    }
+
+    return 0;
+}
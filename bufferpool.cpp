@@ -0,0 +1,237 @@
+#include "bufferpool.h"
+#include <QMutex>
+#include <QMutexLocker>
+#include <vector>
+#include "trace.h"
+
+static const size_t Alignment = 64;
+static const qint64 DefaultCacheLimit = 512LL * 1024 * 1024;
+
+struct CachedBlock {
+    void* data;
+    size_t capacity;
+};
+
+struct Pool {
+    QMutex mutex;
+    // released blocks, the least recently released first
+    std::vector<CachedBlock> cached;
+    qint64 cacheLimit = DefaultCacheLimit;
+    BufferPool::Statistics statistics;
+};
+
+// Never destroyed, images released during static destruction still find it
+static Pool& sharedPool()
+{
+    static Pool* pool = new Pool;
+    return *pool;
+}
+
+// bytes rounded up to a multiple of a quarter of the largest power of two not above it
+static size_t sizeClass(size_t bytes)
+{
+    size_t step = Alignment;
+    while(step * 8 <= bytes)
+        step *= 2;
+
+    return (qMax(bytes, static_cast<size_t>(1)) + step - 1) / step * step;
+}
+
+// Removes the least recently released blocks beyond the cache limit for the caller to free, with the mutex held
+static std::vector<void*> takeExcess(Pool& pool)
+{
+    std::vector<void*> excess;
+    size_t count = 0;
+
+    while(count < pool.cached.size() && pool.statistics.bytesCached > pool.cacheLimit) {
+        excess.push_back(pool.cached[count].data);
+        pool.statistics.bytesCached -= static_cast<qint64>(pool.cached[count].capacity);
+        ++count;
+    }
+
+    pool.cached.erase(pool.cached.begin(), pool.cached.begin() + static_cast<std::ptrdiff_t>(count));
+    return excess;
+}
+
+static void release(void* data, size_t capacity)
+{
+    Pool& pool = sharedPool();
+    std::vector<void*> excess;
+
+    {
+        QMutexLocker locker(&pool.mutex);
+        pool.statistics.bytesInUse -= static_cast<qint64>(capacity);
+        pool.statistics.bytesCached += static_cast<qint64>(capacity);
+        pool.cached.push_back({ data, capacity });
+        excess = takeExcess(pool);
+    }
+
+    for(void* block : excess)
+        qFreeAligned(block);
+}
+
+BufferPool::Buffer::Buffer() : m_data(nullptr), m_size(0), m_capacity(0)
+{
+}
+
+BufferPool::Buffer::Buffer(Buffer &&other) : m_data(other.m_data), m_size(other.m_size), m_capacity(other.m_capacity)
+{
+    other.m_data = nullptr;
+    other.m_size = 0;
+    other.m_capacity = 0;
+}
+
+BufferPool::Buffer &BufferPool::Buffer::operator=(Buffer &&other)
+{
+    if(this != &other) {
+        if(m_data)
+            release(m_data, m_capacity);
+
+        m_data = other.m_data;
+        m_size = other.m_size;
+        m_capacity = other.m_capacity;
+        other.m_data = nullptr;
+        other.m_size = 0;
+        other.m_capacity = 0;
+    }
+
+    return *this;
+}
+
+BufferPool::Buffer::~Buffer()
+{
+    if(m_data)
+        release(m_data, m_capacity);
+}
+
+BufferPool::Buffer BufferPool::acquire(size_t bytes)
+{
+    Pool& pool = sharedPool();
+    const size_t capacity = sizeClass(bytes);
+    void* data = nullptr;
+
+    {
+        QMutexLocker locker(&pool.mutex);
+        ++pool.statistics.requests;
+
+        // the most recently released block of the class is the likeliest to still be in cache
+        for(size_t i = pool.cached.size(); i-- > 0;) {
+            if(pool.cached[i].capacity == capacity) {
+                data = pool.cached[i].data;
+                pool.cached.erase(pool.cached.begin() + static_cast<std::ptrdiff_t>(i));
+                pool.statistics.bytesCached -= static_cast<qint64>(capacity);
+                ++pool.statistics.hits;
+                Trace::cacheHits().add(1);
+                break;
+            }
+        }
+    }
+
+    if(!data) {
+        data = qMallocAligned(capacity, Alignment);
+        Trace::bytesAllocated().add(static_cast<qint64>(capacity));
+    }
+
+    Buffer buffer;
+
+    if(!data)
+        return buffer;
+
+    {
+        QMutexLocker locker(&pool.mutex);
+        pool.statistics.bytesInUse += static_cast<qint64>(capacity);
+        pool.statistics.peakBytesInUse = qMax(pool.statistics.peakBytesInUse, pool.statistics.bytesInUse);
+    }
+
+    buffer.m_data = data;
+    buffer.m_size = bytes;
+    buffer.m_capacity = capacity;
+    return buffer;
+}
+
+static void releaseImageBuffer(void* info)
+{
+    delete static_cast<BufferPool::Buffer*>(info);
+}
+
+QImage BufferPool::image(int width, int height, QImage::Format format)
+{
+    int depth;
+
+    switch(format) {
+    case QImage::Format_Grayscale8:
+        depth = 8;
+        break;
+    case QImage::Format_RGB32:
+    case QImage::Format_ARGB32:
+    case QImage::Format_ARGB32_Premultiplied:
+        depth = 32;
+        break;
+    default:
+        // the formats the filters do not produce come from the heap
+        return QImage(width, height, format);
+    }
+
+    if(width <= 0 || height <= 0)
+        return QImage();
+
+    // rows padded to 32 bits like those of QImage's own buffers
+    const int bytesPerLine = static_cast<int>((static_cast<qint64>(width) * depth + 31) / 32 * 4);
+    Buffer* buffer = new Buffer(acquire(static_cast<size_t>(bytesPerLine) * height));
+
+    if(buffer->isNull()) {
+        delete buffer;
+        return QImage();
+    }
+
+    QImage image(buffer->as<uchar>(), width, height, bytesPerLine, format, releaseImageBuffer, buffer);
+
+    if(image.isNull())
+        delete buffer;
+
+    return image;
+}
+
+BufferPool::Statistics BufferPool::statistics()
+{
+    Pool& pool = sharedPool();
+    QMutexLocker locker(&pool.mutex);
+    return pool.statistics;
+}
+
+void BufferPool::setCacheLimit(qint64 bytes)
+{
+    Pool& pool = sharedPool();
+    std::vector<void*> excess;
+
+    {
+        QMutexLocker locker(&pool.mutex);
+        pool.cacheLimit = qMax(static_cast<qint64>(0), bytes);
+        excess = takeExcess(pool);
+    }
+
+    for(void* block : excess)
+        qFreeAligned(block);
+}
+
+qint64 BufferPool::cacheLimit()
+{
+    Pool& pool = sharedPool();
+    QMutexLocker locker(&pool.mutex);
+    return pool.cacheLimit;
+}
+
+void BufferPool::trim()
+{
+    Pool& pool = sharedPool();
+    std::vector<CachedBlock> cached;
+
+    {
+        QMutexLocker locker(&pool.mutex);
+        cached.swap(pool.cached);
+        pool.statistics.bytesCached = 0;
+    }
+
+    for(const CachedBlock& block : cached)
+        qFreeAligned(block.data);
+}
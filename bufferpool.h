@@ -0,0 +1,78 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <QImage>
+#include <QtGlobal>
+#include <cstddef>
+
+/*
+ * Reuses the large scratch and result buffers of the filters across calls.
+ *
+ * Requests are rounded up to size classes, four per power of two, and a
+ * released block waits in the pool for the next request of its class, so
+ * repeated runs of a filter on the same image size (every slider release)
+ * get back memory that is already mapped instead of page faulting hundreds
+ * of MB of fresh allocations in. Blocks are 64 byte aligned. The least
+ * recently released blocks are freed once the cached ones exceed the cache
+ * limit.
+*/
+namespace BufferPool
+{
+// Block of memory borrowed from the pool, handed back when the handle goes away
+class Buffer
+{
+public:
+    Buffer();
+    Buffer(Buffer&& other);
+    Buffer& operator=(Buffer&& other);
+    ~Buffer();
+
+    Buffer(const Buffer&) = delete;
+    Buffer& operator=(const Buffer&) = delete;
+
+    bool isNull() const { return !m_data; }
+    // The requested size, the block may be larger
+    size_t size() const { return m_size; }
+    void* data() const { return m_data; }
+
+    template <typename T>
+    T* as() const { return static_cast<T*>(m_data); }
+
+private:
+    friend Buffer acquire(size_t bytes);
+
+    void* m_data;
+    size_t m_size;
+    size_t m_capacity;
+};
+
+struct Statistics {
+    // acquire() calls and the ones served from the cache
+    quint64 requests = 0;
+    quint64 hits = 0;
+    // bytes held by buffers and images, and by blocks waiting for reuse
+    qint64 bytesInUse = 0;
+    qint64 bytesCached = 0;
+    qint64 peakBytesInUse = 0;
+};
+
+// Uninitialized block of at least bytes, null if the allocation fails
+Buffer acquire(size_t bytes);
+
+/*
+ * Uninitialized image like QImage(width, height, format) whose pixels come
+ * from the pool and go back to it with the last copy of the image.
+*/
+QImage image(int width, int height, QImage::Format format);
+
+Statistics statistics();
+
+// Bytes of released blocks kept for reuse, 512 MiB by default
+void setCacheLimit(qint64 bytes);
+qint64 cacheLimit();
+
+// Frees every cached block
+void trim();
+}
+
+#endif // BUFFERPOOL_H
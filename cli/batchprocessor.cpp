@@ -0,0 +1,301 @@
+#include "batchprocessor.h"
+#include <QAtomicInt>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QImageReader>
+#include <QImageWriter>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QTextStream>
+#include <QThread>
+#include <QThreadPool>
+#include "imageexport.h"
+#include "rawimage.h"
+#include "streaming.h"
+
+namespace {
+
+// Identity of a file for clash checks: links resolved for existing files, case folded where file systems ignore it
+QString pathKey(const QString& path)
+{
+    const QFileInfo info(path);
+    QString key = info.exists() ? info.canonicalFilePath() : QDir::cleanPath(info.absoluteFilePath());
+#if defined(Q_OS_WIN) || defined(Q_OS_DARWIN)
+    key = key.toLower();
+#endif
+    return key;
+}
+
+struct BatchState
+{
+    explicit BatchState(int slotCount) : queueSlots(slotCount) {}
+
+    QSemaphore queueSlots;
+    QAtomicInt processed;
+    QAtomicInt failed;
+    QAtomicInteger<qint64> pixels;
+    QMutex errorMutex;
+    QStringList errors;
+
+    void fail(const QString& message)
+    {
+        failed.fetchAndAddRelaxed(1);
+        QMutexLocker locker(&errorMutex);
+        errors << message;
+    }
+};
+
+class ImageJob : public QRunnable
+{
+public:
+    ImageJob(const FilterChain& chain, const QString& input, const QString& output, const QByteArray& format, BatchState* state) :
+        m_chain(chain),
+        m_input(input),
+        m_output(output),
+        m_format(format),
+        m_state(state)
+    {
+    }
+
+    void run() override
+    {
+        QString errorMessage;
+        QImage image;
+
+        if(RawImage::isRawImage(m_input)) {
+            image = RawImage::load(m_input, &errorMessage);
+        }
+        else {
+            QImageReader reader(m_input);
+            image = reader.read();
+            errorMessage = QStringLiteral("%1: %2").arg(m_input, reader.errorString());
+        }
+
+        if(image.isNull()) {
+            m_state->fail(errorMessage);
+        }
+        else {
+            QImage result = m_chain.apply(image);
+            ImageExport::Options options;
+            bool isWritten;
+
+            if(ImageExport::formatForSuffix(QString::fromLatin1(m_format), &options.format)) {
+                isWritten = ImageExport::save(result, m_output, options, &errorMessage);
+            }
+            else {
+                // formats ImageExport does not know (TIFF, WebP, ...)
+                QImageWriter writer(m_output, m_format);
+                isWritten = writer.write(result);
+                errorMessage = QStringLiteral("%1: %2").arg(m_output, writer.errorString());
+            }
+
+            if(!isWritten) {
+                m_state->fail(errorMessage);
+            }
+            else {
+                m_state->processed.fetchAndAddRelaxed(1);
+                m_state->pixels.fetchAndAddRelaxed(static_cast<qint64>(image.width()) * image.height());
+            }
+        }
+
+        m_state->queueSlots.release();
+    }
+
+private:
+    const FilterChain& m_chain;
+    QString m_input;
+    QString m_output;
+    QByteArray m_format;
+    BatchState* m_state;
+};
+
+}
+
+double BatchReport::imagesPerSecond() const
+{
+    return elapsedMs > 0 ? processed * 1000.0 / elapsedMs : 0.0;
+}
+
+double BatchReport::megapixelsPerSecond() const
+{
+    return elapsedMs > 0 ? pixels / 1000.0 / elapsedMs : 0.0;
+}
+
+BatchProcessor::BatchProcessor(const FilterChain &chain, const QString &outputDirectory, const QByteArray &outputFormat) :
+    m_chain(chain),
+    m_outputDirectory(outputDirectory),
+    m_outputFormat(outputFormat),
+    m_threadCount(QThread::idealThreadCount()),
+    m_memoryBudget(0)
+{
+}
+
+void BatchProcessor::setThreadCount(int threadCount)
+{
+    m_threadCount = qMax(1, threadCount);
+}
+
+int BatchProcessor::threadCount() const
+{
+    return m_threadCount;
+}
+
+void BatchProcessor::setMemoryBudget(qint64 bytes)
+{
+    m_memoryBudget = qMax<qint64>(0, bytes);
+}
+
+bool BatchProcessor::addInput(const QString &path, QString *errorMessage)
+{
+    QFileInfo info(path);
+
+    if(info.isDir()) {
+        QStringList nameFilters;
+        for(const QByteArray& format : QImageReader::supportedImageFormats())
+            nameFilters << QStringLiteral("*.") + QString::fromLatin1(format);
+        nameFilters << QStringLiteral("*.") + RawImage::suffix();
+
+        const QFileInfoList entries = QDir(path).entryInfoList(nameFilters, QDir::Files | QDir::Readable, QDir::Name);
+        for(const QFileInfo& entry : entries)
+            m_inputs << entry.absoluteFilePath();
+
+        return true;
+    }
+
+    if(!info.isFile()) {
+        *errorMessage = QStringLiteral("No such file or directory: %1").arg(path);
+        return false;
+    }
+
+    m_inputs << info.absoluteFilePath();
+    return true;
+}
+
+bool BatchProcessor::addInputList(const QString &listFileName, QString *errorMessage)
+{
+    QFile listFile(listFileName);
+
+    if(!listFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        *errorMessage = QStringLiteral("Could not open file list %1: %2").arg(listFileName, listFile.errorString());
+        return false;
+    }
+
+    QTextStream stream(&listFile);
+    while(!stream.atEnd()) {
+        const QString line = stream.readLine().trimmed();
+        if(line.isEmpty() || line.startsWith(QLatin1Char('#')))
+            continue;
+
+        if(!addInput(line, errorMessage))
+            return false;
+    }
+
+    return true;
+}
+
+int BatchProcessor::inputCount() const
+{
+    return m_inputs.size();
+}
+
+QString BatchProcessor::outputFileName(const QString &inputFileName) const
+{
+    const QString baseName = QFileInfo(inputFileName).completeBaseName();
+    QString suffix = QString::fromLatin1(m_outputFormat);
+
+    if(m_memoryBudget > 0 && suffix != RawImage::suffix())
+        suffix = QStringLiteral("pnm");
+
+    return QDir(m_outputDirectory).filePath(baseName + QLatin1Char('.') + suffix);
+}
+
+bool BatchProcessor::checkOutputs(QString *errorMessage) const
+{
+    QHash<QString, QString> inputs;
+    QHash<QString, QString> outputs;
+
+    for(const QString& input : m_inputs)
+        inputs.insert(pathKey(input), input);
+
+    for(const QString& input : m_inputs) {
+        const QString output = outputFileName(input);
+        const QString key = pathKey(output);
+
+        if(inputs.contains(key)) {
+            *errorMessage = QStringLiteral("The output %1 would overwrite the input %2, choose another output directory or format")
+                    .arg(output, inputs.value(key));
+            return false;
+        }
+
+        if(outputs.contains(key)) {
+            *errorMessage = QStringLiteral("%1 and %2 would both be written to %3")
+                    .arg(outputs.value(key), input, output);
+            return false;
+        }
+
+        outputs.insert(key, input);
+    }
+
+    return true;
+}
+
+// Every image gets the whole budget, so they run one after the other with the filter threads inside each strip
+BatchReport BatchProcessor::runStreaming()
+{
+    BatchReport report;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    for(const QString& input : qAsConst(m_inputs)) {
+        QString errorMessage;
+        Streaming::Report streamingReport;
+
+        if(!Streaming::filterFile(m_chain.pipeline(), input, outputFileName(input), m_memoryBudget, &errorMessage, &streamingReport)) {
+            ++report.failed;
+            report.errors << errorMessage;
+            continue;
+        }
+
+        ++report.processed;
+        report.pixels += static_cast<qint64>(streamingReport.width) * streamingReport.height;
+    }
+
+    report.elapsedMs = timer.elapsed();
+    return report;
+}
+
+BatchReport BatchProcessor::run()
+{
+    if(m_memoryBudget > 0)
+        return runStreaming();
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(m_threadCount);
+
+    BatchState state(2 * m_threadCount);
+
+    QElapsedTimer timer;
+    timer.start();
+
+    for(const QString& input : qAsConst(m_inputs)) {
+        state.queueSlots.acquire();
+        pool.start(new ImageJob(m_chain, input, outputFileName(input), m_outputFormat, &state));
+    }
+
+    pool.waitForDone();
+
+    BatchReport report;
+    report.elapsedMs = timer.elapsed();
+    report.processed = state.processed.loadAcquire();
+    report.failed = state.failed.loadAcquire();
+    report.pixels = state.pixels.loadAcquire();
+    report.errors = state.errors;
+
+    return report;
+}
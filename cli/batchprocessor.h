@@ -0,0 +1,70 @@
+#ifndef BATCHPROCESSOR_H
+#define BATCHPROCESSOR_H
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include "filterchain.h"
+
+struct BatchReport
+{
+    int processed = 0;
+    int failed = 0;
+    qint64 elapsedMs = 0;
+    qint64 pixels = 0;
+    QStringList errors;
+
+    double imagesPerSecond() const;
+    double megapixelsPerSecond() const;
+};
+
+/*
+ * Runs a FilterChain over a set of image files.
+ * Every image is an independent job (decode -> filter -> encode) served by a
+ * bounded pool of worker threads, so while one worker is decoding another one
+ * is filtering and a third one is encoding. At most twice the worker count of
+ * jobs is queued at any time, which keeps memory flat on directories with tens
+ * of thousands of frames.
+ *
+ * With a memory budget the inputs, which must then be binary PGM/PPM or .ifr
+ * files, are instead streamed one at a time in strips (see
+ * Streaming::filterFile()) and written as .pnm files, or .ifr files with the
+ * ifr output format, so images larger than memory can be filtered.
+*/
+class BatchProcessor
+{
+public:
+    BatchProcessor(const FilterChain& chain, const QString& outputDirectory, const QByteArray& outputFormat);
+
+    void setThreadCount(int threadCount);
+    int threadCount() const;
+
+    // 0, the default, loads whole images
+    void setMemoryBudget(qint64 bytes);
+
+    bool addInput(const QString& path, QString* errorMessage);
+    bool addInputList(const QString& listFileName, QString* errorMessage);
+    int inputCount() const;
+
+    /*
+     * Outputs are named after their input's base name, so a.png and a.jpg, or
+     * same-named files of different directories, would write the same file.
+     * Fails on such clashes and on outputs that would overwrite an input.
+    */
+    bool checkOutputs(QString* errorMessage) const;
+
+    BatchReport run();
+
+private:
+    QString outputFileName(const QString& inputFileName) const;
+    BatchReport runStreaming();
+
+    const FilterChain& m_chain;
+    QString m_outputDirectory;
+    QByteArray m_outputFormat;
+    int m_threadCount;
+    qint64 m_memoryBudget;
+    QStringList m_inputs;
+};
+
+#endif // BATCHPROCESSOR_H
@@ -0,0 +1,31 @@
+#-------------------------------------------------
+#
+# imagefilters-cli: runs Filter:: chains over whole
+# directories without the GUI
+#
+#-------------------------------------------------
+
+QT       += core gui
+QT       -= widgets
+
+CONFIG += console
+CONFIG -= app_bundle
+
+TARGET = imagefilters-cli
+TEMPLATE = app
+
+include(../imagefilters.pri)
+
+SOURCES += \
+        main.cpp \
+    batchprocessor.cpp \
+    filterchain.cpp
+
+HEADERS += \
+    batchprocessor.h \
+    filterchain.h
+
+# Default rules for deployment.
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
@@ -0,0 +1,339 @@
+#include "filterchain.h"
+
+static bool toInt(const QStringList& args, int index, int defaultValue, int* value)
+{
+    if(index >= args.size()) {
+        *value = defaultValue;
+        return true;
+    }
+
+    bool ok = false;
+    *value = args.at(index).toInt(&ok);
+    return ok;
+}
+
+static bool toDouble(const QStringList& args, int index, double* value)
+{
+    if(index >= args.size())
+        return false;
+
+    bool ok = false;
+    *value = args.at(index).toDouble(&ok);
+    return ok;
+}
+
+// Optional [:<mask>[:<order>]] suffix of the Fourier pass filters, starting at args[index]
+static bool toMask(const QStringList& args, int index, Filter::MaskShape* shape, int* order)
+{
+    static const char* const maskNames[] = { "ideal", "butterworth", "gaussian" };
+
+    *shape = Filter::IdealMask;
+    *order = 2;
+
+    if(index >= args.size())
+        return true;
+
+    if(args.size() > index + 2)
+        return false;
+
+    int i = 0;
+    while(i < 3 && args.at(index).toLower() != QLatin1String(maskNames[i]))
+        ++i;
+
+    if(i == 3)
+        return false;
+
+    *shape = static_cast<Filter::MaskShape>(i);
+
+    return toInt(args, index + 1, 2, order) && *order >= 1;
+}
+
+bool FilterChain::parse(const QString &spec, QString *errorMessage)
+{
+    const QStringList steps = spec.split(QLatin1Char(','));
+
+    for(const QString& step : steps) {
+        if(!parseStep(step.trimmed(), errorMessage))
+            return false;
+    }
+
+    return true;
+}
+
+bool FilterChain::parseStep(const QString &step, QString *errorMessage)
+{
+    const QStringList args = step.split(QLatin1Char(':'));
+    const QString name = args.first().toLower();
+    const QString badArguments = QStringLiteral("Invalid arguments for filter step \"%1\"").arg(step);
+
+    if(name == QLatin1String("scale") || name == QLatin1String("shear") ||
+       name == QLatin1String("translate") || name == QLatin1String("matrix")) {
+        if(!parseWarpStep(name, args)) {
+            *errorMessage = badArguments;
+            return false;
+        }
+    }
+    else if(name == QLatin1String("crazy")) {
+        int param;
+        if(args.size() != 2 || !toInt(args, 1, 0, &param)) {
+            *errorMessage = badArguments;
+            return false;
+        }
+        m_pipeline.crazyFilter(param);
+    }
+    else if(name == QLatin1String("gain")) {
+        double gain;
+        double bias = 0;
+        if(args.size() < 2 || args.size() > 3 || !toDouble(args, 1, &gain) || (args.size() == 3 && !toDouble(args, 2, &bias))) {
+            *errorMessage = badArguments;
+            return false;
+        }
+        m_pipeline.pointOp(Filter::PointOp::gain(gain, bias));
+    }
+    else if(name == QLatin1String("gamma")) {
+        double gamma;
+        if(args.size() != 2 || !toDouble(args, 1, &gamma) || gamma <= 0) {
+            *errorMessage = badArguments;
+            return false;
+        }
+        m_pipeline.pointOp(Filter::PointOp::gamma(gamma));
+    }
+    else if(name == QLatin1String("invert")) {
+        if(args.size() != 1) {
+            *errorMessage = badArguments;
+            return false;
+        }
+        m_pipeline.pointOp(Filter::PointOp::invert());
+    }
+    else if(name == QLatin1String("binarize")) {
+        int level;
+        if(args.size() != 2 || !toInt(args, 1, 0, &level)) {
+            *errorMessage = badArguments;
+            return false;
+        }
+        m_pipeline.pointOp(Filter::PointOp::threshold(level));
+    }
+    else if(name == QLatin1String("curve")) {
+        if(args.size() < 3 || args.size() % 2 == 0) {
+            *errorMessage = badArguments;
+            return false;
+        }
+        QVector<QPoint> points;
+        for(int i = 1; i < args.size(); i += 2) {
+            int x;
+            int y;
+            if(!toInt(args, i, 0, &x) || !toInt(args, i + 1, 0, &y) || (!points.isEmpty() && x <= points.last().x())) {
+                *errorMessage = badArguments;
+                return false;
+            }
+            points.append(QPoint(x, y));
+        }
+        m_pipeline.pointOp(Filter::PointOp::curve(points));
+    }
+    else if(name == QLatin1String("sobel") || name == QLatin1String("prewitt")) {
+        int minThreshold;
+        int maxThreshold;
+        if(args.size() > 3 || !toInt(args, 1, 0, &minThreshold) || !toInt(args, 2, 255, &maxThreshold)) {
+            *errorMessage = badArguments;
+            return false;
+        }
+        if(name == QLatin1String("sobel"))
+            m_pipeline.sobelFilter(minThreshold, maxThreshold);
+        else
+            m_pipeline.prewittFilter(minThreshold, maxThreshold);
+    }
+    else if(name == QLatin1String("blur")) {
+        if(args.size() != 1) {
+            *errorMessage = badArguments;
+            return false;
+        }
+        m_pipeline.grayBlurFilter();
+    }
+    else if(name == QLatin1String("boxblur")) {
+        int radius;
+        if(args.size() != 2 || !toInt(args, 1, 0, &radius) || radius < 0) {
+            *errorMessage = badArguments;
+            return false;
+        }
+        m_pipeline.boxBlurFilter(radius);
+    }
+    else if(name == QLatin1String("gaussian")) {
+        double sigma;
+        if(args.size() != 2 || !toDouble(args, 1, &sigma) || sigma <= 0) {
+            *errorMessage = badArguments;
+            return false;
+        }
+        m_pipeline.gaussianBlurFilter(sigma);
+    }
+    else if(name == QLatin1String("localmean")) {
+        int radius;
+        if(args.size() != 2 || !toInt(args, 1, 0, &radius) || radius < 0) {
+            *errorMessage = badArguments;
+            return false;
+        }
+        m_pipeline.localMeanFilter(radius);
+    }
+    else if(name == QLatin1String("threshold")) {
+        int radius;
+        int offset;
+        if(args.size() < 2 || args.size() > 3 || !toInt(args, 1, 0, &radius) || !toInt(args, 2, 0, &offset) || radius < 0) {
+            *errorMessage = badArguments;
+            return false;
+        }
+        m_pipeline.adaptiveThresholdFilter(radius, offset);
+    }
+    else if(name == QLatin1String("rotate")) {
+        int degrees;
+        bool bilinear = args.size() == 3 && args.at(2).toLower() == QLatin1String("bilinear");
+        if(args.size() < 2 || args.size() > 3 || (args.size() == 3 && !bilinear) || !toInt(args, 1, 0, &degrees)) {
+            *errorMessage = badArguments;
+            return false;
+        }
+        m_pipeline.rotationTransform(degrees, bilinear);
+    }
+    else if(name == QLatin1String("lowpass") || name == QLatin1String("highpass")) {
+        double radius;
+        Filter::MaskShape shape;
+        int order;
+        if(args.size() < 2 || !toDouble(args, 1, &radius) || !toMask(args, 2, &shape, &order)) {
+            *errorMessage = badArguments;
+            return false;
+        }
+        if(name == QLatin1String("lowpass"))
+            m_pipeline.lowPassFilter(radius, shape, order);
+        else
+            m_pipeline.highPassFilter(radius, shape, order);
+    }
+    else if(name == QLatin1String("magnitude")) {
+        double radius;
+        if(args.size() != 2 || !toDouble(args, 1, &radius)) {
+            *errorMessage = badArguments;
+            return false;
+        }
+        m_pipeline.highPassFilterMagnitude(radius);
+    }
+    else if(name == QLatin1String("bandpass")) {
+        double minRadius;
+        double maxRadius;
+        Filter::MaskShape shape;
+        int order;
+        if(args.size() < 3 || !toDouble(args, 1, &minRadius) || !toDouble(args, 2, &maxRadius) || !toMask(args, 3, &shape, &order)) {
+            *errorMessage = badArguments;
+            return false;
+        }
+        m_pipeline.bandPassFilter(minRadius, maxRadius, shape, order);
+    }
+    else {
+        *errorMessage = QStringLiteral("Unknown filter \"%1\"").arg(args.first());
+        return false;
+    }
+
+    m_names << step;
+    return true;
+}
+
+bool FilterChain::parseWarpStep(const QString &name, QStringList args)
+{
+    static const char* const samplingNames[] = { "nearest", "bilinear", "bicubic" };
+    bool hasSampling = false;
+    Filter::Sampling sampling = Filter::BilinearSampling;
+
+    for(int i = 0; i < 3 && args.size() > 1; ++i) {
+        if(args.last().toLower() == QLatin1String(samplingNames[i])) {
+            hasSampling = true;
+            sampling = static_cast<Filter::Sampling>(i);
+            args.removeLast();
+            break;
+        }
+    }
+
+    Filter::Warp warp;
+    QVector<double> values;
+    for(int i = 1; i < args.size(); ++i) {
+        double value;
+        if(!toDouble(args, i, &value))
+            return false;
+        values.append(value);
+    }
+
+    if(name == QLatin1String("scale")) {
+        if(values.size() < 1 || values.size() > 2 || values.first() == 0 || values.last() == 0)
+            return false;
+        warp.scale(values.first(), values.last());
+    }
+    else if(name == QLatin1String("shear")) {
+        if(values.size() != 2)
+            return false;
+        warp.shear(values.at(0), values.at(1));
+    }
+    else if(name == QLatin1String("translate")) {
+        if(values.size() != 2)
+            return false;
+        warp.translate(values.at(0), values.at(1));
+    }
+    else {
+        if(values.size() != 9)
+            return false;
+        warp.map(QTransform(values.at(0), values.at(1), values.at(2), values.at(3), values.at(4),
+                            values.at(5), values.at(6), values.at(7), values.at(8)));
+    }
+
+    if(hasSampling)
+        m_pipeline.warpTransform(warp, sampling);
+    else
+        m_pipeline.warpTransform(warp);
+    return true;
+}
+
+bool FilterChain::isEmpty() const
+{
+    return m_pipeline.isEmpty();
+}
+
+QString FilterChain::description() const
+{
+    return m_names.join(QStringLiteral(" -> "));
+}
+
+QImage FilterChain::apply(const QImage &image) const
+{
+    return m_pipeline.apply(image);
+}
+
+const Filter::Pipeline &FilterChain::pipeline() const
+{
+    return m_pipeline;
+}
+
+QString FilterChain::syntaxHelp()
+{
+    return QStringLiteral(
+        "Filter chain steps (comma separated, applied left to right):\n"
+        "  crazy:<offset>\n"
+        "  gain:<gain>[:<bias>]\n"
+        "  gamma:<gamma>\n"
+        "  invert\n"
+        "  binarize:<level>\n"
+        "  curve:<x>:<y>[:<x>:<y>...]   (x increasing)\n"
+        "  sobel[:<min>[:<max>]]\n"
+        "  prewitt[:<min>[:<max>]]\n"
+        "  blur\n"
+        "  boxblur:<radius>\n"
+        "  gaussian:<sigma>\n"
+        "  localmean:<radius>\n"
+        "  threshold:<radius>[:<offset>]\n"
+        "  rotate:<degrees>[:bilinear]\n"
+        "  scale:<sx>[:<sy>][:<sampling>]\n"
+        "  shear:<sh>:<sv>[:<sampling>]\n"
+        "  translate:<dx>:<dy>[:<sampling>]\n"
+        "  matrix:<m11>:<m12>:<m13>:<m21>:<m22>:<m23>:<m31>:<m32>:<m33>[:<sampling>]\n"
+        "  lowpass:<radius%>[:<mask>[:<order>]]\n"
+        "  highpass:<radius%>[:<mask>[:<order>]]\n"
+        "  bandpass:<minRadius%>:<maxRadius%>[:<mask>[:<order>]]\n"
+        "  magnitude:<radius>\n"
+        "Consecutive point steps (crazy, gain, gamma, invert, binarize, curve) compose\n"
+        "into one lookup table; with sobel, prewitt and blur they run as one fused pass.\n"
+        "Consecutive scale, shear, translate and matrix steps resample the image once\n"
+        "with the last <sampling> given among them: nearest, bilinear (default) or bicubic.\n"
+        "<mask> is ideal (default), butterworth with <order> (default 2) or gaussian.\n");
+}
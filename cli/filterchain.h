@@ -0,0 +1,65 @@
+#ifndef FILTERCHAIN_H
+#define FILTERCHAIN_H
+
+#include <QImage>
+#include <QString>
+#include <QStringList>
+#include "pipeline.h"
+
+/*
+ * Ordered list of Filter:: operations parsed from the command line.
+ * Each step is written as name[:param[:param]], steps are separated by commas:
+ *
+ *   crazy:<offset>
+ *   gain:<gain>[:<bias>]
+ *   gamma:<gamma>
+ *   invert
+ *   binarize:<level>
+ *   curve:<x>:<y>[:<x>:<y>...]
+ *   sobel[:<min>[:<max>]]
+ *   prewitt[:<min>[:<max>]]
+ *   blur
+ *   boxblur:<radius>
+ *   gaussian:<sigma>
+ *   localmean:<radius>
+ *   threshold:<radius>[:<offset>]
+ *   rotate:<degrees>[:bilinear]
+ *   scale:<sx>[:<sy>][:<sampling>]
+ *   shear:<sh>:<sv>[:<sampling>]
+ *   translate:<dx>:<dy>[:<sampling>]
+ *   matrix:<m11>:<m12>:<m13>:<m21>:<m22>:<m23>:<m31>:<m32>:<m33>[:<sampling>]
+ *   lowpass:<radius%>[:<mask>[:<order>]]
+ *   highpass:<radius%>[:<mask>[:<order>]]
+ *   bandpass:<minRadius%>:<maxRadius%>[:<mask>[:<order>]]
+ *   magnitude:<radius>
+ *
+ * The chain runs as a Filter::Pipeline: consecutive point steps (crazy, gain,
+ * gamma, invert, binarize, curve) compose into one lookup table, consecutive
+ * point and sobel/prewitt/blur steps are fused into one pass, and consecutive
+ * geometric steps (scale, shear, translate, matrix) resample the image once
+ * with the sampling (nearest, bilinear or bicubic) last given among them,
+ * bilinear by default.
+ * The Fourier masks are ideal (default), butterworth of <order> (default 2)
+ * or gaussian.
+*/
+class FilterChain
+{
+public:
+    bool parse(const QString& spec, QString* errorMessage);
+
+    bool isEmpty() const;
+    QString description() const;
+    QImage apply(const QImage& image) const;
+    const Filter::Pipeline& pipeline() const;
+
+    static QString syntaxHelp();
+
+private:
+    bool parseStep(const QString& step, QString* errorMessage);
+    bool parseWarpStep(const QString& name, QStringList args);
+
+    QStringList m_names;
+    Filter::Pipeline m_pipeline;
+};
+
+#endif // FILTERCHAIN_H
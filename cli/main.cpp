@@ -0,0 +1,166 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QImageWriter>
+#include <QTextStream>
+#include "batchprocessor.h"
+#include "filter.h"
+#include "filterchain.h"
+#include "rawimage.h"
+#include "trace.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("imagefilters-cli"));
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Runs ImageFilters filter chains over image files and directories.\n\n") + FilterChain::syntaxHelp());
+    parser.addHelpOption();
+    parser.addPositionalArgument(QStringLiteral("inputs"), QStringLiteral("Image files or directories to process."), QStringLiteral("[inputs...]"));
+
+    QCommandLineOption filterOption(QStringList() << QStringLiteral("f") << QStringLiteral("filter"),
+                                    QStringLiteral("Filter chain to apply, e.g. \"blur,sobel:20:200\"."), QStringLiteral("chain"));
+    QCommandLineOption outputOption(QStringList() << QStringLiteral("o") << QStringLiteral("output"),
+                                    QStringLiteral("Directory the filtered images are written to."), QStringLiteral("directory"));
+    QCommandLineOption listOption(QStringList() << QStringLiteral("l") << QStringLiteral("list"),
+                                  QStringLiteral("Text file with one input path per line."), QStringLiteral("file"));
+    QCommandLineOption formatOption(QStringList() << QStringLiteral("format"),
+                                    QStringLiteral("Output image format (default: png), ifr for uncompressed memory mapped images."), QStringLiteral("format"), QStringLiteral("png"));
+    QCommandLineOption jobsOption(QStringList() << QStringLiteral("j") << QStringLiteral("jobs"),
+                                  QStringLiteral("Number of worker threads (default: one per core)."), QStringLiteral("count"));
+    QCommandLineOption filterThreadsOption(QStringList() << QStringLiteral("filter-threads"),
+                                           QStringLiteral("Threads each filter may use inside one image (default: one per core)."), QStringLiteral("count"));
+    QCommandLineOption fourierPadOption(QStringList() << QStringLiteral("fourier-pad"),
+                                        QStringLiteral("Zero pad the Fourier filters to power of two sizes instead of transforming at the image size."));
+
+    parser.addOption(filterOption);
+    parser.addOption(outputOption);
+    parser.addOption(listOption);
+    parser.addOption(formatOption);
+    parser.addOption(jobsOption);
+    parser.addOption(filterThreadsOption);
+    QCommandLineOption memoryBudgetOption(QStringList() << QStringLiteral("memory-budget"),
+                                          QStringLiteral("Stream binary PGM/PPM or .ifr inputs in strips using at most this many MiB each, "
+                                                         "one image at a time; results are written as .pnm files, or .ifr with --format ifr."), QStringLiteral("MiB"));
+
+    QCommandLineOption traceOption(QStringList() << QStringLiteral("trace"),
+                                   QStringLiteral("Write a chrome://tracing JSON trace of the run to file and print per scope timings."), QStringLiteral("file"));
+
+    parser.addOption(fourierPadOption);
+    parser.addOption(memoryBudgetOption);
+    parser.addOption(traceOption);
+    parser.process(app);
+
+    QString errorMessage;
+
+    FilterChain chain;
+    if(!parser.isSet(filterOption) || !chain.parse(parser.value(filterOption), &errorMessage)) {
+        err << (errorMessage.isEmpty() ? QStringLiteral("A filter chain is required (--filter).") : errorMessage) << endl;
+        return 1;
+    }
+
+    if(!parser.isSet(outputOption)) {
+        err << "An output directory is required (--output)." << endl;
+        return 1;
+    }
+
+    const QString outputDirectory = parser.value(outputOption);
+    if(!QDir().mkpath(outputDirectory)) {
+        err << "Could not create output directory " << outputDirectory << endl;
+        return 1;
+    }
+
+    const QByteArray outputFormat = parser.value(formatOption).toLatin1().toLower();
+    if(outputFormat != RawImage::suffix().toLatin1() && !QImageWriter::supportedImageFormats().contains(outputFormat)) {
+        err << "Unsupported output format " << parser.value(formatOption) << endl;
+        return 1;
+    }
+
+    BatchProcessor processor(chain, outputDirectory, outputFormat);
+
+    if(parser.isSet(jobsOption)) {
+        bool ok = false;
+        int jobs = parser.value(jobsOption).toInt(&ok);
+        if(!ok || jobs < 1) {
+            err << "Invalid worker count " << parser.value(jobsOption) << endl;
+            return 1;
+        }
+        processor.setThreadCount(jobs);
+    }
+
+    if(parser.isSet(filterThreadsOption)) {
+        bool ok = false;
+        int filterThreads = parser.value(filterThreadsOption).toInt(&ok);
+        if(!ok || filterThreads < 1) {
+            err << "Invalid filter thread count " << parser.value(filterThreadsOption) << endl;
+            return 1;
+        }
+        Filter::setThreadCount(filterThreads);
+    }
+
+    if(parser.isSet(memoryBudgetOption)) {
+        bool ok = false;
+        double megabytes = parser.value(memoryBudgetOption).toDouble(&ok);
+        if(!ok || megabytes <= 0) {
+            err << "Invalid memory budget " << parser.value(memoryBudgetOption) << endl;
+            return 1;
+        }
+        if(chain.pipeline().halo() < 0) {
+            err << "The filter chain needs whole images (rotation, warps or Fourier filters) and cannot be streamed." << endl;
+            return 1;
+        }
+        processor.setMemoryBudget(static_cast<qint64>(megabytes * 1024 * 1024));
+    }
+
+    if(parser.isSet(fourierPadOption))
+        Filter::setFourierPadding(Filter::ZeroPadToPowerOfTwo);
+
+    for(const QString& input : parser.positionalArguments()) {
+        if(!processor.addInput(input, &errorMessage)) {
+            err << errorMessage << endl;
+            return 1;
+        }
+    }
+
+    if(parser.isSet(listOption) && !processor.addInputList(parser.value(listOption), &errorMessage)) {
+        err << errorMessage << endl;
+        return 1;
+    }
+
+    if(processor.inputCount() == 0) {
+        err << "No input images." << endl;
+        return 1;
+    }
+
+    if(!processor.checkOutputs(&errorMessage)) {
+        err << errorMessage << endl;
+        return 1;
+    }
+
+    out << "Processing " << processor.inputCount() << " images with " << processor.threadCount()
+        << " workers: " << chain.description() << endl;
+
+    BatchReport report = processor.run();
+
+    for(const QString& error : qAsConst(report.errors))
+        err << error << endl;
+
+    out << report.processed << " images processed, " << report.failed << " failed in "
+        << report.elapsedMs / 1000.0 << " s ("
+        << QString::number(report.imagesPerSecond(), 'f', 2) << " images/s, "
+        << QString::number(report.megapixelsPerSecond(), 'f', 2) << " MP/s)" << endl;
+
+    if(parser.isSet(traceOption)) {
+        if(!Trace::writeChromeTrace(parser.value(traceOption), &errorMessage)) {
+            err << errorMessage << endl;
+            return 1;
+        }
+        err << Trace::summary();
+    }
+
+    return report.failed == 0 ? 0 : 2;
+}
@@ -0,0 +1,127 @@
+#ifndef CONVOLUTION_H
+#define CONVOLUTION_H
+
+#include <QImage>
+#include <vector>
+#include "bufferpool.h"
+#include "gradient.h"
+#include "luminance.h"
+#include "parallel.h"
+
+/*
+ * Scanline based 3x3 neighbourhood engine used by the edge and blur filters.
+ *
+ * The luminance plane of the source (see Luminance::plane(), shared with the
+ * other gray filters) is walked one row at a time with a sliding window of
+ * three rows (above, center, below), so no source pixel is converted to gray
+ * per filter and no QImage::pixel()/setPixel() call is made per output pixel.
+ *
+ * A kernel is any callable with the signature
+ *   void (const uchar* above, const uchar* center, const uchar* below, uchar* output, int xBegin, int xEnd)
+ * that writes output[x] for xBegin <= x < xEnd. Row pointers index the full
+ * source row, so kernel taps at x-1 and x+1 are always valid inside that range.
+*/
+namespace Convolution
+{
+
+// Sobel (centerWeight 2) and Prewitt (centerWeight 1) gradient magnitude with min/max thresholding
+struct GradientKernel {
+    GradientKernel(int centerWeight, int minThreshold, int maxThreshold) :
+        centerWeight(centerWeight), minThreshold(minThreshold), maxThreshold(maxThreshold) {}
+
+    void operator()(const uchar* above, const uchar* center, const uchar* below, uchar* output, int xBegin, int xEnd) const
+    {
+        Gradient::magnitudeRow(above, center, below, output, xBegin, xEnd, centerWeight, minThreshold, maxThreshold);
+    }
+
+    int centerWeight;
+    int minThreshold;
+    int maxThreshold;
+};
+
+// 3x3 box average
+struct BoxBlurKernel {
+    void operator()(const uchar* above, const uchar* center, const uchar* below, uchar* output, int xBegin, int xEnd) const
+    {
+        for(int x = xBegin; x < xEnd; ++x) {
+            int pixel = above[x-1] + above[x] + above[x+1] +
+                        center[x-1] + center[x] + center[x+1] +
+                        below[x-1] + below[x] + below[x+1];
+
+            output[x] = static_cast<uchar>(pixel / 9);
+        }
+    }
+};
+
+// Grayscale8 rows already are luminance rows and are used in place
+class GrayRowReader
+{
+public:
+    explicit GrayRowReader(const QImage& image) : m_image(image) {}
+
+    const uchar* row(int y, uchar*) const
+    {
+        return m_image.constScanLine(y);
+    }
+
+private:
+    const QImage& m_image;
+};
+
+/*
+ * Runs kernel for output rows firstRow <= y < lastRow and columns xBegin <= x < xEnd.
+ * Rows firstRow-1 and lastRow are read as halo, so the caller must keep them inside the image.
+*/
+template <typename RowReader, typename Kernel>
+void convolveRows(const RowReader& reader, int width, uchar* output, int outputStride,
+                  int firstRow, int lastRow, int xBegin, int xEnd, const Kernel& kernel)
+{
+    if(firstRow >= lastRow || xBegin >= xEnd)
+        return;
+
+    std::vector<uchar> scratch(3 * static_cast<size_t>(width));
+    uchar* window[3] = { &scratch[0], &scratch[static_cast<size_t>(width)], &scratch[2 * static_cast<size_t>(width)] };
+
+    const uchar* above = reader.row(firstRow - 1, window[0]);
+    const uchar* center = reader.row(firstRow, window[1]);
+
+    for(int y = firstRow; y < lastRow; ++y) {
+        // the slot that held the previous "above" row is free again
+        const uchar* below = reader.row(y + 1, window[(y - firstRow + 2) % 3]);
+
+        kernel(above, center, below, output + static_cast<size_t>(y) * outputStride, xBegin, xEnd);
+
+        above = center;
+        center = below;
+    }
+}
+
+/*
+ * Convolves the luminance of source with kernel into a new Grayscale8 image.
+ * The output covers rows 1 <= y < height-2 and columns 1 <= x < width-2, the
+ * same area the per pixel implementation always wrote; the rest is black.
+*/
+template <typename Kernel>
+QImage convolve3x3(const QImage& source, const Kernel& kernel)
+{
+    const QImage image = Luminance::plane(source);
+    const int width = image.width();
+    const int height = image.height();
+
+    QImage filteredImage = BufferPool::image(width, height, QImage::Format_Grayscale8);
+    filteredImage.fill(0);
+
+    uchar* output = filteredImage.bits();
+    const int outputStride = filteredImage.bytesPerLine();
+
+    // each band primes its own window with the halo row above it
+    Parallel::forEachBand(1, height - 2, Parallel::bandHeight(image.bytesPerLine()), [&](int firstRow, int lastRow) {
+        convolveRows(GrayRowReader(image), width, output, outputStride, firstRow, lastRow, 1, width - 2, kernel);
+    });
+
+    return filteredImage;
+}
+
+}
+
+#endif // CONVOLUTION_H
@@ -0,0 +1,57 @@
+#include "exportqueue.h"
+#include <QRunnable>
+
+class ExportQueue::Job : public QRunnable
+{
+public:
+    Job(ExportQueue* queue, const QImage& image, const QString& fileName, const ImageExport::Options& options) :
+        m_queue(queue),
+        m_image(image),
+        m_fileName(fileName),
+        m_options(options)
+    {
+    }
+
+    void run() override
+    {
+        QString errorMessage;
+        const bool isSaved = ImageExport::save(m_image, m_fileName, m_options, &errorMessage);
+        m_image = QImage();
+
+        m_queue->m_pendingCount.fetchAndAddOrdered(-1);
+
+        if(isSaved)
+            emit m_queue->saved(m_fileName);
+        else
+            emit m_queue->failed(m_fileName, errorMessage);
+    }
+
+private:
+    ExportQueue* m_queue;
+    QImage m_image;
+    QString m_fileName;
+    ImageExport::Options m_options;
+};
+
+ExportQueue::ExportQueue(QObject *parent) :
+    QObject(parent),
+    m_pendingCount(0)
+{
+    m_pool.setMaxThreadCount(1);
+}
+
+ExportQueue::~ExportQueue()
+{
+    m_pool.waitForDone();
+}
+
+void ExportQueue::save(const QImage &image, const QString &fileName, const ImageExport::Options &options)
+{
+    m_pendingCount.fetchAndAddOrdered(1);
+    m_pool.start(new Job(this, image, fileName, options));
+}
+
+int ExportQueue::pendingCount() const
+{
+    return m_pendingCount.loadAcquire();
+}
@@ -0,0 +1,46 @@
+#ifndef EXPORTQUEUE_H
+#define EXPORTQUEUE_H
+
+#include <QAtomicInt>
+#include <QImage>
+#include <QObject>
+#include <QString>
+#include <QThreadPool>
+#include "imageexport.h"
+
+/*
+ * Saves images off the GUI thread.
+ *
+ * Jobs are served in submission order by one worker thread, so two saves to
+ * the same file end with the later image; a PNG job itself compresses on all
+ * cores (see ImageExport::encodePng()). The queue holds a shallow copy of each
+ * image, later changes to the window's images do not reach it. saved() and
+ * failed() are emitted on the worker thread, so receivers in the GUI thread
+ * get them queued.
+*/
+class ExportQueue : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ExportQueue(QObject *parent = nullptr);
+    // Finishes the queued jobs, so nothing the user saved is lost on exit
+    ~ExportQueue();
+
+    void save(const QImage& image, const QString& fileName, const ImageExport::Options& options);
+
+    // Jobs queued or running
+    int pendingCount() const;
+
+signals:
+    void saved(const QString& fileName);
+    void failed(const QString& fileName, const QString& errorMessage);
+
+private:
+    class Job;
+
+    QThreadPool m_pool;
+    QAtomicInt m_pendingCount;
+};
+
+#endif // EXPORTQUEUE_H
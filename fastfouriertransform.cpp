@@ -1,189 +1,734 @@
 #include "fastfouriertransform.h"
+#include "parallel.h"
 #include <cmath>
-#include <cstdlib>
+#include <map>
+#include <mutex>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FFT_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+#define FFT_AVX2
+#include <immintrin.h>
+#endif
 
 /*
- * This Source file is an C++ adaptation of Paul Bourke FFT and FFT2D algorithm
+ * The FFT2D interface and scaling conventions come from Paul Bourke's FFT2D
  * Original Source: http://paulbourke.net/miscellaneous/dft/
 */
 
+static const double Pi = 3.14159265358979323846;
 
+static bool isPowerOfTwo(int n)
+{
+    return n > 0 && (n & (n - 1)) == 0;
+}
 
-/*-------------------------------------------------------------------------
-   Calculate the closest but lower power of two of a number
-   twopm = 2**m <= n
-   Return TRUE if 2**m == n
-*/
-bool Powerof2(int n,int *m,int *twopm)
-{
-   if (n <= 1) {
-      *m = 0;
-      *twopm = 1;
-      return(false);
-   }
-
-   *m = 1;
-   *twopm = 2;
-   do {
-      (*m)++;
-      (*twopm) *= 2;
-   } while (2*(*twopm) <= n);
-
-   if (*twopm != n)
-      return(false);
-   else
-      return(true);
-}
-
-
-/*-------------------------------------------------------------------------
-   This computes an in-place complex-to-complex FFT
-   x and y are the real and imaginary arrays of 2^m points.
-   dir =  1 gives forward transform
-   dir = -1 gives reverse transform
-
-     Formula: forward
-                  N-1
-                  ---
-              1   \          - j k 2 pi n / N
-      X(n) = ---   >   x(k) e                    = forward transform
-              N   /                                n=0..N-1
-                  ---
-                  k=0
-
-      Formula: reverse
-                  N-1
-                  ---
-                  \          j k 2 pi n / N
-      X(n) =       >   x(k) e                    = forward transform
-                  /                                n=0..N-1
-                  ---
-                  k=0
-*/
-bool FFT(int dir,int m,double *x,double *y)
-{
-   long nn,i,i1,j,k,i2,l,l1,l2;
-   double c1,c2,tx,ty,t1,t2,u1,u2,z;
-
-   /* Calculate the number of points */
-   nn = 1;
-   for (i=0;i<m;i++)
-      nn *= 2;
-
-   /* Do the bit reversal */
-   i2 = nn >> 1;
-   j = 0;
-   for (i=0;i<nn-1;i++) {
-      if (i < j) {
-         tx = x[i];
-         ty = y[i];
-         x[i] = x[j];
-         y[i] = y[j];
-         x[j] = tx;
-         y[j] = ty;
-      }
-      k = i2;
-      while (k <= j) {
-         j -= k;
-         k >>= 1;
-      }
-      j += k;
-   }
-
-   /* Compute the FFT */
-   c1 = -1.0;
-   c2 = 0.0;
-   l2 = 1;
-   for (l=0;l<m;l++) {
-      l1 = l2;
-      l2 <<= 1;
-      u1 = 1.0;
-      u2 = 0.0;
-      for (j=0;j<l1;j++) {
-         for (i=j;i<nn;i+=l2) {
-            i1 = i + l1;
-            t1 = u1 * x[i1] - u2 * y[i1];
-            t2 = u1 * y[i1] + u2 * x[i1];
-            x[i1] = x[i] - t1;
-            y[i1] = y[i] - t2;
-            x[i] += t1;
-            y[i] += t2;
-         }
-         z =  u1 * c1 - u2 * c2;
-         u2 = u1 * c2 + u2 * c1;
-         u1 = z;
-      }
-      c2 = sqrt((1.0 - c1) / 2.0);
-      if (dir == 1)
-         c2 = -c2;
-      c1 = sqrt((1.0 + c1) / 2.0);
-   }
-
-   /* Scaling for forward transform */
-   if (dir == 1) {
-      for (i=0;i<nn;i++) {
-         x[i] /= (double)nn;
-         y[i] /= (double)nn;
-      }
-   }
-
-   return(true);
-}
-
-/*-------------------------------------------------------------------------
-   Perform a 2D FFT inplace given a complex 2D array
-   The direction dir, 1 for forward, -1 for reverse
-   The size of the array (nx,ny)
-   Return false if there are memory problems or
-      the dimensions are not powers of 2
+template <typename T>
+std::shared_ptr<const BasicFFTPlan<T>> BasicFFTPlan<T>::forSize(int n)
+{
+    if(n < 1)
+        return nullptr;
+
+    static std::mutex cacheMutex;
+    static std::map<int, std::shared_ptr<const BasicFFTPlan>> cache;
+
+    {
+        std::lock_guard<std::mutex> locker(cacheMutex);
+
+        auto cached = cache.find(n);
+        if(cached != cache.end())
+            return cached->second;
+    }
+
+    // built outside the lock, a Bluestein plan asks the cache for its power of two plan
+    std::shared_ptr<const BasicFFTPlan> plan(new BasicFFTPlan(n));
+
+    std::lock_guard<std::mutex> locker(cacheMutex);
+
+    std::shared_ptr<const BasicFFTPlan>& cachedPlan = cache[n];
+    if(!cachedPlan)
+        cachedPlan = plan;
+
+    return cachedPlan;
+}
+
+template <typename T>
+BasicFFTPlan<T>::BasicFFTPlan(int n) :
+    m_size(n),
+    m_leadingRadix2(false)
+{
+    if(!isPowerOfTwo(n)) {
+        initBluestein();
+        return;
+    }
+
+    int bits = 0;
+    while((1 << bits) < n)
+        ++bits;
+
+    for(int i = 0; i < n; ++i) {
+        int reversed = 0;
+        for(int bit = 0; bit < bits; ++bit)
+            reversed |= ((i >> bit) & 1) << (bits - 1 - bit);
+
+        if(i < reversed) {
+            m_swaps.push_back(i);
+            m_swaps.push_back(reversed);
+        }
+    }
+
+    int quarter = 1;
+    if(bits % 2 == 1) {
+        m_leadingRadix2 = true;
+        quarter = 2;
+    }
+
+    for(; quarter < n; quarter *= 4) {
+        Stage stage;
+        stage.quarter = quarter;
+        stage.twiddleOffset = static_cast<int>(m_twiddle1Real.size());
+        m_stages.push_back(stage);
+
+        // t = exp(-2 pi i / 4L), forward direction, always evaluated in double
+        for(int k = 0; k < quarter; ++k) {
+            double angle = -2.0 * Pi * k / (4.0 * quarter);
+            m_twiddle1Real.push_back(static_cast<T>(std::cos(angle)));
+            m_twiddle1Imag.push_back(static_cast<T>(std::sin(angle)));
+            m_twiddle2Real.push_back(static_cast<T>(std::cos(2.0 * angle)));
+            m_twiddle2Imag.push_back(static_cast<T>(std::sin(2.0 * angle)));
+            m_twiddle3Real.push_back(static_cast<T>(std::cos(3.0 * angle)));
+            m_twiddle3Imag.push_back(static_cast<T>(std::sin(3.0 * angle)));
+        }
+    }
+}
+
+template <typename T>
+void BasicFFTPlan<T>::initBluestein()
+{
+    const int n = m_size;
+
+    int m = 1;
+    while(m < 2 * n - 1)
+        m *= 2;
+
+    m_convolutionPlan = BasicFFTPlan::forSize(m);
+
+    // w_k = exp(-i pi k^2 / N), k^2 is reduced modulo 2N to keep the angle accurate
+    for(int k = 0; k < n; ++k) {
+        long long square = static_cast<long long>(k) * k % (2LL * n);
+        double angle = -Pi * square / n;
+        m_chirpReal.push_back(static_cast<T>(std::cos(angle)));
+        m_chirpImag.push_back(static_cast<T>(std::sin(angle)));
+    }
+
+    // spectrum of the conjugated chirp, laid out circularly for indices -(N-1)..N-1
+    m_filterReal.assign(m, T(0));
+    m_filterImag.assign(m, T(0));
+
+    for(int k = 0; k < n; ++k) {
+        m_filterReal[k] = m_chirpReal[k];
+        m_filterImag[k] = -m_chirpImag[k];
+
+        if(k > 0) {
+            m_filterReal[m - k] = m_chirpReal[k];
+            m_filterImag[m - k] = -m_chirpImag[k];
+        }
+    }
+
+    m_convolutionPlan->transform(m_filterReal.data(), m_filterImag.data(), 1);
+
+    // undo the 1/M forward scaling, the convolution then needs no extra scaling
+    for(int k = 0; k < m; ++k) {
+        m_filterReal[k] *= m;
+        m_filterImag[k] *= m;
+    }
+}
+
+// Per thread pair of lines of at least n values, Tag keeps independent users apart
+template <typename T, int Tag>
+static void threadLines(int n, T** real, T** imag)
+{
+    static thread_local std::vector<T> realLine;
+    static thread_local std::vector<T> imagLine;
+
+    if(static_cast<int>(realLine.size()) < n) {
+        realLine.resize(n);
+        imagLine.resize(n);
+    }
+
+    *real = realLine.data();
+    *imag = imagLine.data();
+}
+
+enum LineTag {
+    ScratchLines,
+    BluesteinLines // kept apart from the callers' scratch lines which may hold the data being transformed
+};
+
+/*
+ * nk = (n^2 + k^2 - (k-n)^2) / 2 turns the DFT into X[k] = w_k sum_n (x[n] w_n) conj(w_(k-n)),
+ * a convolution evaluated with power of two FFTs of M >= 2N-1 points.
+ * The reverse transform is conj(DFT(conj(x))).
 */
+template <typename T>
+void BasicFFTPlan<T>::bluestein(T *real, T *imag, int dir) const
+{
+    const int n = m_size;
+    const int m = m_convolutionPlan->size();
+    const T sign = dir == 1 ? T(1) : T(-1);
+
+    T* workReal;
+    T* workImag;
+    threadLines<T, BluesteinLines>(m, &workReal, &workImag);
+
+    for(int k = 0; k < n; ++k) {
+        T xRe = real[k];
+        T xIm = sign * imag[k];
+        workReal[k] = xRe * m_chirpReal[k] - xIm * m_chirpImag[k];
+        workImag[k] = xRe * m_chirpImag[k] + xIm * m_chirpReal[k];
+    }
+    for(int k = n; k < m; ++k) {
+        workReal[k] = T(0);
+        workImag[k] = T(0);
+    }
+
+    m_convolutionPlan->transform(workReal, workImag, 1);
+
+    for(int k = 0; k < m; ++k) {
+        T re = workReal[k] * m_filterReal[k] - workImag[k] * m_filterImag[k];
+        T im = workReal[k] * m_filterImag[k] + workImag[k] * m_filterReal[k];
+        workReal[k] = re;
+        workImag[k] = im;
+    }
+
+    m_convolutionPlan->transform(workReal, workImag, -1);
+
+    for(int k = 0; k < n; ++k) {
+        real[k] = workReal[k] * m_chirpReal[k] - workImag[k] * m_chirpImag[k];
+        imag[k] = sign * (workReal[k] * m_chirpImag[k] + workImag[k] * m_chirpReal[k]);
+    }
+}
+
+// One block of a radix-4 stage: four runs A..D of L points and the stage twiddles t^k, t^2k, t^3k
+template <typename T>
+struct Radix4Block {
+    T* ar; T* ai;
+    T* br; T* bi;
+    T* cr; T* ci;
+    T* dr; T* di;
+    const T* w1r; const T* w1i;
+    const T* w2r; const T* w2i;
+    const T* w3r; const T* w3i;
+};
+
+template <typename T>
+static void radix4Butterflies(const Radix4Block<T>& block, int kBegin, int kEnd, T sign)
+{
+    T* ar = block.ar; T* ai = block.ai;
+    T* br = block.br; T* bi = block.bi;
+    T* cr = block.cr; T* ci = block.ci;
+    T* dr = block.dr; T* di = block.di;
+    const T* w1r = block.w1r; const T* w1i = block.w1i;
+    const T* w2r = block.w2r; const T* w2i = block.w2i;
+    const T* w3r = block.w3r; const T* w3i = block.w3i;
+
+    for(int k = kBegin; k < kEnd; ++k) {
+        // b' = t^2k B, c' = t^k C, d' = t^3k D
+        T bRe = br[k] * w2r[k] - bi[k] * sign * w2i[k];
+        T bIm = bi[k] * w2r[k] + br[k] * sign * w2i[k];
+        T cRe = cr[k] * w1r[k] - ci[k] * sign * w1i[k];
+        T cIm = ci[k] * w1r[k] + cr[k] * sign * w1i[k];
+        T dRe = dr[k] * w3r[k] - di[k] * sign * w3i[k];
+        T dIm = di[k] * w3r[k] + dr[k] * sign * w3i[k];
+
+        T evenRe = ar[k] + bRe, evenIm = ai[k] + bIm;
+        T oddRe = ar[k] - bRe, oddIm = ai[k] - bIm;
+        T sumRe = cRe + dRe, sumIm = cIm + dIm;
+        // (c' - d') * w4 with w4 = -i forward, +i reverse
+        T rotRe = sign * (cIm - dIm), rotIm = -sign * (cRe - dRe);
+
+        ar[k] = evenRe + sumRe;
+        ai[k] = evenIm + sumIm;
+        br[k] = oddRe + rotRe;
+        bi[k] = oddIm + rotIm;
+        cr[k] = evenRe - sumRe;
+        ci[k] = evenIm - sumIm;
+        dr[k] = oddRe - rotRe;
+        di[k] = oddIm - rotIm;
+    }
+}
+
+// Vectorized butterflies, return how many of the quarter points were done, the rest is left to the scalar loop
+static int radix4ButterfliesSimd(const Radix4Block<double>&, int, double)
+{
+    return 0;
+}
+
+static int radix4ButterfliesSimd(const Radix4Block<float>& block, int quarter, float sign)
+{
+    int k = 0;
+
+#ifdef FFT_AVX2
+    const __m256 sign8 = _mm256_set1_ps(sign);
+
+    for(; k + 8 <= quarter; k += 8) {
+        __m256 ar = _mm256_loadu_ps(block.ar + k), ai = _mm256_loadu_ps(block.ai + k);
+        __m256 br = _mm256_loadu_ps(block.br + k), bi = _mm256_loadu_ps(block.bi + k);
+        __m256 cr = _mm256_loadu_ps(block.cr + k), ci = _mm256_loadu_ps(block.ci + k);
+        __m256 dr = _mm256_loadu_ps(block.dr + k), di = _mm256_loadu_ps(block.di + k);
+
+        __m256 w1r = _mm256_loadu_ps(block.w1r + k), w1i = _mm256_mul_ps(sign8, _mm256_loadu_ps(block.w1i + k));
+        __m256 w2r = _mm256_loadu_ps(block.w2r + k), w2i = _mm256_mul_ps(sign8, _mm256_loadu_ps(block.w2i + k));
+        __m256 w3r = _mm256_loadu_ps(block.w3r + k), w3i = _mm256_mul_ps(sign8, _mm256_loadu_ps(block.w3i + k));
+
+        __m256 bRe = _mm256_sub_ps(_mm256_mul_ps(br, w2r), _mm256_mul_ps(bi, w2i));
+        __m256 bIm = _mm256_add_ps(_mm256_mul_ps(bi, w2r), _mm256_mul_ps(br, w2i));
+        __m256 cRe = _mm256_sub_ps(_mm256_mul_ps(cr, w1r), _mm256_mul_ps(ci, w1i));
+        __m256 cIm = _mm256_add_ps(_mm256_mul_ps(ci, w1r), _mm256_mul_ps(cr, w1i));
+        __m256 dRe = _mm256_sub_ps(_mm256_mul_ps(dr, w3r), _mm256_mul_ps(di, w3i));
+        __m256 dIm = _mm256_add_ps(_mm256_mul_ps(di, w3r), _mm256_mul_ps(dr, w3i));
+
+        __m256 evenRe = _mm256_add_ps(ar, bRe), evenIm = _mm256_add_ps(ai, bIm);
+        __m256 oddRe = _mm256_sub_ps(ar, bRe), oddIm = _mm256_sub_ps(ai, bIm);
+        __m256 sumRe = _mm256_add_ps(cRe, dRe), sumIm = _mm256_add_ps(cIm, dIm);
+        __m256 rotRe = _mm256_mul_ps(sign8, _mm256_sub_ps(cIm, dIm));
+        __m256 rotIm = _mm256_mul_ps(sign8, _mm256_sub_ps(dRe, cRe));
+
+        _mm256_storeu_ps(block.ar + k, _mm256_add_ps(evenRe, sumRe));
+        _mm256_storeu_ps(block.ai + k, _mm256_add_ps(evenIm, sumIm));
+        _mm256_storeu_ps(block.br + k, _mm256_add_ps(oddRe, rotRe));
+        _mm256_storeu_ps(block.bi + k, _mm256_add_ps(oddIm, rotIm));
+        _mm256_storeu_ps(block.cr + k, _mm256_sub_ps(evenRe, sumRe));
+        _mm256_storeu_ps(block.ci + k, _mm256_sub_ps(evenIm, sumIm));
+        _mm256_storeu_ps(block.dr + k, _mm256_sub_ps(oddRe, rotRe));
+        _mm256_storeu_ps(block.di + k, _mm256_sub_ps(oddIm, rotIm));
+    }
+#endif
+
+#ifdef FFT_SSE2
+    const __m128 sign4 = _mm_set1_ps(sign);
+
+    for(; k + 4 <= quarter; k += 4) {
+        __m128 ar = _mm_loadu_ps(block.ar + k), ai = _mm_loadu_ps(block.ai + k);
+        __m128 br = _mm_loadu_ps(block.br + k), bi = _mm_loadu_ps(block.bi + k);
+        __m128 cr = _mm_loadu_ps(block.cr + k), ci = _mm_loadu_ps(block.ci + k);
+        __m128 dr = _mm_loadu_ps(block.dr + k), di = _mm_loadu_ps(block.di + k);
+
+        __m128 w1r = _mm_loadu_ps(block.w1r + k), w1i = _mm_mul_ps(sign4, _mm_loadu_ps(block.w1i + k));
+        __m128 w2r = _mm_loadu_ps(block.w2r + k), w2i = _mm_mul_ps(sign4, _mm_loadu_ps(block.w2i + k));
+        __m128 w3r = _mm_loadu_ps(block.w3r + k), w3i = _mm_mul_ps(sign4, _mm_loadu_ps(block.w3i + k));
+
+        __m128 bRe = _mm_sub_ps(_mm_mul_ps(br, w2r), _mm_mul_ps(bi, w2i));
+        __m128 bIm = _mm_add_ps(_mm_mul_ps(bi, w2r), _mm_mul_ps(br, w2i));
+        __m128 cRe = _mm_sub_ps(_mm_mul_ps(cr, w1r), _mm_mul_ps(ci, w1i));
+        __m128 cIm = _mm_add_ps(_mm_mul_ps(ci, w1r), _mm_mul_ps(cr, w1i));
+        __m128 dRe = _mm_sub_ps(_mm_mul_ps(dr, w3r), _mm_mul_ps(di, w3i));
+        __m128 dIm = _mm_add_ps(_mm_mul_ps(di, w3r), _mm_mul_ps(dr, w3i));
+
+        __m128 evenRe = _mm_add_ps(ar, bRe), evenIm = _mm_add_ps(ai, bIm);
+        __m128 oddRe = _mm_sub_ps(ar, bRe), oddIm = _mm_sub_ps(ai, bIm);
+        __m128 sumRe = _mm_add_ps(cRe, dRe), sumIm = _mm_add_ps(cIm, dIm);
+        __m128 rotRe = _mm_mul_ps(sign4, _mm_sub_ps(cIm, dIm));
+        __m128 rotIm = _mm_mul_ps(sign4, _mm_sub_ps(dRe, cRe));
+
+        _mm_storeu_ps(block.ar + k, _mm_add_ps(evenRe, sumRe));
+        _mm_storeu_ps(block.ai + k, _mm_add_ps(evenIm, sumIm));
+        _mm_storeu_ps(block.br + k, _mm_add_ps(oddRe, rotRe));
+        _mm_storeu_ps(block.bi + k, _mm_add_ps(oddIm, rotIm));
+        _mm_storeu_ps(block.cr + k, _mm_sub_ps(evenRe, sumRe));
+        _mm_storeu_ps(block.ci + k, _mm_sub_ps(evenIm, sumIm));
+        _mm_storeu_ps(block.dr + k, _mm_sub_ps(oddRe, rotRe));
+        _mm_storeu_ps(block.di + k, _mm_sub_ps(oddIm, rotIm));
+    }
+#else
+    (void)block;
+    (void)quarter;
+    (void)sign;
+#endif
+
+    return k;
+}
+
+template <typename T>
+template <bool Inverse>
+void BasicFFTPlan<T>::butterflies(T *real, T *imag) const
+{
+    const int n = m_size;
+
+    if(m_leadingRadix2) {
+        for(int i = 0; i < n; i += 2) {
+            T real0 = real[i], imag0 = imag[i];
+            T real1 = real[i + 1], imag1 = imag[i + 1];
+            real[i] = real0 + real1;
+            imag[i] = imag0 + imag1;
+            real[i + 1] = real0 - real1;
+            imag[i + 1] = imag0 - imag1;
+        }
+    }
+
+    // conjugated twiddles and w4 = +i give the reverse transform
+    const T sign = Inverse ? T(-1) : T(1);
+
+    for(const Stage& stage : m_stages) {
+        const int quarter = stage.quarter;
+
+        Radix4Block<T> block;
+        block.w1r = &m_twiddle1Real[stage.twiddleOffset];
+        block.w1i = &m_twiddle1Imag[stage.twiddleOffset];
+        block.w2r = &m_twiddle2Real[stage.twiddleOffset];
+        block.w2i = &m_twiddle2Imag[stage.twiddleOffset];
+        block.w3r = &m_twiddle3Real[stage.twiddleOffset];
+        block.w3i = &m_twiddle3Imag[stage.twiddleOffset];
+
+        for(int base = 0; base < n; base += 4 * quarter) {
+            block.ar = real + base;
+            block.ai = imag + base;
+            block.br = block.ar + quarter;
+            block.bi = block.ai + quarter;
+            block.cr = block.br + quarter;
+            block.ci = block.bi + quarter;
+            block.dr = block.cr + quarter;
+            block.di = block.ci + quarter;
+
+            int done = radix4ButterfliesSimd(block, quarter, sign);
+            radix4Butterflies(block, done, quarter, sign);
+        }
+    }
+}
+
+template <typename T>
+void BasicFFTPlan<T>::transform(T *real, T *imag, int dir) const
+{
+    if(m_convolutionPlan)
+        bluestein(real, imag, dir);
+    else
+        radix4(real, imag, dir);
+
+    /* Scaling for forward transform */
+    if(dir == 1) {
+        const T scale = T(1) / m_size;
+        for(int i = 0; i < m_size; ++i) {
+            real[i] *= scale;
+            imag[i] *= scale;
+        }
+    }
+}
+
+template <typename T>
+void BasicFFTPlan<T>::radix4(T *real, T *imag, int dir) const
+{
+    const int swapCount = static_cast<int>(m_swaps.size());
+    for(int s = 0; s < swapCount; s += 2) {
+        int i = m_swaps[s];
+        int j = m_swaps[s + 1];
+        std::swap(real[i], real[j]);
+        std::swap(imag[i], imag[j]);
+    }
+
+    if(dir == 1)
+        butterflies<false>(real, imag);
+    else
+        butterflies<true>(real, imag);
+}
+
+template <typename T>
+std::shared_ptr<const BasicRealFFTPlan<T>> BasicRealFFTPlan<T>::forSize(int n)
+{
+    if(n < 1)
+        return nullptr;
+
+    static std::mutex cacheMutex;
+    static std::map<int, std::shared_ptr<const BasicRealFFTPlan>> cache;
+
+    std::lock_guard<std::mutex> locker(cacheMutex);
+
+    std::shared_ptr<const BasicRealFFTPlan>& plan = cache[n];
+    if(!plan)
+        plan.reset(new BasicRealFFTPlan(n));
+
+    return plan;
+}
+
+template <typename T>
+BasicRealFFTPlan<T>::BasicRealFFTPlan(int n) :
+    m_size(n)
+{
+    if(n < 2)
+        return;
+
+    if(n % 2 == 1) {
+        m_complexPlan = BasicFFTPlan<T>::forSize(n);
+        return;
+    }
+
+    m_complexPlan = BasicFFTPlan<T>::forSize(n / 2);
+
+    for(int k = 0; k <= n / 2; ++k) {
+        double angle = -2.0 * Pi * k / n;
+        m_splitReal.push_back(static_cast<T>(std::cos(angle)));
+        m_splitImag.push_back(static_cast<T>(std::sin(angle)));
+    }
+}
+
+template <typename T>
+void BasicRealFFTPlan<T>::forward(const T *input, T *outputReal, T *outputImag, T *scratchReal, T *scratchImag) const
+{
+    if(m_size == 1) {
+        outputReal[0] = input[0];
+        outputImag[0] = T(0);
+        return;
+    }
+
+    // odd sizes have no even/odd split, the full complex transform is used
+    if(m_size % 2 == 1) {
+        for(int k = 0; k < m_size; ++k) {
+            scratchReal[k] = input[k];
+            scratchImag[k] = T(0);
+        }
+
+        m_complexPlan->transform(scratchReal, scratchImag, 1);
+
+        for(int k = 0; k < spectrumSize(); ++k) {
+            outputReal[k] = scratchReal[k];
+            outputImag[k] = scratchImag[k];
+        }
+        return;
+    }
+
+    const int half = m_size / 2;
+    const T h = T(0.5);
+
+    for(int m = 0; m < half; ++m) {
+        scratchReal[m] = input[2 * m];
+        scratchImag[m] = input[2 * m + 1];
+    }
+
+    // Z = E + iO, scaled by 1/half
+    m_complexPlan->transform(scratchReal, scratchImag, 1);
+
+    for(int k = 0; k <= half; ++k) {
+        int a = k % half;
+        int b = (half - k) % half;
+
+        // E[k] = (Z[k] + conj(Z[half-k])) / 2, O[k] = (Z[k] - conj(Z[half-k])) / 2i
+        T evenRe = h * (scratchReal[a] + scratchReal[b]);
+        T evenIm = h * (scratchImag[a] - scratchImag[b]);
+        T oddRe = h * (scratchImag[a] + scratchImag[b]);
+        T oddIm = -h * (scratchReal[a] - scratchReal[b]);
+
+        // X[k] = (E[k] + W^k O[k]) / 2, the extra half turns the 1/half scaling into 1/N
+        outputReal[k] = h * (evenRe + m_splitReal[k] * oddRe - m_splitImag[k] * oddIm);
+        outputImag[k] = h * (evenIm + m_splitReal[k] * oddIm + m_splitImag[k] * oddRe);
+    }
+}
+
+template <typename T>
+void BasicRealFFTPlan<T>::inverse(const T *inputReal, const T *inputImag, T *output, T *scratchReal, T *scratchImag) const
+{
+    if(m_size == 1) {
+        output[0] = inputReal[0];
+        return;
+    }
+
+    if(m_size % 2 == 1) {
+        const int spectrum = spectrumSize();
+
+        for(int k = 0; k < spectrum; ++k) {
+            scratchReal[k] = inputReal[k];
+            scratchImag[k] = inputImag[k];
+        }
+        // X[k] = conj(X[N-k])
+        for(int k = spectrum; k < m_size; ++k) {
+            scratchReal[k] = inputReal[m_size - k];
+            scratchImag[k] = -inputImag[m_size - k];
+        }
+
+        m_complexPlan->transform(scratchReal, scratchImag, -1);
+
+        for(int k = 0; k < m_size; ++k)
+            output[k] = scratchReal[k];
+        return;
+    }
+
+    const int half = m_size / 2;
+
+    for(int k = 0; k < half; ++k) {
+        // X[k + half] = conj(X[half - k])
+        T upperRe = inputReal[half - k];
+        T upperIm = -inputImag[half - k];
+
+        T evenRe = inputReal[k] + upperRe;
+        T evenIm = inputImag[k] + upperIm;
+        T diffRe = inputReal[k] - upperRe;
+        T diffIm = inputImag[k] - upperIm;
+
+        // O[k] = (X[k] - X[k + half]) W^-k
+        T oddRe = diffRe * m_splitReal[k] + diffIm * m_splitImag[k];
+        T oddIm = diffIm * m_splitReal[k] - diffRe * m_splitImag[k];
+
+        scratchReal[k] = evenRe - oddIm;
+        scratchImag[k] = evenIm + oddRe;
+    }
+
+    m_complexPlan->transform(scratchReal, scratchImag, -1);
+
+    for(int m = 0; m < half; ++m) {
+        output[2 * m] = scratchReal[m];
+        output[2 * m + 1] = scratchImag[m];
+    }
+}
+
+template class BasicFFTPlan<float>;
+template class BasicFFTPlan<double>;
+template class BasicRealFFTPlan<float>;
+template class BasicRealFFTPlan<double>;
+
+int halfSpectrumWidth(int width)
+{
+    return width / 2 + 1;
+}
+
+// Per thread scratch line, reused across calls instead of allocated per row band
+template <typename T>
+static void scratchLines(int n, T** real, T** imag)
+{
+    threadLines<T, ScratchLines>(n, real, imag);
+}
+
 bool FFT2D(Complex **c,int nx,int ny,int dir)
 {
-   int i,j;
-   int m,twopm;
-   double *real,*imag;
-
-   /* Transform the rows */
-   real = (double *)malloc(nx * sizeof(double));
-   imag = (double *)malloc(nx * sizeof(double));
-   if (real == NULL || imag == NULL)
-      return(false);
-   if (!Powerof2(nx,&m,&twopm) || twopm != nx)
-      return(false);
-   for (j=0;j<ny;j++) {
-      for (i=0;i<nx;i++) {
-         real[i] = c[i][j].real;
-         imag[i] = c[i][j].imag;
-      }
-      FFT(dir,m,real,imag);
-      for (i=0;i<nx;i++) {
-         c[i][j].real = real[i];
-         c[i][j].imag = imag[i];
-      }
-   }
-   free(real);
-   free(imag);
-
-   /* Transform the columns */
-   real = (double *)malloc(ny * sizeof(double));
-   imag = (double *)malloc(ny * sizeof(double));
-   if (real == NULL || imag == NULL)
-      return(false);
-   if (!Powerof2(ny,&m,&twopm) || twopm != ny)
-      return(false);
-   for (i=0;i<nx;i++) {
-      for (j=0;j<ny;j++) {
-         real[j] = c[i][j].real;
-         imag[j] = c[i][j].imag;
-      }
-      FFT(dir,m,real,imag);
-      for (j=0;j<ny;j++) {
-         c[i][j].real = real[j];
-         c[i][j].imag = imag[j];
-      }
-   }
-   free(real);
-   free(imag);
-
-   return(true);
+    std::shared_ptr<const FFTPlan> planX = FFTPlan::forSize(nx);
+    std::shared_ptr<const FFTPlan> planY = FFTPlan::forSize(ny);
+
+    if(!planX || !planY)
+        return false;
+
+    /* Transform the rows */
+    Parallel::forEachBand(0, ny, Parallel::bandHeight(nx * static_cast<int>(sizeof(Complex))), [&](int first, int last) {
+        double* real;
+        double* imag;
+        scratchLines(nx, &real, &imag);
+
+        for(int j = first; j < last; ++j) {
+            for(int i = 0; i < nx; ++i) {
+                real[i] = c[i][j].real;
+                imag[i] = c[i][j].imag;
+            }
+            planX->transform(real, imag, dir);
+            for(int i = 0; i < nx; ++i) {
+                c[i][j].real = real[i];
+                c[i][j].imag = imag[i];
+            }
+        }
+    });
+
+    /* Transform the columns */
+    Parallel::forEachBand(0, nx, Parallel::bandHeight(ny * static_cast<int>(sizeof(Complex))), [&](int first, int last) {
+        double* real;
+        double* imag;
+        scratchLines(ny, &real, &imag);
+
+        for(int i = first; i < last; ++i) {
+            for(int j = 0; j < ny; ++j) {
+                real[j] = c[i][j].real;
+                imag[j] = c[i][j].imag;
+            }
+            planY->transform(real, imag, dir);
+            for(int j = 0; j < ny; ++j) {
+                c[i][j].real = real[j];
+                c[i][j].imag = imag[j];
+            }
+        }
+    });
+
+    return true;
+}
+
+// Complex transform of every column of height x spectrumWidth row major spectrum planes
+template <typename T>
+static void transformSpectrumColumns(T* spectrumReal, T* spectrumImag, int spectrumWidth, int height, const BasicFFTPlan<T>& plan, int dir)
+{
+    Parallel::forEachBand(0, spectrumWidth, Parallel::bandHeight(height * 2 * static_cast<int>(sizeof(T))), [&](int first, int last) {
+        T* real;
+        T* imag;
+        scratchLines(height, &real, &imag);
+
+        for(int u = first; u < last; ++u) {
+            for(int v = 0; v < height; ++v) {
+                real[v] = spectrumReal[static_cast<size_t>(v) * spectrumWidth + u];
+                imag[v] = spectrumImag[static_cast<size_t>(v) * spectrumWidth + u];
+            }
+            plan.transform(real, imag, dir);
+            for(int v = 0; v < height; ++v) {
+                spectrumReal[static_cast<size_t>(v) * spectrumWidth + u] = real[v];
+                spectrumImag[static_cast<size_t>(v) * spectrumWidth + u] = imag[v];
+            }
+        }
+    });
+}
+
+template <typename T>
+bool RealFFT2D(const T *input, int width, int height, T *spectrumReal, T *spectrumImag)
+{
+    std::shared_ptr<const BasicRealFFTPlan<T>> rowPlan = BasicRealFFTPlan<T>::forSize(width);
+    std::shared_ptr<const BasicFFTPlan<T>> columnPlan = BasicFFTPlan<T>::forSize(height);
+
+    if(!rowPlan || !columnPlan)
+        return false;
+
+    const int spectrumWidth = halfSpectrumWidth(width);
+
+    /* Transform the rows */
+    Parallel::forEachBand(0, height, Parallel::bandHeight(width * static_cast<int>(sizeof(T))), [&](int first, int last) {
+        T* real;
+        T* imag;
+        scratchLines(width, &real, &imag);
+
+        for(int v = first; v < last; ++v) {
+            size_t row = static_cast<size_t>(v) * spectrumWidth;
+            rowPlan->forward(input + static_cast<size_t>(v) * width, spectrumReal + row, spectrumImag + row, real, imag);
+        }
+    });
+
+    /* Transform the columns */
+    transformSpectrumColumns(spectrumReal, spectrumImag, spectrumWidth, height, *columnPlan, 1);
+
+    return true;
 }
+
+template <typename T>
+bool InverseRealFFT2D(T *spectrumReal, T *spectrumImag, int width, int height, T *output)
+{
+    std::shared_ptr<const BasicRealFFTPlan<T>> rowPlan = BasicRealFFTPlan<T>::forSize(width);
+    std::shared_ptr<const BasicFFTPlan<T>> columnPlan = BasicFFTPlan<T>::forSize(height);
+
+    if(!rowPlan || !columnPlan)
+        return false;
+
+    const int spectrumWidth = halfSpectrumWidth(width);
+
+    /* Transform the columns */
+    transformSpectrumColumns(spectrumReal, spectrumImag, spectrumWidth, height, *columnPlan, -1);
+
+    /* Transform the rows */
+    Parallel::forEachBand(0, height, Parallel::bandHeight(width * static_cast<int>(sizeof(T))), [&](int first, int last) {
+        T* real;
+        T* imag;
+        scratchLines(width, &real, &imag);
+
+        for(int v = first; v < last; ++v) {
+            size_t row = static_cast<size_t>(v) * spectrumWidth;
+            rowPlan->inverse(spectrumReal + row, spectrumImag + row, output + static_cast<size_t>(v) * width, real, imag);
+        }
+    });
+
+    return true;
+}
+
+template bool RealFFT2D<float>(const float*, int, int, float*, float*);
+template bool RealFFT2D<double>(const double*, int, int, double*, double*);
+template bool InverseRealFFT2D<float>(float*, float*, int, int, float*);
+template bool InverseRealFFT2D<double>(double*, double*, int, int, double*);
@@ -1,12 +1,136 @@
 #ifndef FASTFOURIERTRANSFORM_H
 #define FASTFOURIERTRANSFORM_H
 
+#include <memory>
+#include <vector>
 
 struct Complex {
     double real;
     double imag;
 };
 
+/*
+ * Precomputed 1D FFT of one size, in float or double precision.
+ *
+ * For a power of two a plan holds the bit reversal permutation and the per
+ * stage twiddle factors, so transforms do no trigonometry and no data dependent
+ * index arithmetic. Stages are radix-4 butterflies, with one leading radix-2
+ * stage when the size is an odd power of two.
+ * Any other size uses Bluestein's algorithm: the DFT is rewritten as a chirp
+ * convolution and evaluated with a power of two plan of at least 2N-1 points.
+ * Data is kept in split real/imaginary planes so the butterflies vectorize.
+ * Plans are immutable and shared between threads.
+*/
+template <typename T>
+class BasicFFTPlan
+{
+public:
+    // Cached plan for size n, or nullptr when n < 1
+    static std::shared_ptr<const BasicFFTPlan> forSize(int n);
+
+    int size() const { return m_size; }
+
+    /*
+     * In place transform of split real/imaginary arrays of size() points.
+     * dir =  1 gives the forward transform, scaled by 1/N
+     * dir = -1 gives the reverse transform
+    */
+    void transform(T* real, T* imag, int dir) const;
+
+private:
+    explicit BasicFFTPlan(int n);
+
+    void initBluestein();
+    void radix4(T* real, T* imag, int dir) const;
+    void bluestein(T* real, T* imag, int dir) const;
+
+    template <bool Inverse>
+    void butterflies(T* real, T* imag) const;
+
+    struct Stage {
+        int quarter;       // L: the stage combines four blocks of L points into one of 4L
+        int twiddleOffset; // first of L entries of t^k, t^2k, t^3k in the twiddle arrays
+    };
+
+    int m_size;
+    bool m_leadingRadix2;
+    std::vector<int> m_swaps; // bit reversal as (i, j) pairs with i < j
+    std::vector<Stage> m_stages;
+    std::vector<T> m_twiddle1Real, m_twiddle1Imag;
+    std::vector<T> m_twiddle2Real, m_twiddle2Imag;
+    std::vector<T> m_twiddle3Real, m_twiddle3Imag;
+
+    // Bluestein only
+    std::shared_ptr<const BasicFFTPlan> m_convolutionPlan;
+    std::vector<T> m_chirpReal, m_chirpImag;   // w_k = exp(-i pi k^2 / N)
+    std::vector<T> m_filterReal, m_filterImag; // spectrum of conj(w) over M points
+};
+
+typedef BasicFFTPlan<double> FFTPlan;
+
+/*
+ * FFT of n real samples. For even n it is computed as a complex FFT of n/2
+ * points (even samples as real part, odd samples as imaginary part) followed
+ * by a split step, odd n falls back to a full complex FFT. Only the n/2+1
+ * non-redundant outputs are produced, the rest follow from X[n-k] = conj(X[k]).
+*/
+template <typename T>
+class BasicRealFFTPlan
+{
+public:
+    static std::shared_ptr<const BasicRealFFTPlan> forSize(int n);
+
+    int size() const { return m_size; }
+    int spectrumSize() const { return m_size / 2 + 1; }
+
+    // spectrumSize() outputs scaled by 1/N, scratch holds size() values each
+    void forward(const T* input, T* outputReal, T* outputImag, T* scratchReal, T* scratchImag) const;
+    // size() outputs, unscaled
+    void inverse(const T* inputReal, const T* inputImag, T* output, T* scratchReal, T* scratchImag) const;
+
+private:
+    explicit BasicRealFFTPlan(int n);
+
+    int m_size;
+    std::shared_ptr<const BasicFFTPlan<T>> m_complexPlan; // n/2 points for even n, n points for odd n
+    std::vector<T> m_splitReal, m_splitImag; // W^k = exp(-2 pi i k / N), k = 0..N/2, even n only
+};
+
+typedef BasicRealFFTPlan<double> RealFFTPlan;
+
+extern template class BasicFFTPlan<float>;
+extern template class BasicFFTPlan<double>;
+extern template class BasicRealFFTPlan<float>;
+extern template class BasicRealFFTPlan<double>;
+
+/*
+ * Columns of the half-spectrum of a width x height real image
+*/
+int halfSpectrumWidth(int width);
+
+/*
+ * Forward 2D transform of a real image, scaled by 1/(width*height) like FFT2D.
+ * input is height rows of width samples, the spectrum planes receive height rows
+ * of halfSpectrumWidth(width) values with the zero frequency at [0][0] (not centered).
+ * Instantiated for float and double.
+ * Any positive dimensions are supported, return false otherwise
+*/
+template <typename T>
+bool RealFFT2D(const T* input, int width, int height, T* spectrumReal, T* spectrumImag);
+
+/*
+ * Reverse of RealFFT2D. The spectrum must be Hermitian (as every spectrum of a
+ * real image is) and is overwritten.
+*/
+template <typename T>
+bool InverseRealFFT2D(T* spectrumReal, T* spectrumImag, int width, int height, T* output);
+
+/*
+ * Perform a 2D FFT inplace given a complex 2D array
+ * The direction dir, 1 for forward, -1 for reverse
+ * The size of the array (nx,ny), any positive size
+ * Return false if a dimension is not positive
+*/
 bool FFT2D(Complex **c,int nx,int ny,int dir);
 
 #endif // FASTFOURIERTRANSFORM_H
@@ -1,56 +1,74 @@
 #include "filter.h"
-#include <QDebug>
+#include <QAtomicInt>
+#include <QMutex>
 #include <QtMath>
 #include <stdio.h>
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include "bufferpool.h"
 #include "fastfouriertransform.h"
+#include "frequencymask.h"
+#include "integralimage.h"
+#include "convolution.h"
+#include "luminance.h"
+#include "parallel.h"
+#include "pointop.h"
+#include "resample.h"
+#include "separable.h"
+#include "trace.h"
+
+static QAtomicInt s_fourierPadding(Filter::NoPadding);
+
+static qint64 pixelCount(const QImage& image)
+{
+    return static_cast<qint64>(image.width()) * image.height();
+}
+
+// 8-bit images do not need double precision, the pass filters transform in float
+typedef float FourierSample;
+
+// Half spectrum of a real image as split real and imaginary planes
+struct HalfSpectrum {
+    BufferPool::Buffer real;
+    BufferPool::Buffer imag;
 
-enum FourierType {
-    LOW_PASS,
-    HIGH_PASS,
-    BAND_PASS
+    FourierSample* realData() const { return real.as<FourierSample>(); }
+    FourierSample* imagData() const { return imag.as<FourierSample>(); }
 };
 
-static void bandPassFilter(Complex** complex2DArray, int width, int height, double minRadius, double maxRadius)
+// Planes of count samples each, both null if the pool cannot provide them
+static bool acquireSpectrum(HalfSpectrum* spectrum, size_t count)
 {
-    for(int i = 0; i < height; ++i)
-        for(int j = 0; j < width; ++j){
-            //d(u,v) = [(u - M/2)^2 + (v - N/2)^2]^1/2
-            double duv = qSqrt((j - width/2)*(j - width/2) + (i - height/2)*(i - height/2));
+    spectrum->real = BufferPool::acquire(count * sizeof(FourierSample));
+    spectrum->imag = BufferPool::acquire(count * sizeof(FourierSample));
 
-            if(duv < minRadius || duv > maxRadius) {
-                complex2DArray[i][j].real = 0.0;
-                complex2DArray[i][j].imag = 0.0;
-            }
-        }
+    return !spectrum->real.isNull() && !spectrum->imag.isNull();
 }
 
-static void lowPassFilter(Complex** complex2DArray, int width, int height, double radius)
-{
-    for(int i = 0; i < height; ++i)
-        for(int j = 0; j < width; ++j){
-            //d(u,v) = [(u - M/2)^2 + (v - N/2)^2]^1/2
-            double duv = qSqrt((j - width/2)*(j - width/2) + (i - height/2)*(i - height/2));
+// Plane of the magnitude filter, row pointers into one block of width x height values
+struct ComplexPlane {
+    BufferPool::Buffer values;
+    BufferPool::Buffer rowPointers;
 
-            if(duv >= radius) {
-                complex2DArray[i][j].real = 0.0;
-                complex2DArray[i][j].imag = 0.0;
-            }
-        }
-}
+    Complex** rows() const { return rowPointers.as<Complex*>(); }
+};
 
 static void highPassFilter(Complex** complex2DArray, int width, int height, double radius)
 {
-    for(int i = 0; i < height; ++i)
-        for(int j = 0; j < width; ++j){
-            //d(u,v) = [(u - M/2)^2 + (v - N/2)^2]^1/2
-            double duv = qSqrt((j - width/2)*(j - width/2) + (i - height/2)*(i - height/2));
-
-            if(duv < radius) {
-                complex2DArray[i][j].real = 0.0;
-                complex2DArray[i][j].imag = 0.0;
+    Parallel::forEachBand(0, height, Parallel::bandHeight(width * static_cast<int>(sizeof(Complex))), [=](int firstRow, int lastRow) {
+        for(int i = firstRow; i < lastRow; ++i)
+            for(int j = 0; j < width; ++j){
+                //d(u,v) = [(u - M/2)^2 + (v - N/2)^2]^1/2
+                double duv = qSqrt((j - width/2)*(j - width/2) + (i - height/2)*(i - height/2));
+
+                if(duv < radius) {
+                    complex2DArray[i][j].real = 0.0;
+                    complex2DArray[i][j].imag = 0.0;
+                }
             }
-        }
-
+    });
 }
 
 static QImage convertComplex2dArrayToMagnitudeImage(Complex** complex2dArray, int width, int height) {
@@ -69,192 +87,477 @@ static QImage convertComplex2dArrayToMagnitudeImage(Complex** complex2dArray, in
     }
 
     double c = 255/(qLn(1 + max));
-    qDebug() << "MAX: " << max;
-    qDebug() << "C: " << c;
-
-    QImage outputImage(width, height, QImage::Format_Grayscale8);
 
+    QImage outputImage = BufferPool::image(width, height, QImage::Format_Grayscale8);
+    uchar* outputBits = outputImage.bits();
+    int outputStride = outputImage.bytesPerLine();
 
-    for(int i = 0; i < height; ++i)
-        for(int j = 0; j < width; ++j) {
+    Parallel::forEachBand(0, height, Parallel::bandHeight(width * static_cast<int>(sizeof(Complex))), [=](int firstRow, int lastRow) {
+        for(int i = firstRow; i < lastRow; ++i) {
+            uchar* outputLine = outputBits + i * outputStride;
 
-            double real = complex2dArray[i][j].real;
-            double imag = complex2dArray[i][j].imag;
-            double mag = qSqrt(real * real + imag * imag) * 150;
+            for(int j = 0; j < width; ++j) {
 
-            double gray = c * qLn(1 + mag);
+                double real = complex2dArray[i][j].real;
+                double imag = complex2dArray[i][j].imag;
+                double mag = qSqrt(real * real + imag * imag) * 150;
 
-            int grayPixel = static_cast<int>(gray);
+                double gray = c * qLn(1 + mag);
 
-            outputImage.setPixel(j, i, qRgb(grayPixel, grayPixel, grayPixel));
+                outputLine[j] = static_cast<uchar>(static_cast<int>(gray));
+            }
         }
+    });
 
     return outputImage;
 }
 
-static Complex** convertQImageToCenteredComplex2dArray(const QImage& image)
+// The magnitude filter converts a scaled copy, its luminance is not worth keeping
+static bool convertQImageToCenteredComplex2dArray(const QImage& image, ComplexPlane* plane)
 {
-
+    const QImage gray = Luminance::convert(image);
     int width = image.width();
     int height = image.height();
 
+    plane->values = BufferPool::acquire(static_cast<size_t>(width) * height * sizeof(Complex));
+    plane->rowPointers = BufferPool::acquire(static_cast<size_t>(height) * sizeof(Complex*));
 
-    Complex* complexPtr = new Complex[width*height*sizeof(Complex)];
+    if(plane->values.isNull() || plane->rowPointers.isNull())
+        return false;
 
-    Complex** rowComplexPtr = new Complex*[height*sizeof(Complex*)];
+    Complex* complexPtr = plane->values.as<Complex>();
+    Complex** rowComplexPtr = plane->rows();
 
     for(int i = 0; i < height; ++i)
-        rowComplexPtr[i] = &complexPtr[i*width];
+        rowComplexPtr[i] = &complexPtr[static_cast<size_t>(i) * width];
 
-    for(int i = 0; i < height; ++i)
-        for(int j = 0; j < width; ++j) {
-            int pixel = qGray(image.pixel(j,i));
-            rowComplexPtr[i][j].real = pixel * qPow(-1, i+j);
-            rowComplexPtr[i][j].imag = 0;
+    Parallel::forEachBand(0, height, Parallel::bandHeight(width * static_cast<int>(sizeof(Complex))), [&](int firstRow, int lastRow) {
+        for(int i = firstRow; i < lastRow; ++i) {
+            const uchar* grayLine = gray.constScanLine(i);
+
+            for(int j = 0; j < width; ++j) {
+                int pixel = grayLine[j];
+                // (-1)^(i+j) moves the zero frequency to the center of the spectrum
+                rowComplexPtr[i][j].real = ((i + j) & 1) ? -pixel : pixel;
+                rowComplexPtr[i][j].imag = 0;
 
+            }
         }
+    });
 
-    return rowComplexPtr;
+    return true;
 
 }
 
-static QImage convertCenteredComplex2dArrayToQImage(Complex** complex2dArray, int width, int height)
+// Gray samples of image in the top left corner of a width x height array, the rest is zero
+static BufferPool::Buffer convertQImageToRealArray(const QImage& image, int width, int height)
 {
-    QImage image(width, height, QImage::Format_Grayscale8);
+    const QImage gray = Luminance::plane(image);
+    int imageWidth = image.width();
+    int imageHeight = image.height();
 
-    for(int i = 0; i < height; ++i)
-        for(int j = 0; j < width; ++j) {
-            int grayValue = static_cast<int>(complex2dArray[i][j].real* qPow(-1, i+j));
+    BufferPool::Buffer buffer = BufferPool::acquire(static_cast<size_t>(width) * height * sizeof(FourierSample));
+    FourierSample* samples = buffer.as<FourierSample>();
+
+    if(!samples)
+        return buffer;
 
-            if(grayValue < 0)
-                grayValue = 0;
+    // a pooled block holds whatever its last user left, the padding is cleared here
+    Parallel::forEachBand(0, height, Parallel::bandHeight(width * static_cast<int>(sizeof(FourierSample))), [&](int firstRow, int lastRow) {
+        for(int i = firstRow; i < lastRow; ++i) {
+            FourierSample* samplesRow = samples + static_cast<size_t>(i) * width;
+            int j = 0;
 
-            if(grayValue > 255)
-                grayValue = 255;
+            if(i < imageHeight) {
+                const uchar* grayLine = gray.constScanLine(i);
 
-            image.setPixel(j, i, qRgb(grayValue, grayValue, grayValue));
+                for(; j < imageWidth; ++j)
+                    samplesRow[j] = grayLine[j];
+            }
+
+            std::fill(samplesRow + j, samplesRow + width, FourierSample(0));
         }
+    });
+
+    return buffer;
+}
+
+// The top left width x height corner of a samples array with rows of stride values
+static QImage convertRealArrayToQImage(const FourierSample* samples, int stride, int width, int height)
+{
+    QImage image = BufferPool::image(width, height, QImage::Format_Grayscale8);
+    uchar* imageBits = image.bits();
+    int imageStride = image.bytesPerLine();
+
+    Parallel::forEachBand(0, height, Parallel::bandHeight(width * static_cast<int>(sizeof(FourierSample))), [=](int firstRow, int lastRow) {
+        for(int i = firstRow; i < lastRow; ++i) {
+            const FourierSample* samplesRow = samples + static_cast<size_t>(i) * stride;
+            uchar* imageLine = imageBits + i * imageStride;
+
+            for(int j = 0; j < width; ++j) {
+                int grayValue = static_cast<int>(samplesRow[j]);
+
+                if(grayValue < 0)
+                    grayValue = 0;
+
+                if(grayValue > 255)
+                    grayValue = 255;
+
+                imageLine[j] = static_cast<uchar>(grayValue);
+            }
+        }
+    });
 
     return image;
 }
 
-static void deleteComplex2dArray(Complex** complex2dArray)
+/*
+ * Forward spectra of the last images run through the Fourier filters, keyed on the image
+ * identity and transform size. A radius change then costs only a mask and an inverse transform.
+ * There are two entries so the preview proxy the window filters while a slider is dragged does
+ * not evict the spectrum of the full image rendered on release.
+*/
+struct SpectrumEntry {
+    qint64 cacheKey = 0;
+    int width = 0;
+    int height = 0;
+    // value of SpectrumCache::useCount when the entry was last returned
+    quint64 lastUse = 0;
+    std::shared_ptr<const HalfSpectrum> spectrum;
+};
+
+struct SpectrumCache {
+    QMutex mutex;
+    quint64 useCount = 0;
+    SpectrumEntry entries[2];
+};
+
+static SpectrumCache& spectrumCache()
+{
+    static SpectrumCache cache;
+    return cache;
+}
+
+static std::shared_ptr<const HalfSpectrum> forwardSpectrum(const QImage& image, int width, int height)
 {
-    delete complex2dArray[0];
-    delete complex2dArray;
+    SpectrumCache& cache = spectrumCache();
+    qint64 cacheKey = image.cacheKey();
+
+    {
+        QMutexLocker locker(&cache.mutex);
+
+        for(SpectrumEntry& entry : cache.entries) {
+            if(entry.spectrum && entry.cacheKey == cacheKey && entry.width == width && entry.height == height) {
+                entry.lastUse = ++cache.useCount;
+                Trace::cacheHits().add(1);
+                return entry.spectrum;
+            }
+        }
+    }
+
+    // the image is real, so only the non-redundant half of its spectrum is transformed and masked
+    BufferPool::Buffer samples;
+    {
+        Trace::Scope scope("Fourier: conversion");
+        samples = convertQImageToRealArray(image, width, height);
+    }
+
+    std::shared_ptr<HalfSpectrum> spectrum = std::make_shared<HalfSpectrum>();
+
+    if(samples.isNull() || !acquireSpectrum(spectrum.get(), static_cast<size_t>(height) * halfSpectrumWidth(width)))
+        return nullptr;
+
+    {
+        Trace::Scope scope("Fourier: forward FFT2D");
+        if(!RealFFT2D(samples.as<FourierSample>(), width, height, spectrum->realData(), spectrum->imagData()))
+            return nullptr;
+    }
 
+    // an interrupted transform is incomplete and must not be cached
+    if(Parallel::isCancelled())
+        return nullptr;
+
+    // the least recently used entry makes room, an empty one has never been used
+    QMutexLocker locker(&cache.mutex);
+    SpectrumEntry& entry = cache.entries[0].lastUse <= cache.entries[1].lastUse ? cache.entries[0] : cache.entries[1];
+    entry.cacheKey = cacheKey;
+    entry.width = width;
+    entry.height = height;
+    entry.lastUse = ++cache.useCount;
+    entry.spectrum = spectrum;
+
+    return spectrum;
 }
 
-static QImage fourierPassFilter(const QImage &originalImage, double radius1, double radius2, FourierType filterType)
+static QImage fourierPassFilter(const QImage &originalImage, double radius1, double radius2, FrequencyMask::Band band,
+                                Filter::MaskShape shape, int order)
 {
-    int originalWidth = originalImage.width();
-    int originalHeight = originalImage.height();
-    int maxDim = qMax(originalWidth, originalHeight);
-    int nextPowerOfTwo = static_cast<int>(qNextPowerOfTwo(static_cast<quint32>(maxDim-1))); //maxDim -1  is a fast workaround to handle cases where maxDim is already a power of two
+    int imageWidth = originalImage.width();
+    int imageHeight = originalImage.height();
 
-    QImage scaledImage = originalImage.scaled(nextPowerOfTwo, nextPowerOfTwo);
-    int width = scaledImage.width();
-    int height = scaledImage.height();
+    if(originalImage.isNull())
+        return QImage();
+
+    // the transform runs at the native size, or padded with zeros to powers of two for the radix-4 path
+    int width = imageWidth;
+    int height = imageHeight;
+
+    if(Filter::fourierPadding() == Filter::ZeroPadToPowerOfTwo) {
+        width = static_cast<int>(qNextPowerOfTwo(static_cast<quint32>(imageWidth - 1)));
+        height = static_cast<int>(qNextPowerOfTwo(static_cast<quint32>(imageHeight - 1)));
+    }
+
+    std::shared_ptr<const HalfSpectrum> forward = forwardSpectrum(originalImage, width, height);
+
+    if(!forward)
+        return QImage();
 
-    Complex** complex2dArray = convertQImageToCenteredComplex2dArray(scaledImage);
+    // the cached spectrum is shared, the mask works on a copy
+    const size_t spectrumSize = static_cast<size_t>(height) * halfSpectrumWidth(width);
+    HalfSpectrum spectrum;
 
-    FFT2D(complex2dArray, width, height, 1);
+    if(!acquireSpectrum(&spectrum, spectrumSize))
+        return QImage();
+
+    {
+        Trace::Scope scope("Fourier: spectrum copy");
+        std::memcpy(spectrum.realData(), forward->realData(), spectrumSize * sizeof(FourierSample));
+        std::memcpy(spectrum.imagData(), forward->imagData(), spectrumSize * sizeof(FourierSample));
+    }
 
-    //transform de radius percentage relative to the image where max radius equal to the square diagonal l/2 * 2^(1/2)
+    //transform de radius percentage in a normalized radius where the max radius is the corner frequency (1/2, 1/2), 2^(1/2)/2
     //Given that the filter is not linea qPow is used to improve the feeling of horizontal bar movement as deltaY has a small variation between 0..1
-    radius1 = qPow(radius1/100.0, 3) * (nextPowerOfTwo/2) * qSqrt(2.0);
-    radius2 = qPow(radius2/100.0, 3) * (nextPowerOfTwo/2) * qSqrt(2.0);
+    radius1 = qPow(radius1/100.0, 3) * qSqrt(2.0) / 2;
+    radius2 = qPow(radius2/100.0, 3) * qSqrt(2.0) / 2;
 
 
-    switch(filterType)
+    // Filter::MaskShape lists the shapes in the order of FrequencyMask::Shape
+    FrequencyMask::Mask mask = { static_cast<FrequencyMask::Shape>(shape), band, radius1, radius2, order };
     {
-    case LOW_PASS:
-        lowPassFilter(complex2dArray, width, height, radius1);
-        break;
-    case HIGH_PASS:
-        highPassFilter(complex2dArray, width, height, radius1);
-        break;
-    case BAND_PASS:
-        bandPassFilter(complex2dArray, width, height, radius1, radius2);
-        break;
+        Trace::Scope scope("Fourier: masking");
+        FrequencyMask::apply(mask, spectrum.realData(), spectrum.imagData(), width, height);
     }
-    FFT2D(complex2dArray, width, height, -1);
 
-    QImage transformed = convertCenteredComplex2dArrayToQImage(complex2dArray, width, height).scaled(originalWidth, originalHeight);
-    deleteComplex2dArray(complex2dArray);
+    BufferPool::Buffer samples = BufferPool::acquire(static_cast<size_t>(width) * height * sizeof(FourierSample));
 
-    return transformed;
+    if(samples.isNull())
+        return QImage();
+
+    {
+        Trace::Scope scope("Fourier: inverse FFT2D");
+        InverseRealFFT2D(spectrum.realData(), spectrum.imagData(), width, height, samples.as<FourierSample>());
+    }
+
+    Trace::Scope scope("Fourier: conversion back");
+    return convertRealArrayToQImage(samples.as<FourierSample>(), width, imageWidth, imageHeight);
 
 }
 
-QImage Filter::crazyFilter(int filterParam, const QImage &originalImage)
+void Filter::setThreadCount(int threadCount)
 {
+    Parallel::setThreadCount(threadCount);
+}
 
-    int width = originalImage.width();
-    int height = originalImage.height();
-    QImage resultImage(width, height, originalImage.format());
+int Filter::threadCount()
+{
+    return Parallel::threadCount();
+}
 
-    for(int i = 0; i < height; ++i)
-        for(int j = 0; j < width; ++j) {
+void Filter::setFourierPadding(Filter::FourierPadding padding)
+{
+    s_fourierPadding.storeRelease(padding);
+}
+
+Filter::FourierPadding Filter::fourierPadding()
+{
+    return static_cast<FourierPadding>(s_fourierPadding.loadAcquire());
+}
+
+void Filter::clearSpectrumCache()
+{
+    SpectrumCache& cache = spectrumCache();
 
-            if((j < width ) && (i < height)) {
-                QRgb pixelColor = originalImage.pixel(j,i);
+    QMutexLocker locker(&cache.mutex);
+    cache.useCount = 0;
 
-                QColor color(pixelColor);
+    for(SpectrumEntry& entry : cache.entries)
+        entry = SpectrumEntry();
+}
+
+// Pixels are read and written straight on scanlines, so resample in a format with a fixed pixel size
+static QImage::Format resampleFormat(QImage::Format format)
+{
+    if(format == QImage::Format_Grayscale8 || format == QImage::Format_RGB32 || format == QImage::Format_ARGB32)
+        return format;
 
-                color.setRed((color.red() + filterParam ) & 0xFF);
-                color.setGreen((color.green() + filterParam) & 0xFF);
-                color.setBlue((color.blue() + filterParam) & 0xFF);
+    return QImage::Format_ARGB32;
+}
+
+// Columns per tile of warpTransform(), a band of rows is resampled one tile after the other
+static const int WarpTileWidth = 128;
 
+/*
+ * Result pixel (j, i) samples the original at the position its center (j + 0.5, i + 0.5)
+ * maps to; original pixel (x, y) covers [x, x+1) x [y, y+1), so nearest neighbour truncates
+ * the position and the interpolating samplers shift it by half a pixel into sample space.
+*/
+static void warpAffineBand(const QImage& source, const QTransform& inverse, Filter::Sampling sampling,
+                           uchar* resultBits, int resultStride, int resultWidth, int firstRow, int lastRow)
+{
+    const Resample::Fixed half = Resample::Fixed(1) << (Resample::FixedBits - 1);
+    const Resample::Fixed stepX = Resample::toFixed(inverse.m11());
+    const Resample::Fixed stepY = Resample::toFixed(inverse.m12());
 
-                resultImage.setPixel(j, i, color.rgb());
+    for(int tileBegin = 0; tileBegin < resultWidth; tileBegin += WarpTileWidth) {
+        int tileEnd = qMin(tileBegin + WarpTileWidth, resultWidth);
+
+        for(int i = firstRow; i < lastRow; ++i) {
+            QPointF origin = inverse.map(QPointF(0.5, i + 0.5));
+
+            Resample::RowMapping row;
+            row.x = Resample::toFixed(origin.x());
+            row.y = Resample::toFixed(origin.y());
+            row.dx = stepX;
+            row.dy = stepY;
+
+            int begin = tileBegin;
+            int end = tileEnd;
+            if(!Resample::clipRow(row, 0, 0, source.width(), source.height(), &begin, &end))
+                continue;
+
+            uchar* resultLine = resultBits + i * resultStride;
+
+            if(sampling == Filter::NearestSampling) {
+                Resample::nearestRow(source, row, resultLine, begin, end);
+                continue;
             }
 
+            row.x -= half;
+            row.y -= half;
 
+            if(sampling == Filter::BicubicSampling)
+                Resample::bicubicRow(source, row, resultLine, begin, end);
+            else
+                Resample::bilinearRow(source, row, resultLine, begin, end);
         }
+    }
+}
 
-    return resultImage;
+// Projective rows divide per pixel, the positions of a tile row are computed first and then sampled run by run
+static void warpProjectiveBand(const QImage& source, const QTransform& inverse, Filter::Sampling sampling,
+                               uchar* resultBits, int resultStride, int resultWidth, int firstRow, int lastRow)
+{
+    const double sourceWidth = source.width();
+    const double sourceHeight = source.height();
+    const double shift = sampling == Filter::NearestSampling ? 0.0 : 0.5;
+
+    std::vector<Resample::Fixed> positionsX(resultWidth);
+    std::vector<Resample::Fixed> positionsY(resultWidth);
+    std::vector<bool> inside(resultWidth);
+
+    for(int tileBegin = 0; tileBegin < resultWidth; tileBegin += WarpTileWidth) {
+        int tileEnd = qMin(tileBegin + WarpTileWidth, resultWidth);
+
+        for(int i = firstRow; i < lastRow; ++i) {
+            double y = i + 0.5;
+
+            for(int j = tileBegin; j < tileEnd; ++j) {
+                double x = j + 0.5;
+                double w = inverse.m13()*x + inverse.m23()*y + inverse.m33();
+                double u = (inverse.m11()*x + inverse.m21()*y + inverse.dx()) / w;
+                double v = (inverse.m12()*x + inverse.m22()*y + inverse.dy()) / w;
+
+                // w <= 0 are points behind the projection, they never belong to the image
+                inside[j] = w > 0 && u >= 0 && u < sourceWidth && v >= 0 && v < sourceHeight;
+                if(inside[j]) {
+                    positionsX[j] = Resample::toFixed(u - shift);
+                    positionsY[j] = Resample::toFixed(v - shift);
+                }
+            }
 
+            uchar* resultLine = resultBits + i * resultStride;
 
+            for(int begin = tileBegin; begin < tileEnd; ) {
+                if(!inside[begin]) {
+                    ++begin;
+                    continue;
+                }
+
+                int end = begin + 1;
+                while(end < tileEnd && inside[end])
+                    ++end;
+
+                if(sampling == Filter::NearestSampling)
+                    Resample::nearestPoints(source, positionsX.data(), positionsY.data(), resultLine, begin, end);
+                else if(sampling == Filter::BicubicSampling)
+                    Resample::bicubicPoints(source, positionsX.data(), positionsY.data(), resultLine, begin, end);
+                else
+                    Resample::bilinearPoints(source, positionsX.data(), positionsY.data(), resultLine, begin, end);
+
+                begin = end;
+            }
+        }
+    }
+}
+
+QImage Filter::crazyFilter(int filterParam, const QImage &originalImage)
+{
+    Trace::Scope scope("Filter::crazyFilter", pixelCount(originalImage));
+    // like QColor(QRgb), the result is always opaque
+    return PointOp::offset(filterParam).then(PointOp::opaque()).apply(originalImage);
 }
 
 QImage Filter::rotationTransform(int degrees, const QImage &originalImage, bool hasBilinearInterpolation)
 {
+    Trace::Scope scope("Filter::rotationTransform", pixelCount(originalImage));
     double angle = qDegreesToRadians(static_cast<double>(degrees));
     double cosAngle = qCos(angle);
     double sinAngle = qSin(angle);
 
     int width = originalImage.width();
     int height = originalImage.height();
-    QImage resultImage(width, height, originalImage.format());
-    resultImage.fill(Qt::black);
-
 
+    QImage::Format resultFormat = resampleFormat(originalImage.format());
+    QImage sourceImage = originalImage.format() == resultFormat ? originalImage : originalImage.convertToFormat(resultFormat);
 
+    QImage resultImage = BufferPool::image(width, height, resultFormat);
+    resultImage.fill(Qt::black);
+    uchar* resultBits = resultImage.bits();
+    int resultStride = resultImage.bytesPerLine();
 
     int pivotX = width/2;
     int pivotY = height/2;
 
-
-    for(int i = 0; i < height; ++i)
-        for(int j = 0; j < width; j++) {
-            double originalX = ((j-pivotX)*cosAngle) + ((i-pivotY)*sinAngle) + pivotX;
-            double originalY = (-1*(j-pivotX)*sinAngle) + (cosAngle*(i-pivotY)) + pivotY;
-
-            int transformX = j;// + pivotX;
-            int transformY = i;// - pivotY;
-
-            if(((originalX >= 0 && originalX < width) && (originalY >=0 && originalY < height)) &&
-                    ((transformX >= 0 && transformX < width) && (transformY >=0 && transformY < height))) {
-
-                if(hasBilinearInterpolation)
-                    resultImage.setPixel(j, i, bilinearInterpolation(originalX, originalY, originalImage));
-                else
-                    resultImage.setPixel(j, i, originalImage.pixel(static_cast<int>(originalX), static_cast<int>(originalY)));
-
-            }
-
+    // originalX = (j-pivotX)*cos + (i-pivotY)*sin + pivotX, originalY = -(j-pivotX)*sin + (i-pivotY)*cos + pivotY
+    Resample::Fixed stepX = Resample::toFixed(cosAngle);
+    Resample::Fixed stepY = Resample::toFixed(-sinAngle);
+
+    Parallel::forEachBand(0, height, Parallel::bandHeight(resultStride), [&](int firstRow, int lastRow) {
+        for(int i = firstRow; i < lastRow; ++i) {
+            // anchored at the pivot column, so the pivot itself maps exactly
+            Resample::RowMapping row;
+            row.x = Resample::toFixed((i-pivotY)*sinAngle + pivotX) - pivotX * stepX;
+            row.y = Resample::toFixed((i-pivotY)*cosAngle + pivotY) - pivotX * stepY;
+            row.dx = stepX;
+            row.dy = stepY;
+
+            // only the columns that map inside the original image are sampled, the rest stays black
+            int begin = 0;
+            int end = width;
+            if(!Resample::clipRow(row, 0, 0, width, height, &begin, &end))
+                continue;
+
+            uchar* resultLine = resultBits + i * resultStride;
+
+            if(hasBilinearInterpolation)
+                Resample::bilinearRow(sourceImage, row, resultLine, begin, end);
+            else
+                Resample::nearestRow(sourceImage, row, resultLine, begin, end);
         }
+    });
+
+    if(resultFormat != originalImage.format())
+        return resultImage.convertToFormat(originalImage.format());
 
     return resultImage;
 
@@ -262,179 +565,290 @@ QImage Filter::rotationTransform(int degrees, const QImage &originalImage, bool
 
 QRgb Filter::bilinearInterpolation(double x, double y, const QImage &originalImage)
 {
-     int px1 = static_cast<int>(x);
-     int px2 = static_cast<int>(x) + 1;
-     int py1 = static_cast<int>(y);
-     int py2 = static_cast<int>(y) + 1;
+    int width = originalImage.width();
+    int height = originalImage.height();
 
-     if((px1 < 0) || (px2 >= originalImage.width() )|| (py1 < 0) || (py2 >= originalImage.height()))
-         return originalImage.pixel(static_cast<int>(x), static_cast<int>(y));
+    if(width == 0 || height == 0)
+        return 0;
 
-     // 4 cores dos pixels vizinhos
-     const QColor p1Color = originalImage.pixel(px1, py1);
-     const QColor p2Color = originalImage.pixel(px2, py1);
-     const QColor p3Color = originalImage.pixel(px1, py2);
-     const QColor p4Color = originalImage.pixel(px2, py2);
+    // positions outside the image take the nearest border pixel
+    x = qBound(0.0, x, width - 1.0);
+    y = qBound(0.0, y, height - 1.0);
 
-     int pointRedComponent = (p1Color.red() + p2Color.red() + p3Color.red() + p4Color.red())/4;
-     int pointGreenComponent = (p1Color.green() + p2Color.green() + p3Color.green() + p4Color.green())/4;
-     int pointBlueComponent = (p1Color.blue() + p2Color.blue() + p3Color.blue() + p4Color.blue())/4;
+    int px1 = static_cast<int>(x);
+    int py1 = static_cast<int>(y);
+    int px2 = qMin(px1 + 1, width - 1);
+    int py2 = qMin(py1 + 1, height - 1);
 
-     return QColor(pointRedComponent, pointGreenComponent, pointBlueComponent).rgb();
-}
+    double fx = x - px1;
+    double fy = y - py1;
 
-QImage Filter::sobelFilter(const QImage &originalImage, int minThreshold, int maxThreshold)
-{
-    QImage grayImage = originalImage;
-    QImage filteredImage(originalImage.width(), originalImage.height(), QImage::Format_Grayscale8);
-
-    int sobelX[3][3]{{-1,0,1}, {-2,0,2}, {-1,0,1}};
-    int sobelY[3][3] = {{-1,-2,-1}, {0,0,0},{1,2,1}};
+    // the 4 neighbouring pixels, each weighted by the area of the opposite sub-rectangle
+    QRgb p1 = originalImage.pixel(px1, py1);
+    QRgb p2 = originalImage.pixel(px2, py1);
+    QRgb p3 = originalImage.pixel(px1, py2);
+    QRgb p4 = originalImage.pixel(px2, py2);
 
-    int width = grayImage.width();
-    int height = grayImage.height();
+    double w1 = (1 - fx) * (1 - fy);
+    double w2 = fx * (1 - fy);
+    double w3 = (1 - fx) * fy;
+    double w4 = fx * fy;
 
-    for(int y = 1; y < height -2; ++y)
-        for(int x = 1; x < width -2; ++x) {
+    int red = qRound(qRed(p1)*w1 + qRed(p2)*w2 + qRed(p3)*w3 + qRed(p4)*w4);
+    int green = qRound(qGreen(p1)*w1 + qGreen(p2)*w2 + qGreen(p3)*w3 + qGreen(p4)*w4);
+    int blue = qRound(qBlue(p1)*w1 + qBlue(p2)*w2 + qBlue(p3)*w3 + qBlue(p4)*w4);
+    int alpha = qRound(qAlpha(p1)*w1 + qAlpha(p2)*w2 + qAlpha(p3)*w3 + qAlpha(p4)*w4);
 
-            int xn1yn1 = qGray((grayImage.pixel(x-1,y-1)));
-            int x0yn1 = qGray((grayImage.pixel(x,y-1)));
-            int x1yn1 = qGray((grayImage.pixel(x+1,y-1)));
-            int xn1y0 = qGray((grayImage.pixel(x-1,y)));
-            int x0y0 = qGray((grayImage.pixel(x,y)));
-            int x1y0 = qGray((grayImage.pixel(x+1,y)));
-            int xn1y1 = qGray((grayImage.pixel(x-1,y+1)));
-            int x0y1 = qGray((grayImage.pixel(x,y+1)));
-            int x1y1 = qGray((grayImage.pixel(x+1,y+1)));
+    return qRgba(red, green, blue, alpha);
+}
 
+QImage Filter::warpTransform(const QImage &originalImage, const QTransform &transform, Sampling sampling, const QSize &resultSize)
+{
+    Trace::Scope scope("Filter::warpTransform", pixelCount(originalImage));
+    if(originalImage.isNull())
+        return QImage();
 
-            int pixelX = (sobelX[0][0] * xn1yn1) + (sobelX[0][1] * x0yn1) + (sobelX[0][2] * x1yn1) +
-                         (sobelX[1][0] * xn1y0)   + (sobelX[1][1] * x0y0)   + (sobelX[1][2] * x1y0) +
-                         (sobelX[2][0] * xn1y1) + (sobelX[2][1] * x0y1) + (sobelX[2][2] * x1y1);
+    QSize size = resultSize.isValid() ? resultSize : originalImage.size();
 
-            int pixelY = (sobelY[0][0] * xn1yn1) + (sobelY[0][1] * x0yn1) + (sobelY[0][2] * x1yn1) +
-                         (sobelY[1][0] * xn1y0)   + (sobelY[1][1] * x0y0)   + (sobelY[1][2] * x1y0) +
-                         (sobelY[2][0] * xn1y1) + (sobelY[2][1] * x0y1) + (sobelY[2][2] * x1y1);
+    QImage::Format resultFormat = resampleFormat(originalImage.format());
+    QImage resultImage = BufferPool::image(size.width(), size.height(), resultFormat);
+    resultImage.fill(Qt::black);
 
-            int pixel = qCeil(qSqrt(pixelX*pixelX + pixelY*pixelY));
+    bool invertible = false;
+    QTransform inverse = transform.inverted(&invertible);
+
+    if(invertible && !resultImage.isNull()) {
+        QImage sourceImage = originalImage.format() == resultFormat ? originalImage : originalImage.convertToFormat(resultFormat);
+        uchar* resultBits = resultImage.bits();
+        int resultStride = resultImage.bytesPerLine();
+        int resultWidth = resultImage.width();
+
+        Parallel::forEachBand(0, resultImage.height(), Parallel::bandHeight(resultStride), [&](int firstRow, int lastRow) {
+            if(inverse.isAffine())
+                warpAffineBand(sourceImage, inverse, sampling, resultBits, resultStride, resultWidth, firstRow, lastRow);
+            else
+                warpProjectiveBand(sourceImage, inverse, sampling, resultBits, resultStride, resultWidth, firstRow, lastRow);
+        });
+    }
 
-            if(pixel > 255)
-                pixel = 0;
+    if(resultFormat != originalImage.format())
+        return resultImage.convertToFormat(originalImage.format());
 
-            if(pixel < minThreshold || pixel > maxThreshold)
-                pixel = 0;
+    return resultImage;
+}
 
-            filteredImage.setPixel(x,y, qRgb(pixel, pixel, pixel));
-        }
+Filter::Warp::Warp()
+    : m_scaleX(1.0), m_scaleY(1.0)
+{
+}
 
-    return filteredImage;
+Filter::Warp &Filter::Warp::translate(double dx, double dy)
+{
+    return map(QTransform::fromTranslate(dx, dy));
 }
 
-QImage Filter::grayBlurFilter(const QImage &originalImage)
+Filter::Warp &Filter::Warp::scale(double sx, double sy)
 {
-    QImage grayImage = originalImage;
-    QImage filteredImage(originalImage.width(), originalImage.height(), QImage::Format_Grayscale8);
+    m_scaleX *= qAbs(sx);
+    m_scaleY *= qAbs(sy);
 
-    int width = grayImage.width();
-    int height = grayImage.height();
+    return map(QTransform::fromScale(sx, sy));
+}
 
-    for(int y = 1; y < height -2; ++y)
-        for(int x = 1; x < width -2; ++x) {
+Filter::Warp &Filter::Warp::shear(double sh, double sv)
+{
+    return map(QTransform().shear(sh, sv));
+}
 
-            int xn1yn1 = qGray((grayImage.pixel(x-1,y-1)));
-            int x0yn1 = qGray((grayImage.pixel(x,y-1)));
-            int x1yn1 = qGray((grayImage.pixel(x+1,y-1)));
-            int xn1y0 = qGray((grayImage.pixel(x-1,y)));
-            int x0y0 = qGray((grayImage.pixel(x,y)));
-            int x1y0 = qGray((grayImage.pixel(x+1,y)));
-            int xn1y1 = qGray((grayImage.pixel(x-1,y+1)));
-            int x0y1 = qGray((grayImage.pixel(x,y+1)));
-            int x1y1 = qGray((grayImage.pixel(x+1,y+1)));
+Filter::Warp &Filter::Warp::rotate(double degrees, const QPointF &center)
+{
+    return map(QTransform().translate(center.x(), center.y()).rotate(degrees).translate(-center.x(), -center.y()));
+}
 
-            int pixel = xn1yn1 +x0yn1 +x1yn1 +xn1y0 +x0y0 +x1y0 +xn1y1 + x0y1 + x1y1;
+Filter::Warp &Filter::Warp::map(const QTransform &transform)
+{
+    // QTransform composes row vector style, m_transform applies first
+    m_transform = m_transform * transform;
+    return *this;
+}
 
-            pixel/=9;
-            filteredImage.setPixel(x,y, qRgb(pixel, pixel, pixel));
-        }
+Filter::Warp &Filter::Warp::map(const Warp &warp)
+{
+    m_scaleX *= warp.m_scaleX;
+    m_scaleY *= warp.m_scaleY;
 
-    return filteredImage;
+    return map(warp.m_transform);
+}
 
+bool Filter::Warp::isIdentity() const
+{
+    return m_transform.isIdentity() && m_scaleX == 1.0 && m_scaleY == 1.0;
 }
 
-QImage Filter::prewittFilter(const QImage &originalImage, int minThreshold, int maxThreshold)
+const QTransform &Filter::Warp::transform() const
 {
-    QImage grayImage = originalImage;//.convertToFormat(QImage::Format_Grayscale8);
-    QImage filteredImage(originalImage.width(), originalImage.height(), QImage::Format_Grayscale8);
+    return m_transform;
+}
 
-    int prewittX[3][3]{{-1,0,1}, {-1,0,1}, {-1,0,1}};
-    int prewittY[3][3] = {{-1,-1,-1}, {0,0,0},{1,1,1}};
+QSize Filter::Warp::resultSize(const QSize &originalSize) const
+{
+    return QSize(qMax(1, qRound(originalSize.width() * m_scaleX)), qMax(1, qRound(originalSize.height() * m_scaleY)));
+}
 
-    int width = grayImage.width();
-    int height = grayImage.height();
+QImage Filter::Warp::apply(const QImage &originalImage, Sampling sampling) const
+{
+    return Filter::warpTransform(originalImage, m_transform, sampling, resultSize(originalImage.size()));
+}
 
-    for(int y = 1; y < height -2; ++y)
-        for(int x = 1; x < width -2; ++x) {
+QImage Filter::sobelFilter(const QImage &originalImage, int minThreshold, int maxThreshold)
+{
+    Trace::Scope scope("Filter::sobelFilter", pixelCount(originalImage));
+    //sobelX {{-1,0,1}, {-2,0,2}, {-1,0,1}}, sobelY {{-1,-2,-1}, {0,0,0},{1,2,1}}
+    return Convolution::convolve3x3(originalImage, Convolution::GradientKernel(2, minThreshold, maxThreshold));
+}
 
-            int xn1yn1 = qGray((grayImage.pixel(x-1,y-1)));
-            int x0yn1 = qGray((grayImage.pixel(x,y-1)));
-            int x1yn1 = qGray((grayImage.pixel(x+1,y-1)));
-            int xn1y0 = qGray((grayImage.pixel(x-1,y)));
-            int x0y0 = qGray((grayImage.pixel(x,y)));
-            int x1y0 = qGray((grayImage.pixel(x+1,y)));
-            int xn1y1 = qGray((grayImage.pixel(x-1,y+1)));
-            int x0y1 = qGray((grayImage.pixel(x,y+1)));
-            int x1y1 = qGray((grayImage.pixel(x+1,y+1)));
+QImage Filter::grayBlurFilter(const QImage &originalImage)
+{
+    Trace::Scope scope("Filter::grayBlurFilter", pixelCount(originalImage));
+    return Convolution::convolve3x3(originalImage, Convolution::BoxBlurKernel());
+}
 
+QImage Filter::boxBlurFilter(const QImage &originalImage, int radius)
+{
+    Trace::Scope scope("Filter::boxBlurFilter", pixelCount(originalImage));
+    return Separable::boxBlur(originalImage, std::vector<int>(1, qMax(0, radius)));
+}
+
+QImage Filter::gaussianBlurFilter(const QImage &originalImage, double sigma)
+{
+    Trace::Scope scope("Filter::gaussianBlurFilter", pixelCount(originalImage));
+    // three box passes are within a few percent of a true Gaussian
+    return Separable::boxBlur(originalImage, Separable::gaussianBoxRadii(sigma));
+}
 
-            int pixelX = (prewittX[0][0] * xn1yn1) + (prewittX[0][1] * x0yn1) + (prewittX[0][2] * x1yn1) +
-                         (prewittX[1][0] * xn1y0)   + (prewittX[1][1] * x0y0)   + (prewittX[1][2] * x1y0) +
-                         (prewittX[2][0] * xn1y1) + (prewittX[2][1] * x0y1) + (prewittX[2][2] * x1y1);
+QImage Filter::separableFilter(const QImage &originalImage, const QVector<double> &horizontalKernel, const QVector<double> &verticalKernel)
+{
+    Trace::Scope scope("Filter::separableFilter", pixelCount(originalImage));
+    return Separable::convolve(originalImage, horizontalKernel.toStdVector(), verticalKernel.toStdVector());
+}
 
-            int pixelY = (prewittY[0][0] * xn1yn1) + (prewittY[0][1] * x0yn1) + (prewittY[0][2] * x1yn1) +
-                         (prewittY[1][0] * xn1y0)   + (prewittY[1][1] * x0y0)   + (prewittY[1][2] * x1y0) +
-                         (prewittY[2][0] * xn1y1) + (prewittY[2][1] * x0y1) + (prewittY[2][2] * x1y1);
+/*
+ * Pixel (j, i) of the result is output(luminance, windowSum, windowArea) for the window of
+ * radius around it; the luminance is read back from the table as a 1x1 window.
+*/
+template <typename Output>
+static QImage integralWindowFilter(const QImage& originalImage, int radius, Output output)
+{
+    IntegralImage integral = IntegralImage::cached(originalImage);
+
+    if(integral.isNull())
+        return QImage();
+
+    int width = integral.width();
+    int height = integral.height();
+    size_t stride = static_cast<size_t>(width) + 1;
+    const quint64* sums = integral.sums();
+    radius = qMax(0, radius);
+
+    QImage resultImage = BufferPool::image(width, height, QImage::Format_Grayscale8);
+    uchar* resultBits = resultImage.bits();
+    int resultStride = resultImage.bytesPerLine();
+
+    Parallel::forEachBand(0, height, Parallel::bandHeight(static_cast<int>(stride * sizeof(quint64))), [&](int firstRow, int lastRow) {
+        for(int i = firstRow; i < lastRow; ++i) {
+            int top = qMax(0, i - radius);
+            int bottom = qMin(height, i + radius + 1);
+            const quint64* topRow = sums + top * stride;
+            const quint64* bottomRow = sums + bottom * stride;
+            const quint64* pixelTop = sums + i * stride;
+            const quint64* pixelBottom = pixelTop + stride;
+            uchar* resultLine = resultBits + i * resultStride;
+
+            for(int j = 0; j < width; ++j) {
+                int left = qMax(0, j - radius);
+                int right = qMin(width, j + radius + 1);
+
+                quint64 windowSum = bottomRow[right] - bottomRow[left] - topRow[right] + topRow[left];
+                int pixel = static_cast<int>(pixelBottom[j + 1] - pixelBottom[j] - pixelTop[j + 1] + pixelTop[j]);
+
+                resultLine[j] = output(pixel, windowSum, (bottom - top) * (right - left));
+            }
+        }
+    });
 
-            int pixel = qCeil(qSqrt(pixelX*pixelX + pixelY*pixelY));
+    return resultImage;
+}
 
-            if(pixel > 255)
-                pixel = 0;
+QImage Filter::localMeanFilter(const QImage &originalImage, int radius)
+{
+    Trace::Scope scope("Filter::localMeanFilter", pixelCount(originalImage));
+    return integralWindowFilter(originalImage, radius, [](int, quint64 windowSum, int area) {
+        return static_cast<uchar>((windowSum + static_cast<quint64>(area / 2)) / static_cast<quint64>(area));
+    });
+}
 
-            if(pixel < minThreshold || pixel > maxThreshold)
-                pixel = 0;
+QImage Filter::adaptiveThresholdFilter(const QImage &originalImage, int radius, int offset)
+{
+    Trace::Scope scope("Filter::adaptiveThresholdFilter", pixelCount(originalImage));
+    return integralWindowFilter(originalImage, radius, [offset](int pixel, quint64 windowSum, int area) {
+        // pixel > mean - offset without dividing
+        qint64 scaled = static_cast<qint64>(pixel + offset) * area;
+        return static_cast<uchar>(scaled > static_cast<qint64>(windowSum) ? 255 : 0);
+    });
+}
 
-            filteredImage.setPixel(x,y, qRgb(pixel, pixel, pixel));
-        }
-    return filteredImage;
+QImage Filter::prewittFilter(const QImage &originalImage, int minThreshold, int maxThreshold)
+{
+    Trace::Scope scope("Filter::prewittFilter", pixelCount(originalImage));
+    //prewittX {{-1,0,1}, {-1,0,1}, {-1,0,1}}, prewittY {{-1,-1,-1}, {0,0,0},{1,1,1}}
+    return Convolution::convolve3x3(originalImage, Convolution::GradientKernel(1, minThreshold, maxThreshold));
 }
 
-QImage Filter::lowPassFilter(const QImage &originalImage, double radius)
+QImage Filter::lowPassFilter(const QImage &originalImage, double radius, MaskShape shape, int order)
 {
-   return fourierPassFilter(originalImage, radius, 0, LOW_PASS);
+    Trace::Scope scope("Filter::lowPassFilter", pixelCount(originalImage));
+    return fourierPassFilter(originalImage, radius, 0, FrequencyMask::LowPass, shape, order);
 }
 
-QImage Filter::highPassFilter(const QImage &originalImage, double radius)
+QImage Filter::highPassFilter(const QImage &originalImage, double radius, MaskShape shape, int order)
 {
-    return fourierPassFilter(originalImage, radius, 0, HIGH_PASS);
+    Trace::Scope scope("Filter::highPassFilter", pixelCount(originalImage));
+    return fourierPassFilter(originalImage, radius, 0, FrequencyMask::HighPass, shape, order);
 }
 
-QImage Filter::bandPassFilter(const QImage &originalImage, double minRadius, double maxRadius)
+QImage Filter::bandPassFilter(const QImage &originalImage, double minRadius, double maxRadius, MaskShape shape, int order)
 {
-    return fourierPassFilter(originalImage, minRadius, maxRadius, BAND_PASS);
+    Trace::Scope scope("Filter::bandPassFilter", pixelCount(originalImage));
+    return fourierPassFilter(originalImage, minRadius, maxRadius, FrequencyMask::BandPass, shape, order);
 }
 
 QImage Filter::highPassFilterMagnitude(const QImage &originalImage, double radius)
 {
+    Trace::Scope scope("Filter::highPassFilterMagnitude", pixelCount(originalImage));
     QImage scaledImage = originalImage.scaled(256,256);
     int width = scaledImage.width();
     int height = scaledImage.height();
-    Complex** complex2dArray = convertQImageToCenteredComplex2dArray(scaledImage);
+    ComplexPlane plane;
+    bool isConverted;
+    {
+        Trace::Scope scope("Fourier: conversion");
+        isConverted = convertQImageToCenteredComplex2dArray(scaledImage, &plane);
+    }
 
-    FFT2D(complex2dArray, width, height, 1);
-    highPassFilter(complex2dArray, width, height, radius);
+    if(!isConverted)
+        return QImage();
 
-    QImage transformed = convertComplex2dArrayToMagnitudeImage(complex2dArray, width, height);
+    Complex** complex2dArray = plane.rows();
 
-    deleteComplex2dArray(complex2dArray);
+    {
+        Trace::Scope scope("Fourier: forward FFT2D");
+        FFT2D(complex2dArray, width, height, 1);
+    }
+    {
+        Trace::Scope scope("Fourier: masking");
+        highPassFilter(complex2dArray, width, height, radius);
+    }
 
-    return transformed;
+    Trace::Scope rescaleScope("Fourier: magnitude rescale");
+    return convertComplex2dArrayToMagnitudeImage(complex2dArray, width, height);
 }
@@ -2,17 +2,110 @@
 #define FILTER_H
 
 #include <QImage>
+#include <QTransform>
+#include <QVector>
 
 namespace Filter
 {
+// Worker threads used by every filter, 0 means one per core
+void setThreadCount(int threadCount);
+int threadCount();
+
+// Transform size of the Fourier filters: the image size, or each axis zero padded to the next power of two
+enum FourierPadding {
+    NoPadding,
+    ZeroPadToPowerOfTwo
+};
+void setFourierPadding(FourierPadding padding);
+FourierPadding fourierPadding();
+
+// The Fourier filters keep the forward spectra of the last two images they saw, drop them when the image changes
+void clearSpectrumCache();
+
 QImage crazyFilter(int filterParam, const QImage& originalImage);
 QImage sobelFilter(const QImage& originalImage, int minThreshold, int maxThreshold);
 QImage prewittFilter(const QImage& originalImage, int minThreshold, int maxThreshold);
 QImage rotationTransform(int angleDegrees, const QImage& originalImage, bool bilinearInterpolation = false);
+
+// Resampling of warpTransform()
+enum Sampling {
+    NearestSampling,
+    BilinearSampling,
+    BicubicSampling
+};
+
+/*
+ * Maps the image through an affine or projective transform (original pixel
+ * coordinates to result pixel coordinates) in a single resampling pass.
+ * Result pixels that fall outside the original are black, an invalid
+ * resultSize keeps the size of the original.
+*/
+QImage warpTransform(const QImage& originalImage, const QTransform& transform, Sampling sampling = BilinearSampling,
+                     const QSize& resultSize = QSize());
+
+/*
+ * Chain of geometric transforms composed into one matrix, so applying it
+ * resamples the image once however long the chain is. Each call acts on the
+ * result of the previous ones; scale() resizes the result along with it.
+*/
+class Warp
+{
+public:
+    Warp();
+
+    Warp& translate(double dx, double dy);
+    Warp& scale(double sx, double sy);
+    Warp& shear(double sh, double sv);
+    Warp& rotate(double degrees, const QPointF& center);
+    Warp& map(const QTransform& transform);
+    Warp& map(const Warp& warp);
+
+    bool isIdentity() const;
+    const QTransform& transform() const;
+    QSize resultSize(const QSize& originalSize) const;
+
+    QImage apply(const QImage& originalImage, Sampling sampling = BilinearSampling) const;
+
+private:
+    QTransform m_transform;
+    double m_scaleX;
+    double m_scaleY;
+};
+
 QImage grayBlurFilter(const QImage& originalImage);
-QImage lowPassFilter(const QImage& originalImage, double radius);
-QImage highPassFilter(const QImage& originalImage, double radius);
-QImage bandPassFilter(const QImage& originalImage, double minRadius, double maxRadius);
+
+/*
+ * Blurs of any size in the format of the original, each colour channel on its
+ * own. Their cost per pixel does not grow with radius or sigma.
+*/
+QImage boxBlurFilter(const QImage& originalImage, int radius);
+QImage gaussianBlurFilter(const QImage& originalImage, double sigma);
+
+// Horizontal then vertical pass with odd length kernels centered on their middle weight
+QImage separableFilter(const QImage& originalImage, const QVector<double>& horizontalKernel, const QVector<double>& verticalKernel);
+
+/*
+ * Grayscale8 results over the (2*radius+1)^2 window around each pixel, clipped
+ * to the image, read from the cached IntegralImage of the original: any radius
+ * costs four lookups per pixel. The adaptive threshold is white where the
+ * luminance is above the window mean minus offset, black elsewhere.
+*/
+QImage localMeanFilter(const QImage& originalImage, int radius);
+QImage adaptiveThresholdFilter(const QImage& originalImage, int radius, int offset);
+
+/*
+ * Fourier pass filters, radii are percentages of the corner frequency. Ideal
+ * masks cut at the radius and ring; Butterworth masks of the given order roll
+ * off to half gain at the radius, Gaussian masks use it as standard deviation.
+*/
+enum MaskShape {
+    IdealMask,
+    ButterworthMask,
+    GaussianMask
+};
+QImage lowPassFilter(const QImage& originalImage, double radius, MaskShape shape = IdealMask, int order = 2);
+QImage highPassFilter(const QImage& originalImage, double radius, MaskShape shape = IdealMask, int order = 2);
+QImage bandPassFilter(const QImage& originalImage, double minRadius, double maxRadius, MaskShape shape = IdealMask, int order = 2);
 QImage highPassFilterMagnitude(const QImage& originalImage, double radius);
 QRgb bilinearInterpolation(double x, double y, const QImage& originalImage);
 };
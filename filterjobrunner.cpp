@@ -0,0 +1,110 @@
+#include "filterjobrunner.h"
+#include <QMutexLocker>
+#include <QRunnable>
+#include "parallel.h"
+
+class FilterJobRunner::Worker : public QRunnable
+{
+public:
+    explicit Worker(FilterJobRunner* runner) : m_runner(runner) {}
+
+    void run() override
+    {
+        m_runner->work();
+    }
+
+private:
+    FilterJobRunner* m_runner;
+};
+
+FilterJobRunner::FilterJobRunner(QObject *parent) :
+    QObject(parent),
+    m_generation(0),
+    m_running(false)
+{
+    m_pool.setMaxThreadCount(1);
+    connect(this, &FilterJobRunner::jobDone, this, &FilterJobRunner::deliver, Qt::QueuedConnection);
+}
+
+FilterJobRunner::~FilterJobRunner()
+{
+    cancel();
+    m_pool.waitForDone();
+}
+
+void FilterJobRunner::submit(const Job &job)
+{
+    QMutexLocker locker(&m_mutex);
+
+    ++m_generation;
+    m_pendingJob = job;
+
+    if(m_cancelFlag)
+        m_cancelFlag->storeRelease(1);
+
+    if(!m_running) {
+        m_running = true;
+        m_pool.start(new Worker(this));
+    }
+}
+
+void FilterJobRunner::cancel()
+{
+    QMutexLocker locker(&m_mutex);
+
+    ++m_generation;
+    m_pendingJob = Job();
+
+    if(m_cancelFlag)
+        m_cancelFlag->storeRelease(1);
+}
+
+bool FilterJobRunner::isBusy() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_running;
+}
+
+void FilterJobRunner::deliver(quint64 generation, const QImage &result)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        if(generation != m_generation)
+            return;
+    }
+
+    emit finished(result);
+}
+
+void FilterJobRunner::work()
+{
+    for(;;) {
+        Job job;
+        quint64 generation;
+        std::shared_ptr<QAtomicInt> cancelFlag = std::make_shared<QAtomicInt>(0);
+
+        {
+            QMutexLocker locker(&m_mutex);
+
+            if(!m_pendingJob) {
+                m_running = false;
+                m_cancelFlag.reset();
+                return;
+            }
+
+            job = m_pendingJob;
+            m_pendingJob = Job();
+            generation = m_generation;
+            m_cancelFlag = cancelFlag;
+        }
+
+        QImage result;
+        {
+            Parallel::CancellationScope scope(cancelFlag.get());
+            result = job();
+        }
+
+        if(!cancelFlag->loadAcquire())
+            emit jobDone(generation, result);
+    }
+}
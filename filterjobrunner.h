@@ -0,0 +1,60 @@
+#ifndef FILTERJOBRUNNER_H
+#define FILTERJOBRUNNER_H
+
+#include <QAtomicInt>
+#include <QImage>
+#include <QMutex>
+#include <QObject>
+#include <QThreadPool>
+#include <functional>
+#include <memory>
+
+/*
+ * Runs filter jobs off the GUI thread, one at a time.
+ *
+ * Only the latest submitted job matters: submit() raises the cancellation flag
+ * of the running job (see Parallel::CancellationScope) and replaces the job
+ * still waiting, so a burst of slider or spin box events collapses into one
+ * run with the last value. finished() is emitted on the runner's thread with
+ * the result of the latest job only, stale results are dropped.
+*/
+class FilterJobRunner : public QObject
+{
+    Q_OBJECT
+
+public:
+    typedef std::function<QImage()> Job;
+
+    explicit FilterJobRunner(QObject *parent = nullptr);
+    ~FilterJobRunner();
+
+    void submit(const Job& job);
+
+    // Drops the waiting job and the result of the running one
+    void cancel();
+
+    bool isBusy() const;
+
+signals:
+    void finished(const QImage& result);
+
+    // internal, carries a result from the worker thread
+    void jobDone(quint64 generation, const QImage& result);
+
+private slots:
+    void deliver(quint64 generation, const QImage& result);
+
+private:
+    class Worker;
+
+    void work();
+
+    mutable QMutex m_mutex;
+    QThreadPool m_pool;
+    Job m_pendingJob;
+    quint64 m_generation;
+    bool m_running;
+    std::shared_ptr<QAtomicInt> m_cancelFlag;
+};
+
+#endif // FILTERJOBRUNNER_H
@@ -0,0 +1,229 @@
+#include "frequencymask.h"
+#include <QMutex>
+#include <QtMath>
+#include "fastfouriertransform.h"
+#include "parallel.h"
+#include "trace.h"
+
+// Smooth gains divide by the radius, a zero radius becomes a vanishingly small one
+static const double MinimumSmoothRadius = 1e-9;
+
+// exp(-s/2) sampled GaussianTableScale times per unit of s up to GaussianTableEnd, past it the gain is below e^-32
+static const int GaussianTableScale = 64;
+static const int GaussianTableEnd = 64;
+
+// Squared distances of the last transform size asked for
+struct DistanceCache {
+    QMutex mutex;
+    int width = 0;
+    int height = 0;
+    std::shared_ptr<const std::vector<float>> distances;
+};
+
+static DistanceCache& distanceCache()
+{
+    static DistanceCache cache;
+    return cache;
+}
+
+// Vertical frequency of spectrum row i, rows past the middle hold the negative frequencies
+static int spectrumRowFrequency(int i, int height)
+{
+    return i < height - height/2 ? i : i - height;
+}
+
+std::shared_ptr<const std::vector<float>> FrequencyMask::squaredDistances(int width, int height)
+{
+    DistanceCache& cache = distanceCache();
+
+    {
+        QMutexLocker locker(&cache.mutex);
+
+        if(cache.distances && cache.width == width && cache.height == height) {
+            Trace::cacheHits().add(1);
+            return cache.distances;
+        }
+    }
+
+    const int spectrumWidth = halfSpectrumWidth(width);
+    std::shared_ptr<std::vector<float>> distances = std::make_shared<std::vector<float>>(static_cast<size_t>(spectrumWidth) * height);
+    float* distancesData = distances->data();
+
+    Parallel::forEachBand(0, height, Parallel::bandHeight(spectrumWidth * static_cast<int>(sizeof(float))), [=](int firstRow, int lastRow) {
+        for(int i = firstRow; i < lastRow; ++i) {
+            double dv = static_cast<double>(spectrumRowFrequency(i, height)) / height;
+            float* row = distancesData + static_cast<size_t>(i) * spectrumWidth;
+
+            for(int u = 0; u < spectrumWidth; ++u) {
+                double du = static_cast<double>(u) / width;
+                row[u] = static_cast<float>(du*du + dv*dv);
+            }
+        }
+    });
+
+    // an interrupted table is incomplete and must not be cached
+    if(Parallel::isCancelled())
+        return distances;
+
+    QMutexLocker locker(&cache.mutex);
+    cache.width = width;
+    cache.height = height;
+    cache.distances = distances;
+
+    return distances;
+}
+
+static const float* gaussianTable()
+{
+    static const std::vector<float> table = [] {
+        std::vector<float> values(GaussianTableEnd * GaussianTableScale + 2);
+
+        for(size_t i = 0; i < values.size(); ++i)
+            values[i] = static_cast<float>(qExp(-0.5 * i / GaussianTableScale));
+
+        return values;
+    }();
+
+    return table.data();
+}
+
+/*
+ * Low pass responses as functions of s = d^2 / radius^2. The high pass of the same
+ * shape is 1 - response, the band pass the product of a high and a low pass.
+*/
+struct ButterworthResponse {
+    int order;
+
+    float operator()(float s) const
+    {
+        float power = s;
+        for(int k = 1; k < order; ++k)
+            power *= s;
+
+        return 1.0f / (1.0f + power);
+    }
+};
+
+struct GaussianResponse {
+    const float* table;
+
+    float operator()(float s) const
+    {
+        if(!(s < GaussianTableEnd))
+            return 0.0f;
+
+        float position = s * GaussianTableScale;
+        int index = static_cast<int>(position);
+        float fraction = position - index;
+
+        return table[index] + (table[index + 1] - table[index]) * fraction;
+    }
+};
+
+template <typename Response>
+struct LowGain {
+    Response response;
+    float scale;
+
+    float operator()(float distance) const { return response(distance * scale); }
+};
+
+template <typename Response>
+struct HighGain {
+    Response response;
+    float scale;
+
+    float operator()(float distance) const { return 1.0f - response(distance * scale); }
+};
+
+template <typename Response>
+struct BandGain {
+    Response response;
+    float minScale;
+    float maxScale;
+
+    float operator()(float distance) const { return (1.0f - response(distance * minScale)) * response(distance * maxScale); }
+};
+
+// The ideal masks keep d < radius, d >= radius and minRadius <= d <= maxRadius
+struct IdealLowGain {
+    float radius2;
+    float operator()(float distance) const { return distance < radius2 ? 1.0f : 0.0f; }
+};
+
+struct IdealHighGain {
+    float radius2;
+    float operator()(float distance) const { return distance >= radius2 ? 1.0f : 0.0f; }
+};
+
+struct IdealBandGain {
+    float minRadius2;
+    float maxRadius2;
+    float operator()(float distance) const { return distance >= minRadius2 && distance <= maxRadius2 ? 1.0f : 0.0f; }
+};
+
+template <typename Gain>
+static void applyGain(const Gain& gain, const float* distances, float* real, float* imag, int spectrumWidth, int height)
+{
+    Parallel::forEachBand(0, height, Parallel::bandHeight(spectrumWidth * 3 * static_cast<int>(sizeof(float))), [&](int firstRow, int lastRow) {
+        const size_t begin = static_cast<size_t>(firstRow) * spectrumWidth;
+        const size_t end = static_cast<size_t>(lastRow) * spectrumWidth;
+
+        for(size_t i = begin; i < end; ++i) {
+            float factor = gain(distances[i]);
+            real[i] *= factor;
+            imag[i] *= factor;
+        }
+    });
+}
+
+static float inverseSquare(double radius)
+{
+    radius = qMax(radius, MinimumSmoothRadius);
+    return static_cast<float>(1.0 / (radius * radius));
+}
+
+template <typename Response>
+static void applyResponse(const Response& response, const FrequencyMask::Mask& mask, const float* distances,
+                          float* real, float* imag, int spectrumWidth, int height)
+{
+    switch(mask.band) {
+    case FrequencyMask::LowPass:
+        applyGain(LowGain<Response>{ response, inverseSquare(mask.radius) }, distances, real, imag, spectrumWidth, height);
+        break;
+    case FrequencyMask::HighPass:
+        applyGain(HighGain<Response>{ response, inverseSquare(mask.radius) }, distances, real, imag, spectrumWidth, height);
+        break;
+    case FrequencyMask::BandPass:
+        applyGain(BandGain<Response>{ response, inverseSquare(mask.radius), inverseSquare(mask.maxRadius) },
+                  distances, real, imag, spectrumWidth, height);
+        break;
+    }
+}
+
+void FrequencyMask::apply(const Mask &mask, float *real, float *imag, int width, int height)
+{
+    std::shared_ptr<const std::vector<float>> distanceTable = squaredDistances(width, height);
+    const float* distances = distanceTable->data();
+    const int spectrumWidth = halfSpectrumWidth(width);
+
+    const float radius2 = static_cast<float>(mask.radius * mask.radius);
+    const float maxRadius2 = static_cast<float>(mask.maxRadius * mask.maxRadius);
+
+    switch(mask.shape) {
+    case Ideal:
+        if(mask.band == LowPass)
+            applyGain(IdealLowGain{ radius2 }, distances, real, imag, spectrumWidth, height);
+        else if(mask.band == HighPass)
+            applyGain(IdealHighGain{ radius2 }, distances, real, imag, spectrumWidth, height);
+        else
+            applyGain(IdealBandGain{ radius2, maxRadius2 }, distances, real, imag, spectrumWidth, height);
+        break;
+    case Butterworth:
+        applyResponse(ButterworthResponse{ qMax(1, mask.order) }, mask, distances, real, imag, spectrumWidth, height);
+        break;
+    case Gaussian:
+        applyResponse(GaussianResponse{ gaussianTable() }, mask, distances, real, imag, spectrumWidth, height);
+        break;
+    }
+}
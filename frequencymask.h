@@ -0,0 +1,48 @@
+#ifndef FREQUENCYMASK_H
+#define FREQUENCYMASK_H
+
+#include <memory>
+#include <vector>
+
+/*
+ * Radial masks for half spectra laid out as RealFFT2D() writes them, rows of
+ * halfSpectrumWidth(width) bins with the zero frequency at [0][0].
+ *
+ * The squared distance (u/width)^2 + (v/height)^2 of every bin, in cycles per
+ * pixel, is computed once per transform size and cached. A mask multiplies
+ * both planes by a gain read from that table in one parallel pass, so moving
+ * a radius costs no square root, and the smooth shapes no transcendental
+ * function either: Butterworth gains are rational in the squared distance and
+ * Gaussian gains come from a precomputed table.
+*/
+namespace FrequencyMask
+{
+enum Shape {
+    Ideal,
+    // 1 / (1 + (d/radius)^(2*order)), half gain at the radius
+    Butterworth,
+    // exp(-d^2 / (2*radius^2)), the radius is the standard deviation
+    Gaussian
+};
+
+enum Band {
+    LowPass,
+    HighPass,
+    // high pass at radius times low pass at maxRadius
+    BandPass
+};
+
+struct Mask {
+    Shape shape;
+    Band band;
+    double radius;
+    double maxRadius;
+    int order;
+};
+
+std::shared_ptr<const std::vector<float>> squaredDistances(int width, int height);
+
+void apply(const Mask& mask, float* real, float* imag, int width, int height);
+}
+
+#endif // FREQUENCYMASK_H
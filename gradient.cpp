@@ -0,0 +1,207 @@
+#include "gradient.h"
+#include <QtMath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GRADIENT_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+#define GRADIENT_AVX2
+#include <immintrin.h>
+#endif
+
+// ceil(sqrt(s)) > 255 exactly when s > 255^2
+static const int MaxMagnitudeSquared = 255 * 255;
+
+void Gradient::magnitudeRowScalar(const uchar *above, const uchar *center, const uchar *below, uchar *output,
+                                  int xBegin, int xEnd, int centerWeight, int minThreshold, int maxThreshold)
+{
+    for(int x = xBegin; x < xEnd; ++x) {
+        int pixelX = (above[x+1] - above[x-1]) + centerWeight * (center[x+1] - center[x-1]) + (below[x+1] - below[x-1]);
+        int pixelY = (below[x-1] - above[x-1]) + centerWeight * (below[x] - above[x]) + (below[x+1] - above[x+1]);
+
+        int pixel = qCeil(qSqrt(pixelX*pixelX + pixelY*pixelY));
+
+        if(pixel > 255)
+            pixel = 0;
+
+        if(pixel < minThreshold || pixel > maxThreshold)
+            pixel = 0;
+
+        output[x] = static_cast<uchar>(pixel);
+    }
+}
+
+#ifdef GRADIENT_SSE2
+
+/*
+ * Gx^2 + Gy^2 for four pixels -> thresholded ceil(sqrt()) as 32-bit lanes.
+ * Sums are below 2^21, so the float conversion is exact and the correctly
+ * rounded sqrtps never crosses an integer: truncation gives floor(sqrt(s)),
+ * and adding one where r*r < s gives the ceiling.
+*/
+static inline __m128i magnitudeSse2(__m128i gradients, __m128i minimum, __m128i maximum)
+{
+    const __m128i sum = _mm_madd_epi16(gradients, gradients);
+    __m128i root = _mm_cvttps_epi32(_mm_sqrt_ps(_mm_cvtepi32_ps(sum)));
+
+    // root < 2^11, so the high 16 bits are zero and madd yields root*root
+    root = _mm_sub_epi32(root, _mm_cmplt_epi32(_mm_madd_epi16(root, root), sum));
+
+    __m128i keep = _mm_cmplt_epi32(sum, _mm_set1_epi32(MaxMagnitudeSquared + 1));
+    keep = _mm_andnot_si128(_mm_cmplt_epi32(root, minimum), keep);
+    keep = _mm_andnot_si128(_mm_cmpgt_epi32(root, maximum), keep);
+
+    return _mm_and_si128(root, keep);
+}
+
+static inline __m128i gradientSse2(__m128i a0, __m128i a1, __m128i a2, __m128i c0, __m128i c2,
+                                   __m128i b0, __m128i b1, __m128i b2, bool doubleCenter,
+                                   __m128i minimum, __m128i maximum)
+{
+    __m128i centerX = _mm_subs_epi16(c2, c0);
+    __m128i centerY = _mm_subs_epi16(b1, a1);
+    if(doubleCenter) {
+        centerX = _mm_adds_epi16(centerX, centerX);
+        centerY = _mm_adds_epi16(centerY, centerY);
+    }
+
+    const __m128i gx = _mm_adds_epi16(_mm_adds_epi16(_mm_subs_epi16(a2, a0), _mm_subs_epi16(b2, b0)), centerX);
+    const __m128i gy = _mm_adds_epi16(_mm_adds_epi16(_mm_subs_epi16(b0, a0), _mm_subs_epi16(b2, a2)), centerY);
+
+    const __m128i low = magnitudeSse2(_mm_unpacklo_epi16(gx, gy), minimum, maximum);
+    const __m128i high = magnitudeSse2(_mm_unpackhi_epi16(gx, gy), minimum, maximum);
+
+    return _mm_packs_epi32(low, high);
+}
+
+static int magnitudeRowSse2(const uchar *above, const uchar *center, const uchar *below, uchar *output,
+                            int xBegin, int xEnd, bool doubleCenter, int minThreshold, int maxThreshold)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i minimum = _mm_set1_epi32(minThreshold);
+    const __m128i maximum = _mm_set1_epi32(maxThreshold);
+
+    int x = xBegin;
+
+    // the right taps read up to x+16, which is still inside the row while x+16 <= xEnd
+    for(; x + 16 <= xEnd; x += 16) {
+        const __m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(above + x - 1));
+        const __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(above + x));
+        const __m128i a2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(above + x + 1));
+        const __m128i c0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(center + x - 1));
+        const __m128i c2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(center + x + 1));
+        const __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(below + x - 1));
+        const __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(below + x));
+        const __m128i b2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(below + x + 1));
+
+        const __m128i low = gradientSse2(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(a2, zero),
+                                         _mm_unpacklo_epi8(c0, zero), _mm_unpacklo_epi8(c2, zero),
+                                         _mm_unpacklo_epi8(b0, zero), _mm_unpacklo_epi8(b1, zero), _mm_unpacklo_epi8(b2, zero),
+                                         doubleCenter, minimum, maximum);
+        const __m128i high = gradientSse2(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(a2, zero),
+                                          _mm_unpackhi_epi8(c0, zero), _mm_unpackhi_epi8(c2, zero),
+                                          _mm_unpackhi_epi8(b0, zero), _mm_unpackhi_epi8(b1, zero), _mm_unpackhi_epi8(b2, zero),
+                                          doubleCenter, minimum, maximum);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + x), _mm_packus_epi16(low, high));
+    }
+
+    return x;
+}
+
+#endif
+
+#ifdef GRADIENT_AVX2
+
+// Same as the SSE2 path on 256-bit registers; unpack/pack stay inside 128-bit lanes, so pixel order round-trips
+static inline __m256i magnitudeAvx2(__m256i gradients, __m256i minimum, __m256i maximum)
+{
+    const __m256i sum = _mm256_madd_epi16(gradients, gradients);
+    __m256i root = _mm256_cvttps_epi32(_mm256_sqrt_ps(_mm256_cvtepi32_ps(sum)));
+
+    root = _mm256_sub_epi32(root, _mm256_cmpgt_epi32(sum, _mm256_madd_epi16(root, root)));
+
+    __m256i keep = _mm256_cmpgt_epi32(_mm256_set1_epi32(MaxMagnitudeSquared + 1), sum);
+    keep = _mm256_andnot_si256(_mm256_cmpgt_epi32(minimum, root), keep);
+    keep = _mm256_andnot_si256(_mm256_cmpgt_epi32(root, maximum), keep);
+
+    return _mm256_and_si256(root, keep);
+}
+
+static inline __m256i gradientAvx2(__m256i a0, __m256i a1, __m256i a2, __m256i c0, __m256i c2,
+                                   __m256i b0, __m256i b1, __m256i b2, bool doubleCenter,
+                                   __m256i minimum, __m256i maximum)
+{
+    __m256i centerX = _mm256_subs_epi16(c2, c0);
+    __m256i centerY = _mm256_subs_epi16(b1, a1);
+    if(doubleCenter) {
+        centerX = _mm256_adds_epi16(centerX, centerX);
+        centerY = _mm256_adds_epi16(centerY, centerY);
+    }
+
+    const __m256i gx = _mm256_adds_epi16(_mm256_adds_epi16(_mm256_subs_epi16(a2, a0), _mm256_subs_epi16(b2, b0)), centerX);
+    const __m256i gy = _mm256_adds_epi16(_mm256_adds_epi16(_mm256_subs_epi16(b0, a0), _mm256_subs_epi16(b2, a2)), centerY);
+
+    const __m256i low = magnitudeAvx2(_mm256_unpacklo_epi16(gx, gy), minimum, maximum);
+    const __m256i high = magnitudeAvx2(_mm256_unpackhi_epi16(gx, gy), minimum, maximum);
+
+    return _mm256_packs_epi32(low, high);
+}
+
+static int magnitudeRowAvx2(const uchar *above, const uchar *center, const uchar *below, uchar *output,
+                            int xBegin, int xEnd, bool doubleCenter, int minThreshold, int maxThreshold)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i minimum = _mm256_set1_epi32(minThreshold);
+    const __m256i maximum = _mm256_set1_epi32(maxThreshold);
+
+    int x = xBegin;
+
+    for(; x + 32 <= xEnd; x += 32) {
+        const __m256i a0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(above + x - 1));
+        const __m256i a1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(above + x));
+        const __m256i a2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(above + x + 1));
+        const __m256i c0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(center + x - 1));
+        const __m256i c2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(center + x + 1));
+        const __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(below + x - 1));
+        const __m256i b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(below + x));
+        const __m256i b2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(below + x + 1));
+
+        const __m256i low = gradientAvx2(_mm256_unpacklo_epi8(a0, zero), _mm256_unpacklo_epi8(a1, zero), _mm256_unpacklo_epi8(a2, zero),
+                                         _mm256_unpacklo_epi8(c0, zero), _mm256_unpacklo_epi8(c2, zero),
+                                         _mm256_unpacklo_epi8(b0, zero), _mm256_unpacklo_epi8(b1, zero), _mm256_unpacklo_epi8(b2, zero),
+                                         doubleCenter, minimum, maximum);
+        const __m256i high = gradientAvx2(_mm256_unpackhi_epi8(a0, zero), _mm256_unpackhi_epi8(a1, zero), _mm256_unpackhi_epi8(a2, zero),
+                                          _mm256_unpackhi_epi8(c0, zero), _mm256_unpackhi_epi8(c2, zero),
+                                          _mm256_unpackhi_epi8(b0, zero), _mm256_unpackhi_epi8(b1, zero), _mm256_unpackhi_epi8(b2, zero),
+                                          doubleCenter, minimum, maximum);
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(output + x), _mm256_packus_epi16(low, high));
+    }
+
+    return x;
+}
+
+#endif
+
+void Gradient::magnitudeRow(const uchar *above, const uchar *center, const uchar *below, uchar *output,
+                            int xBegin, int xEnd, int centerWeight, int minThreshold, int maxThreshold)
+{
+    int x = xBegin;
+
+#if defined(GRADIENT_AVX2) || defined(GRADIENT_SSE2)
+    // the vector paths only know the Sobel and Prewitt weights
+    if(centerWeight == 1 || centerWeight == 2) {
+#ifdef GRADIENT_AVX2
+        x = magnitudeRowAvx2(above, center, below, output, x, xEnd, centerWeight == 2, minThreshold, maxThreshold);
+#endif
+#ifdef GRADIENT_SSE2
+        x = magnitudeRowSse2(above, center, below, output, x, xEnd, centerWeight == 2, minThreshold, maxThreshold);
+#endif
+    }
+#endif
+
+    magnitudeRowScalar(above, center, below, output, x, xEnd, centerWeight, minThreshold, maxThreshold);
+}
@@ -0,0 +1,26 @@
+#ifndef GRADIENT_H
+#define GRADIENT_H
+
+#include <QtGlobal>
+
+/*
+ * Row kernels for the Sobel/Prewitt gradient magnitude.
+ *
+ *   Gx = (above[x+1] - above[x-1]) + w * (center[x+1] - center[x-1]) + (below[x+1] - below[x-1])
+ *   Gy = (below[x-1] - above[x-1]) + w * (below[x]   - above[x])     + (below[x+1] - above[x+1])
+ *   output[x] = ceil(sqrt(Gx^2 + Gy^2)), or 0 when above 255 or outside [minThreshold, maxThreshold]
+ *
+ * w is 2 for Sobel and 1 for Prewitt. The SSE2 (16 pixels) and AVX2 (32 pixels)
+ * paths are bit-exact with the scalar one, which handles row tails and builds
+ * without SIMD support.
+*/
+namespace Gradient
+{
+void magnitudeRow(const uchar* above, const uchar* center, const uchar* below, uchar* output,
+                  int xBegin, int xEnd, int centerWeight, int minThreshold, int maxThreshold);
+
+void magnitudeRowScalar(const uchar* above, const uchar* center, const uchar* below, uchar* output,
+                        int xBegin, int xEnd, int centerWeight, int minThreshold, int maxThreshold);
+}
+
+#endif // GRADIENT_H
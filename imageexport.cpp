@@ -0,0 +1,349 @@
+#include "imageexport.h"
+#include <QAtomicInt>
+#include <QImageWriter>
+#include <QSaveFile>
+#include <QtEndian>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <zlib.h>
+#include "parallel.h"
+#include "rawimage.h"
+
+// Filtered bytes deflated per task, large enough that the restart of every strip costs next to nothing
+static const int StripBytes = 256 * 1024;
+// deflate window, the part of the previous strip a strip can refer back to
+static const int DictionaryBytes = 32 * 1024;
+
+enum PngFilter {
+    FilterNone,
+    FilterSub,
+    FilterUp,
+    FilterAverage,
+    FilterPaeth,
+    FilterCount
+};
+
+static inline int paeth(int left, int up, int upLeft)
+{
+    const int estimate = left + up - upLeft;
+    const int toLeft = std::abs(estimate - left);
+    const int toUp = std::abs(estimate - up);
+    const int toUpLeft = std::abs(estimate - upLeft);
+
+    if(toLeft <= toUp && toLeft <= toUpLeft)
+        return left;
+
+    return toUp <= toUpLeft ? up : upLeft;
+}
+
+static inline uchar filterByte(int filter, const uchar* row, const uchar* previous, int i, int bytesPerPixel)
+{
+    const int left = i >= bytesPerPixel ? row[i - bytesPerPixel] : 0;
+    const int upLeft = i >= bytesPerPixel ? previous[i - bytesPerPixel] : 0;
+
+    switch(filter) {
+    case FilterSub:
+        return static_cast<uchar>(row[i] - left);
+    case FilterUp:
+        return static_cast<uchar>(row[i] - previous[i]);
+    case FilterAverage:
+        return static_cast<uchar>(row[i] - ((left + previous[i]) >> 1));
+    case FilterPaeth:
+        return static_cast<uchar>(row[i] - paeth(left, previous[i], upLeft));
+    default:
+        return row[i];
+    }
+}
+
+/*
+ * Writes the filter type byte and the filtered row to output. Like libpng, every
+ * filter is tried and the one with the smallest sum of the bytes taken as signed
+ * values wins, that row usually deflates best; stored files skip the search.
+*/
+static void filterRow(const uchar* row, const uchar* previous, int rowBytes, int bytesPerPixel, int compression, uchar* output)
+{
+    int best = FilterNone;
+
+    if(compression > 0) {
+        quint64 bestSum = ~static_cast<quint64>(0);
+
+        for(int filter = FilterNone; filter < FilterCount; ++filter) {
+            quint64 sum = 0;
+            for(int i = 0; i < rowBytes && sum < bestSum; ++i)
+                sum += std::abs(static_cast<signed char>(filterByte(filter, row, previous, i, bytesPerPixel)));
+
+            if(sum < bestSum) {
+                bestSum = sum;
+                best = filter;
+            }
+        }
+    }
+
+    output[0] = static_cast<uchar>(best);
+    for(int i = 0; i < rowBytes; ++i)
+        output[i + 1] = filterByte(best, row, previous, i, bytesPerPixel);
+}
+
+// PNG byte order of a Grayscale8, RGB32 or ARGB32 scanline
+static void packRow(const uchar* line, QImage::Format format, int width, uchar* output)
+{
+    if(format == QImage::Format_Grayscale8) {
+        std::memcpy(output, line, static_cast<size_t>(width));
+        return;
+    }
+
+    const QRgb* pixels = reinterpret_cast<const QRgb*>(line);
+    const bool hasAlpha = format == QImage::Format_ARGB32;
+
+    for(int j = 0; j < width; ++j) {
+        const QRgb pixel = pixels[j];
+        *output++ = static_cast<uchar>(qRed(pixel));
+        *output++ = static_cast<uchar>(qGreen(pixel));
+        *output++ = static_cast<uchar>(qBlue(pixel));
+        if(hasAlpha)
+            *output++ = static_cast<uchar>(qAlpha(pixel));
+    }
+}
+
+static void appendChunk(QByteArray& file, const char* type, const uchar* data, int length, const uchar* tail = nullptr, int tailLength = 0)
+{
+    uchar header[8];
+    qToBigEndian<quint32>(static_cast<quint32>(length + tailLength), header);
+    std::memcpy(header + 4, type, 4);
+    file.append(reinterpret_cast<const char*>(header), sizeof(header));
+    file.append(reinterpret_cast<const char*>(data), length);
+    file.append(reinterpret_cast<const char*>(tail), tailLength);
+
+    // crc32() restarts on a null buffer
+    uLong crc = crc32(0, header + 4, 4);
+    if(length > 0)
+        crc = crc32(crc, data, static_cast<uInt>(length));
+    if(tailLength > 0)
+        crc = crc32(crc, tail, static_cast<uInt>(tailLength));
+
+    uchar trailer[4];
+    qToBigEndian<quint32>(static_cast<quint32>(crc), trailer);
+    file.append(reinterpret_cast<const char*>(trailer), sizeof(trailer));
+}
+
+// Raw deflate of [data + begin, data + end), ending in a sync flush, or the final block for the last strip
+static bool deflateStrip(const uchar* data, size_t begin, size_t end, bool isLast, int compression, QByteArray* output)
+{
+    z_stream stream;
+    std::memset(&stream, 0, sizeof(stream));
+
+    if(deflateInit2(&stream, compression, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return false;
+
+    const size_t dictionaryBytes = qMin(begin, static_cast<size_t>(DictionaryBytes));
+    if(dictionaryBytes > 0)
+        deflateSetDictionary(&stream, data + begin - dictionaryBytes, static_cast<uInt>(dictionaryBytes));
+
+    const uLong length = static_cast<uLong>(end - begin);
+    // the sync flush marker is not part of deflateBound()
+    output->resize(static_cast<int>(deflateBound(&stream, length)) + 16);
+
+    stream.next_in = const_cast<uchar*>(data + begin);
+    stream.avail_in = static_cast<uInt>(length);
+    stream.next_out = reinterpret_cast<uchar*>(output->data());
+    stream.avail_out = static_cast<uInt>(output->size());
+
+    const int status = deflate(&stream, isLast ? Z_FINISH : Z_SYNC_FLUSH);
+    const bool isDone = isLast ? status == Z_STREAM_END : status == Z_OK && stream.avail_in == 0 && stream.avail_out > 0;
+
+    output->resize(static_cast<int>(stream.total_out));
+    deflateEnd(&stream);
+    return isDone;
+}
+
+QString ImageExport::suffix(Format format)
+{
+    switch(format) {
+    case Jpeg:
+        return QStringLiteral("jpg");
+    case Bmp:
+        return QStringLiteral("bmp");
+    case Ppm:
+        return QStringLiteral("ppm");
+    case Raw:
+        return RawImage::suffix();
+    default:
+        return QStringLiteral("png");
+    }
+}
+
+bool ImageExport::formatForSuffix(const QString &suffix, Format *format)
+{
+    const QString name = suffix.toLower();
+
+    for(Format candidate : { Png, Jpeg, Bmp, Ppm, Raw }) {
+        if(name == ImageExport::suffix(candidate)) {
+            *format = candidate;
+            return true;
+        }
+    }
+
+    if(name == QLatin1String("jpeg")) {
+        *format = Jpeg;
+        return true;
+    }
+
+    return false;
+}
+
+QByteArray ImageExport::encodePng(const QImage &originalImage, int compression)
+{
+    if(originalImage.isNull())
+        return QByteArray();
+
+    QImage image = originalImage;
+
+    switch(image.format()) {
+    case QImage::Format_Grayscale8:
+    case QImage::Format_RGB32:
+    case QImage::Format_ARGB32:
+        break;
+    default:
+        image = image.convertToFormat(image.hasAlphaChannel() ? QImage::Format_ARGB32 : QImage::Format_RGB32);
+        break;
+    }
+
+    compression = qBound(0, compression, 9);
+
+    const int width = image.width();
+    const int height = image.height();
+    const QImage::Format format = image.format();
+    const int bytesPerPixel = format == QImage::Format_Grayscale8 ? 1 : format == QImage::Format_RGB32 ? 3 : 4;
+    const int rowBytes = width * bytesPerPixel;
+    const size_t filteredRowBytes = static_cast<size_t>(rowBytes) + 1;
+
+    // filtering needs the row above each row, so every band packs one row more than it filters
+    std::vector<uchar> filtered(filteredRowBytes * height);
+
+    Parallel::forEachBand(0, height, Parallel::bandHeight(rowBytes), [&](int firstRow, int lastRow) {
+        std::vector<uchar> rows(2 * static_cast<size_t>(rowBytes), 0);
+        uchar* previous = rows.data();
+        uchar* row = previous + rowBytes;
+
+        if(firstRow > 0)
+            packRow(image.constScanLine(firstRow - 1), format, width, previous);
+
+        for(int i = firstRow; i < lastRow; ++i) {
+            packRow(image.constScanLine(i), format, width, row);
+            filterRow(row, previous, rowBytes, bytesPerPixel, compression, filtered.data() + i * filteredRowBytes);
+            std::swap(row, previous);
+        }
+    });
+
+    const size_t total = filtered.size();
+    const int stripCount = static_cast<int>((total + StripBytes - 1) / StripBytes);
+    std::vector<QByteArray> strips(stripCount);
+    std::vector<uLong> checksums(stripCount);
+    QAtomicInt failed(0);
+
+    Parallel::forEachBand(0, stripCount, 1, [&](int firstStrip, int lastStrip) {
+        for(int strip = firstStrip; strip < lastStrip; ++strip) {
+            const size_t begin = static_cast<size_t>(strip) * StripBytes;
+            const size_t end = qMin(total, begin + StripBytes);
+
+            if(!deflateStrip(filtered.data(), begin, end, strip == stripCount - 1, compression, &strips[strip]))
+                failed.storeRelease(1);
+
+            checksums[strip] = adler32(adler32(0, nullptr, 0), filtered.data() + begin, static_cast<uInt>(end - begin));
+        }
+    });
+
+    if(failed.loadAcquire())
+        return QByteArray();
+
+    uLong adler = checksums[0];
+    for(int strip = 1; strip < stripCount; ++strip) {
+        const size_t begin = static_cast<size_t>(strip) * StripBytes;
+        adler = adler32_combine(adler, checksums[strip], static_cast<z_off_t>(qMin(total - begin, static_cast<size_t>(StripBytes))));
+    }
+
+    static const uchar Signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    // 32 KiB window, default compression, no dictionary
+    static const uchar ZlibHeader[2] = { 0x78, 0x9c };
+
+    QByteArray file;
+    file.append(reinterpret_cast<const char*>(Signature), sizeof(Signature));
+
+    uchar header[13];
+    qToBigEndian<quint32>(static_cast<quint32>(width), header);
+    qToBigEndian<quint32>(static_cast<quint32>(height), header + 4);
+    header[8] = 8;
+    header[9] = format == QImage::Format_Grayscale8 ? 0 : format == QImage::Format_RGB32 ? 2 : 6;
+    header[10] = 0;
+    header[11] = 0;
+    header[12] = 0;
+    appendChunk(file, "IHDR", header, sizeof(header));
+
+    // one IDAT per strip, the zlib header goes in front of the first and the checksum after the last
+    uchar checksum[4];
+    qToBigEndian<quint32>(static_cast<quint32>(adler), checksum);
+
+    for(int strip = 0; strip < stripCount; ++strip) {
+        QByteArray data = strips[strip];
+        if(strip == 0)
+            data.prepend(reinterpret_cast<const char*>(ZlibHeader), sizeof(ZlibHeader));
+
+        const bool isLast = strip == stripCount - 1;
+        appendChunk(file, "IDAT", reinterpret_cast<const uchar*>(data.constData()), data.size(),
+                    isLast ? checksum : nullptr, isLast ? sizeof(checksum) : 0);
+    }
+
+    appendChunk(file, "IEND", nullptr, 0);
+    return file;
+}
+
+bool ImageExport::save(const QImage &image, const QString &fileName, const Options &options, QString *errorMessage)
+{
+    if(image.isNull()) {
+        *errorMessage = QStringLiteral("%1: no image to save").arg(fileName);
+        return false;
+    }
+
+    if(options.format == Raw)
+        return RawImage::save(image, fileName, errorMessage);
+
+    QSaveFile file(fileName);
+
+    if(!file.open(QIODevice::WriteOnly)) {
+        *errorMessage = QStringLiteral("%1: %2").arg(fileName, file.errorString());
+        return false;
+    }
+
+    if(options.format == Png) {
+        const QByteArray data = encodePng(image, options.compression);
+
+        if(data.isEmpty()) {
+            *errorMessage = QStringLiteral("%1: PNG compression failed").arg(fileName);
+            return false;
+        }
+
+        if(file.write(data) != data.size()) {
+            *errorMessage = QStringLiteral("%1: %2").arg(fileName, file.errorString());
+            return false;
+        }
+    }
+    else {
+        QImageWriter writer(&file, suffix(options.format).toLatin1());
+        if(options.format == Jpeg)
+            writer.setQuality(qBound(0, options.quality, 100));
+
+        if(!writer.write(image)) {
+            *errorMessage = QStringLiteral("%1: %2").arg(fileName, writer.errorString());
+            return false;
+        }
+    }
+
+    if(!file.commit()) {
+        *errorMessage = QStringLiteral("%1: %2").arg(fileName, file.errorString());
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,49 @@
+#ifndef IMAGEEXPORT_H
+#define IMAGEEXPORT_H
+
+#include <QByteArray>
+#include <QImage>
+#include <QString>
+
+/*
+ * Writes result images in the formats the application offers, each with its
+ * own size/speed knob.
+ *
+ * PNG is encoded here rather than by Qt's plugin so large images compress on
+ * every core: the filtered rows are cut into strips that are deflated in
+ * parallel, each strip primed with the 32 KiB before it as its dictionary and
+ * ended with a sync flush, so the strips join into the single zlib stream a
+ * PNG needs and compress nearly as well as one sequential stream.
+*/
+namespace ImageExport
+{
+enum Format {
+    Png,
+    Jpeg,
+    Bmp,
+    Ppm,
+    Raw
+};
+
+struct Options {
+    Format format = Png;
+    // zlib level of PNG files, 0 stores the pixels and 9 compresses best but slowest
+    int compression = 6;
+    // JPEG quality, 0-100
+    int quality = 90;
+};
+
+// png, jpg, bmp, ppm or ifr
+QString suffix(Format format);
+
+// Format of a file name suffix (case insensitive, jpeg for jpg too), false when none matches
+bool formatForSuffix(const QString& suffix, Format* format);
+
+// Complete PNG file of image, an empty array if compression fails
+QByteArray encodePng(const QImage& image, int compression);
+
+// Replaces fileName only once the whole file is written
+bool save(const QImage& image, const QString& fileName, const Options& options, QString* errorMessage);
+}
+
+#endif // IMAGEEXPORT_H
@@ -0,0 +1,64 @@
+# Filter core shared by every ImageFilters target.
+
+# The following define makes your compiler emit warnings if you use
+# any feature of Qt which has been marked as deprecated (the exact warnings
+# depend on your compiler). Please consult the documentation of the
+# deprecated API in order to know how to port your code away from it.
+DEFINES += QT_DEPRECATED_WARNINGS
+
+# You can also make your code fail to compile if you use deprecated APIs.
+# In order to do so, uncomment the following line.
+# You can also select to disable deprecated APIs only up to a certain version of Qt.
+#DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
+
+CONFIG += c++11
+
+INCLUDEPATH += $$PWD
+DEPENDPATH += $$PWD
+
+SOURCES += \
+    $$PWD/bufferpool.cpp \
+    $$PWD/fastfouriertransform.cpp \
+    $$PWD/filter.cpp \
+    $$PWD/frequencymask.cpp \
+    $$PWD/gradient.cpp \
+    $$PWD/imageexport.cpp \
+    $$PWD/integralimage.cpp \
+    $$PWD/luminance.cpp \
+    $$PWD/parallel.cpp \
+    $$PWD/pipeline.cpp \
+    $$PWD/pointop.cpp \
+    $$PWD/rawimage.cpp \
+    $$PWD/resample.cpp \
+    $$PWD/separable.cpp \
+    $$PWD/streaming.cpp \
+    $$PWD/trace.cpp
+
+HEADERS += \
+    $$PWD/bufferpool.h \
+    $$PWD/convolution.h \
+    $$PWD/fastfouriertransform.h \
+    $$PWD/filter.h \
+    $$PWD/frequencymask.h \
+    $$PWD/gradient.h \
+    $$PWD/imageexport.h \
+    $$PWD/integralimage.h \
+    $$PWD/luminance.h \
+    $$PWD/parallel.h \
+    $$PWD/pipeline.h \
+    $$PWD/pointop.h \
+    $$PWD/rawimage.h \
+    $$PWD/resample.h \
+    $$PWD/separable.h \
+    $$PWD/streaming.h \
+    $$PWD/trace.h
+
+# zlib for the parallel PNG encoder of imageexport.cpp
+LIBS += -lz
+
+# "qmake CONFIG+=native_simd" lets the compiler use every SIMD extension of the
+# build machine, which enables the AVX2 kernels. SSE2 is always used on x86-64.
+native_simd {
+    gcc|clang: QMAKE_CXXFLAGS += -march=native
+    msvc: QMAKE_CXXFLAGS += -arch:AVX2
+}
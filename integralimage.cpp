@@ -0,0 +1,209 @@
+#include "integralimage.h"
+#include <QMutex>
+#include <vector>
+#include "luminance.h"
+#include "parallel.h"
+#include "trace.h"
+
+// Table columns per strip of the column prefix pass
+static const int PrefixStripColumns = 256;
+
+struct IntegralImage::Tables {
+    int width = 0;
+    int height = 0;
+    std::vector<quint64> sums;
+    std::vector<quint64> squareSums;
+};
+
+/*
+ * Tables of the last image passed to cached(), keyed on the image identity
+ * like the spectrum cache of the Fourier filters.
+*/
+struct IntegralCache {
+    QMutex mutex;
+    qint64 cacheKey = 0;
+    IntegralImage integral;
+};
+
+static IntegralCache& integralCache()
+{
+    static IntegralCache cache;
+    return cache;
+}
+
+IntegralImage::IntegralImage()
+{
+}
+
+IntegralImage::IntegralImage(const QImage &image)
+{
+    if(image.isNull())
+        return;
+
+    // the luminance plane the other gray filters share
+    const QImage source = Luminance::plane(image);
+    std::shared_ptr<Tables> tables = std::make_shared<Tables>();
+    const int width = source.width();
+    const int height = source.height();
+    const size_t stride = static_cast<size_t>(width) + 1;
+
+    tables->width = width;
+    tables->height = height;
+    tables->sums.assign(stride * (height + 1), 0);
+    tables->squareSums.assign(stride * (height + 1), 0);
+
+    quint64* sums = tables->sums.data();
+    quint64* squareSums = tables->squareSums.data();
+
+    // row prefix: table row i+1 holds the running sums of image row i
+    Parallel::forEachBand(0, height, Parallel::bandHeight(static_cast<int>(stride * 2 * sizeof(quint64))), [&](int firstRow, int lastRow) {
+        for(int i = firstRow; i < lastRow; ++i) {
+            const uchar* line = source.constScanLine(i);
+            quint64* sumRow = sums + (i + 1) * stride;
+            quint64* squareRow = squareSums + (i + 1) * stride;
+            quint64 sum = 0;
+            quint64 squareSum = 0;
+
+            for(int j = 0; j < width; ++j) {
+                const quint64 pixel = line[j];
+                sum += pixel;
+                squareSum += pixel * pixel;
+                sumRow[j + 1] = sum;
+                squareRow[j + 1] = squareSum;
+            }
+        }
+    });
+
+    // column prefix, every strip of columns walks all rows top to bottom
+    const int strips = static_cast<int>((stride + PrefixStripColumns - 1) / PrefixStripColumns);
+
+    Parallel::forEachBand(0, strips, 1, [&](int firstStrip, int lastStrip) {
+        const size_t begin = static_cast<size_t>(firstStrip) * PrefixStripColumns;
+        const size_t end = qMin(stride, static_cast<size_t>(lastStrip) * PrefixStripColumns);
+
+        for(int i = 2; i <= height; ++i) {
+            quint64* sumRow = sums + i * stride;
+            quint64* squareRow = squareSums + i * stride;
+
+            for(size_t j = begin; j < end; ++j) {
+                sumRow[j] += sumRow[j - stride];
+                squareRow[j] += squareRow[j - stride];
+            }
+        }
+    });
+
+    m_tables = tables;
+}
+
+IntegralImage IntegralImage::cached(const QImage &image)
+{
+    IntegralCache& cache = integralCache();
+    const qint64 cacheKey = image.cacheKey();
+
+    {
+        QMutexLocker locker(&cache.mutex);
+
+        if(!cache.integral.isNull() && cache.cacheKey == cacheKey) {
+            Trace::cacheHits().add(1);
+            return cache.integral;
+        }
+    }
+
+    IntegralImage integral(image);
+
+    // interrupted prefix passes leave the tables incomplete, they must not be cached
+    if(integral.isNull() || Parallel::isCancelled())
+        return integral;
+
+    QMutexLocker locker(&cache.mutex);
+    cache.cacheKey = cacheKey;
+    cache.integral = integral;
+
+    return integral;
+}
+
+void IntegralImage::clearCache()
+{
+    IntegralCache& cache = integralCache();
+    QMutexLocker locker(&cache.mutex);
+    cache.integral = IntegralImage();
+}
+
+bool IntegralImage::isNull() const
+{
+    return !m_tables;
+}
+
+int IntegralImage::width() const
+{
+    return m_tables ? m_tables->width : 0;
+}
+
+int IntegralImage::height() const
+{
+    return m_tables ? m_tables->height : 0;
+}
+
+// Sum of table over [left, right) x [top, bottom)
+static quint64 rectangleSum(const quint64* table, size_t stride, int left, int top, int right, int bottom)
+{
+    const quint64* topRow = table + top * stride;
+    const quint64* bottomRow = table + bottom * stride;
+
+    return bottomRow[right] - bottomRow[left] - topRow[right] + topRow[left];
+}
+
+quint64 IntegralImage::sum(const QRect &rect) const
+{
+    const QRect clipped = rect.intersected(QRect(0, 0, width(), height()));
+
+    if(clipped.isEmpty())
+        return 0;
+
+    return rectangleSum(m_tables->sums.data(), static_cast<size_t>(width()) + 1,
+                        clipped.left(), clipped.top(), clipped.right() + 1, clipped.bottom() + 1);
+}
+
+quint64 IntegralImage::squareSum(const QRect &rect) const
+{
+    const QRect clipped = rect.intersected(QRect(0, 0, width(), height()));
+
+    if(clipped.isEmpty())
+        return 0;
+
+    return rectangleSum(m_tables->squareSums.data(), static_cast<size_t>(width()) + 1,
+                        clipped.left(), clipped.top(), clipped.right() + 1, clipped.bottom() + 1);
+}
+
+int IntegralImage::area(const QRect &rect) const
+{
+    const QRect clipped = rect.intersected(QRect(0, 0, width(), height()));
+    return clipped.isEmpty() ? 0 : clipped.width() * clipped.height();
+}
+
+double IntegralImage::mean(const QRect &rect) const
+{
+    const int pixels = area(rect);
+    return pixels > 0 ? static_cast<double>(sum(rect)) / pixels : 0.0;
+}
+
+double IntegralImage::variance(const QRect &rect) const
+{
+    const int pixels = area(rect);
+
+    if(pixels == 0)
+        return 0.0;
+
+    const double average = static_cast<double>(sum(rect)) / pixels;
+    return qMax(0.0, static_cast<double>(squareSum(rect)) / pixels - average * average);
+}
+
+const quint64 *IntegralImage::sums() const
+{
+    return m_tables ? m_tables->sums.data() : nullptr;
+}
+
+const quint64 *IntegralImage::squareSums() const
+{
+    return m_tables ? m_tables->squareSums.data() : nullptr;
+}
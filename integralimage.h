@@ -0,0 +1,49 @@
+#ifndef INTEGRALIMAGE_H
+#define INTEGRALIMAGE_H
+
+#include <QImage>
+#include <QRect>
+#include <memory>
+
+/*
+ * Summed-area tables of the luminance of an image and of its square.
+ *
+ * Both tables have (width+1) x (height+1) 64-bit entries, entry (x, y) holds the
+ * sum over the pixels [0, x) x [0, y), so the sum over any rectangle takes four
+ * lookups whatever its size. Building them is a parallel row prefix pass
+ * followed by a parallel column prefix pass.
+ *
+ * Copies share the same tables.
+*/
+class IntegralImage
+{
+public:
+    IntegralImage();
+    explicit IntegralImage(const QImage& image);
+
+    // The tables of image, kept for the image last asked for so repeated filters build them once
+    static IntegralImage cached(const QImage& image);
+    static void clearCache();
+
+    bool isNull() const;
+    int width() const;
+    int height() const;
+
+    // Over the part of rect inside the image
+    quint64 sum(const QRect& rect) const;
+    quint64 squareSum(const QRect& rect) const;
+    int area(const QRect& rect) const;
+    double mean(const QRect& rect) const;
+    double variance(const QRect& rect) const;
+
+    // Raw tables, rows of width()+1 entries
+    const quint64* sums() const;
+    const quint64* squareSums() const;
+
+private:
+    struct Tables;
+
+    std::shared_ptr<const Tables> m_tables;
+};
+
+#endif // INTEGRALIMAGE_H
@@ -0,0 +1,144 @@
+#include "luminance.h"
+#include <QMutex>
+#include "bufferpool.h"
+#include "parallel.h"
+#include "trace.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LUMINANCE_SSE2
+#include <emmintrin.h>
+#endif
+
+/*
+ * Plane of the last image passed to plane(), keyed on the image identity
+ * like the integral image cache.
+*/
+struct LuminanceCache {
+    QMutex mutex;
+    qint64 cacheKey = 0;
+    QImage plane;
+};
+
+static LuminanceCache& luminanceCache()
+{
+    static LuminanceCache cache;
+    return cache;
+}
+
+#ifdef LUMINANCE_SSE2
+
+/*
+ * (r*11 + g*16 + b*5) / 32 of four pixels as 32-bit lanes. madd pairs blue with
+ * green and red with alpha (weight 0), the pairs fit in 16 bits, so a second
+ * madd with ones adds them up per pixel.
+*/
+static inline __m128i grayPixelsSse2(__m128i pixels)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i weights = _mm_set_epi16(0, 11, 16, 5, 0, 11, 16, 5);
+
+    const __m128i low = _mm_madd_epi16(_mm_unpacklo_epi8(pixels, zero), weights);
+    const __m128i high = _mm_madd_epi16(_mm_unpackhi_epi8(pixels, zero), weights);
+    const __m128i sums = _mm_madd_epi16(_mm_packs_epi32(low, high), _mm_set1_epi16(1));
+
+    return _mm_srli_epi32(sums, 5);
+}
+
+#endif
+
+void Luminance::convertRow(const QRgb *pixels, uchar *output, int count)
+{
+    int x = 0;
+
+#ifdef LUMINANCE_SSE2
+    const __m128i* input = reinterpret_cast<const __m128i*>(pixels);
+
+    for(; x + 16 <= count; x += 16, input += 4) {
+        const __m128i gray0 = grayPixelsSse2(_mm_loadu_si128(input));
+        const __m128i gray1 = grayPixelsSse2(_mm_loadu_si128(input + 1));
+        const __m128i gray2 = grayPixelsSse2(_mm_loadu_si128(input + 2));
+        const __m128i gray3 = grayPixelsSse2(_mm_loadu_si128(input + 3));
+
+        const __m128i gray = _mm_packus_epi16(_mm_packs_epi32(gray0, gray1), _mm_packs_epi32(gray2, gray3));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + x), gray);
+    }
+#endif
+
+    for(; x < count; ++x)
+        output[x] = static_cast<uchar>(qGray(pixels[x]));
+}
+
+QImage Luminance::convert(const QImage &image)
+{
+    QImage source = image;
+
+    switch(source.format()) {
+    case QImage::Format_Grayscale8:
+        return source;
+    case QImage::Format_RGB32:
+    case QImage::Format_ARGB32:
+        break;
+    default:
+        source = source.convertToFormat(QImage::Format_ARGB32);
+        break;
+    }
+
+    const int width = source.width();
+    const int height = source.height();
+
+    QImage gray = BufferPool::image(width, height, QImage::Format_Grayscale8);
+
+    if(gray.isNull())
+        return gray;
+
+    uchar* grayBits = gray.bits();
+    const int grayStride = gray.bytesPerLine();
+
+    Parallel::forEachBand(0, height, Parallel::bandHeight(source.bytesPerLine()), [&](int firstRow, int lastRow) {
+        for(int i = firstRow; i < lastRow; ++i)
+            convertRow(reinterpret_cast<const QRgb*>(source.constScanLine(i)), grayBits + i * grayStride, width);
+    });
+
+    return gray;
+}
+
+QImage Luminance::plane(const QImage &image)
+{
+    if(image.format() == QImage::Format_Grayscale8 || image.isNull())
+        return image;
+
+    LuminanceCache& cache = luminanceCache();
+    const qint64 cacheKey = image.cacheKey();
+
+    {
+        QMutexLocker locker(&cache.mutex);
+
+        if(!cache.plane.isNull() && cache.cacheKey == cacheKey) {
+            Trace::cacheHits().add(1);
+            return cache.plane;
+        }
+    }
+
+    QImage gray;
+    {
+        Trace::Scope scope("Luminance::plane");
+        gray = convert(image);
+    }
+
+    // an interrupted conversion leaves rows unwritten, it must not be cached
+    if(gray.isNull() || Parallel::isCancelled())
+        return gray;
+
+    QMutexLocker locker(&cache.mutex);
+    cache.cacheKey = cacheKey;
+    cache.plane = gray;
+
+    return gray;
+}
+
+void Luminance::clearCache()
+{
+    LuminanceCache& cache = luminanceCache();
+    QMutexLocker locker(&cache.mutex);
+    cache.plane = QImage();
+}
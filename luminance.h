@@ -0,0 +1,34 @@
+#ifndef LUMINANCE_H
+#define LUMINANCE_H
+
+#include <QImage>
+#include <QRgb>
+
+/*
+ * Luminance planes, qGray() of every pixel, for the filters that work on gray.
+ *
+ * Sobel, Prewitt, the gray blur, the integral image and the Fourier filters
+ * all start from the luminance of their input. plane() converts an image once
+ * and keeps the result for the image it was last asked for, keyed on the
+ * image identity like the spectrum and integral image caches, so switching
+ * between those filters on the same working image converts it once. An
+ * image that is modified gets a new cacheKey() and a fresh plane.
+ *
+ * Rows are converted 16 pixels at a time with SSE2, bit-exact with qGray().
+*/
+namespace Luminance
+{
+// qGray() of the first count pixels into output
+void convertRow(const QRgb* pixels, uchar* output, int count);
+
+// Uncached Grayscale8 luminance of image, gray images are returned as they are
+QImage convert(const QImage& image);
+
+// convert(), kept for the image last asked for
+QImage plane(const QImage& image);
+
+// Drops the kept plane, for when the working image is replaced
+void clearCache();
+}
+
+#endif // LUMINANCE_H
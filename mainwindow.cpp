@@ -7,12 +7,52 @@
 #include <QGraphicsPixmapItem>
 #include <QRgb>
 #include <QFileDialog>
+#include <QFileInfo>
+#include <QStatusBar>
+#include <QInputDialog>
+#include <QMutex>
+#include <QMutexLocker>
 #include "filter.h"
+#include "luminance.h"
+#include "rawimage.h"
+#include "trace.h"
 #include <QBuffer>
 
+class MainWindow::PreviewProxy
+{
+public:
+    PreviewProxy(const QImage& source, const QSize& size) : m_source(source), m_size(size) {}
+
+    // Scales the source on first use; later jobs wait for it and share the result, and with it the caches keyed on it
+    QImage image()
+    {
+        QMutexLocker locker(&m_mutex);
+
+        if(m_image.isNull() && !m_source.isNull()) {
+            Trace::Scope scope("MainWindow::PreviewProxy::image");
+
+            if(m_source.width() > m_size.width() || m_source.height() > m_size.height())
+                m_image = m_source.scaled(m_size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+            else
+                m_image = m_source;
+
+            m_source = QImage();
+        }
+
+        return m_image;
+    }
+
+private:
+    QMutex m_mutex;
+    QImage m_source;
+    QSize m_size;
+    QImage m_image;
+};
+
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
     ui(new Ui::MainWindow),
+    m_previewPending(false),
     m_useBilinearInterpolation(false),
     m_sobelMinThreshold(0),
     m_sobelMaxThreshold(255),
@@ -21,6 +61,14 @@ MainWindow::MainWindow(QWidget *parent) :
     m_fourierOp(NotSelected)
 {
     ui->setupUi(this);
+    // previews are smaller than the label, keep them in its visible corner
+    ui->label->setAlignment(Qt::AlignLeft | Qt::AlignTop);
+    m_filterJobs = new FilterJobRunner(this);
+    connect(m_filterJobs, &FilterJobRunner::finished, this, &MainWindow::showResult);
+    m_exports = new ExportQueue(this);
+    connect(m_exports, &ExportQueue::saved, this, &MainWindow::showSaved);
+    connect(m_exports, &ExportQueue::failed, this, &MainWindow::showSaveError);
+
     ui->radius2label->hide();
     ui->horizontalSlider_2->hide();
     this->showMaximized();
@@ -28,120 +76,276 @@ MainWindow::MainWindow(QWidget *parent) :
 
 MainWindow::~MainWindow()
 {
+    // the running job may still read the images, let it finish before they go away
+    delete m_filterJobs;
+    // pending saves are finished, not dropped
+    delete m_exports;
     delete ui;
+
+    // IMAGEFILTERS_TRACE=<file> keeps the session's trace for chrome://tracing
+    const QString traceFileName = QString::fromLocal8Bit(qgetenv("IMAGEFILTERS_TRACE"));
+    if(!traceFileName.isEmpty()) {
+        QString errorMessage;
+        if(!Trace::writeChromeTrace(traceFileName, &errorMessage))
+            qDebug() << errorMessage;
+        qDebug().noquote() << Trace::summary();
+    }
 }
 
-void MainWindow::crazyFilter()
+void MainWindow::runFilter(const FilterJobRunner::Job &job, bool preview)
 {
-    QImage image = ui->label->pixmap()->toImage();
+    statusBar()->showMessage(preview ? tr("Previewing...") : tr("Filtering..."));
+    // until the full resolution result is shown, m_resultImage is not what the user sees
+    ui->applyButton->setEnabled(false);
+    m_previewPending = preview;
+    m_filterJobs->submit(job);
+}
 
-    int width = image.width();
-    int height = image.height();
+void MainWindow::showImage(const QImage &image)
+{
+    m_resultImage = image;
+    ui->label->setPixmap(QPixmap::fromImage(image));
+    ui->label->show();
+    ui->applyButton->setEnabled(true);
+}
 
-    qDebug() << width;
-    qDebug() << height;
+void MainWindow::showResult(const QImage &image)
+{
+    Trace::Scope scope("MainWindow::showResult");
+    statusBar()->clearMessage();
+
+    // only the latest job reports back, so m_previewPending describes this result
+    if(m_previewPending) {
+        ui->label->setPixmap(QPixmap::fromImage(image));
+        ui->label->show();
+        return;
+    }
 
-    for(int i = 0; i < height; ++i)
-        for(int j = 0; j < width; ++j) {
+    showImage(image);
+}
 
-            if((j < width ) && (i < height)) {
-                QRgb color = image.pixel(j,i);
-                color/=7;
-                image.setPixel(j, i, color);
-            }
+void MainWindow::setSourceImage(const QImage &image)
+{
+    m_modifiedImage = image;
+    m_previewProxy.reset();
+    Filter::clearSpectrumCache();
+    Luminance::clearCache();
+}
 
+std::function<QImage()> MainWindow::jobSource(bool preview)
+{
+    if(!preview) {
+        QImage image = m_modifiedImage;
+        return [image]() { return image; };
+    }
 
-        }
+    if(!m_previewProxy) {
+        // the part of the label inside the window, a larger proxy would not show more
+        QSize visibleSize = ui->label->visibleRegion().boundingRect().size();
+        if(visibleSize.isEmpty())
+            visibleSize = ui->centralWidget->size();
 
-    ui->label->setPixmap(QPixmap::fromImage(image));
-    ui->label->show();
+        m_previewProxy = std::make_shared<PreviewProxy>(m_modifiedImage, visibleSize);
+    }
 
+    std::shared_ptr<PreviewProxy> proxy = m_previewProxy;
+    return [proxy]() { return proxy->image(); };
 }
 
-void MainWindow::on_anglelSlider_sliderMoved(int position)
+void MainWindow::runRotation(bool preview)
 {
-   QImage rotatedImage = Filter::rotationTransform(position, m_modifiedImage, m_useBilinearInterpolation);
+    std::function<QImage()> source = jobSource(preview);
+    int degrees = ui->anglelSlider->value();
+    bool bilinear = m_useBilinearInterpolation;
 
-    ui->label->setPixmap(QPixmap::fromImage(rotatedImage));
-    ui->label->show();
+    runFilter([=]() { return Filter::rotationTransform(degrees, source(), bilinear); }, preview);
+}
+
+void MainWindow::runFourierFilter(bool preview)
+{
+    std::function<QImage()> source = jobSource(preview);
+    int radius = ui->horizontalSlider->value();
+    int maxRadius = ui->horizontalSlider_2->value();
+
+    switch (m_fourierOp) {
+    case LowPass:
+        runFilter([=]() { return Filter::lowPassFilter(source(), 100 - radius); }, preview);
+        break;
+    case HighPass:
+        runFilter([=]() { return Filter::highPassFilter(source(), radius); }, preview);
+        break;
+    case BandPass:
+        runFilter([=]() { return Filter::bandPassFilter(source(), radius, maxRadius); }, preview);
+        break;
+    default:
+        break;
+    }
+}
+
+void MainWindow::crazyFilter()
+{
+    QImage image = m_resultImage;
+
+    runFilter([image]() mutable {
+        int width = image.width();
+        int height = image.height();
+
+        qDebug() << width;
+        qDebug() << height;
+
+        for(int i = 0; i < height; ++i)
+            for(int j = 0; j < width; ++j) {
+                QRgb color = image.pixel(j,i);
+                color/=7;
+                image.setPixel(j, i, color);
+            }
+
+        return image;
+    });
 }
 
 void MainWindow::on_checkBox_clicked(bool checked)
 {
+    Trace::Scope scope("MainWindow::on_checkBox_clicked");
     m_useBilinearInterpolation = checked;
 }
 
 
 void MainWindow::on_sobelFilterButton_clicked()
 {
-    ui->label->setPixmap(QPixmap::fromImage(Filter::sobelFilter(m_modifiedImage, m_sobelMinThreshold, m_sobelMaxThreshold)));
-    ui->label->show();
+    Trace::Scope scope("MainWindow::on_sobelFilterButton_clicked");
+    QImage image = m_modifiedImage;
+    int minThreshold = m_sobelMinThreshold;
+    int maxThreshold = m_sobelMaxThreshold;
 
+    runFilter([=]() { return Filter::sobelFilter(image, minThreshold, maxThreshold); });
 }
 
 void MainWindow::on_prewittButton_clicked()
 {
-    ui->label->setPixmap(QPixmap::fromImage(Filter::prewittFilter(m_modifiedImage, m_prewittMinThreshold, m_prewittMaxThreshold)));
-    ui->label->show();
+    Trace::Scope scope("MainWindow::on_prewittButton_clicked");
+    QImage image = m_modifiedImage;
+    int minThreshold = m_prewittMinThreshold;
+    int maxThreshold = m_prewittMaxThreshold;
+
+    runFilter([=]() { return Filter::prewittFilter(image, minThreshold, maxThreshold); });
 }
 
 void MainWindow::on_blurButton_clicked()
 {
-    ui->label->setPixmap(QPixmap::fromImage(Filter::grayBlurFilter(ui->label->pixmap()->toImage())));
-    ui->label->show();
+    Trace::Scope scope("MainWindow::on_blurButton_clicked");
+    QImage image = m_resultImage;
 
+    runFilter([=]() { return Filter::grayBlurFilter(image); });
 }
 
+// valueChanged also fires while dragging, then it only previews; the release renders the full image
 void MainWindow::on_anglelSlider_valueChanged(int value)
 {
-    on_anglelSlider_sliderMoved(value);
+    Trace::Scope scope("MainWindow::on_anglelSlider_valueChanged");
+    Q_UNUSED(value);
+    runRotation(ui->anglelSlider->isSliderDown());
 }
 
-void MainWindow::on_saveButton_clicked()
+void MainWindow::on_anglelSlider_sliderReleased()
 {
-    auto fileName = QFileDialog::getSaveFileName(this,
-        tr("Open Image"), "", tr("Image Files (*.png)"));
+    Trace::Scope scope("MainWindow::on_anglelSlider_sliderReleased");
+    runRotation(false);
+}
 
+void MainWindow::on_saveButton_clicked()
+{
+    static const ImageExport::Format formats[] = { ImageExport::Png, ImageExport::Jpeg, ImageExport::Bmp,
+                                                   ImageExport::Ppm, ImageExport::Raw };
+    const QStringList nameFilters = QStringList() << tr("PNG images (*.png)") << tr("JPEG images (*.jpg *.jpeg)")
+                                                  << tr("BMP images (*.bmp)") << tr("PPM images (*.ppm)")
+                                                  << tr("Raw images (*.ifr)");
+    QString selectedFilter = nameFilters.first();
+    QString fileName = QFileDialog::getSaveFileName(this, tr("Save Image"), "", nameFilters.join(";;"), &selectedFilter);
 
     if(fileName.isEmpty()) {
         qDebug() << "Filename is empty";
         return;
     }
 
-    QFile imageFile(fileName);
+    // the suffix decides the format, a file name without a known one gets that of the chosen filter
+    ImageExport::Options options = m_exportOptions;
+    if(!ImageExport::formatForSuffix(QFileInfo(fileName).suffix(), &options.format)) {
+        options.format = formats[qMax(0, nameFilters.indexOf(selectedFilter))];
+        fileName += QLatin1Char('.') + ImageExport::suffix(options.format);
+    }
+
+    bool isAccepted = true;
 
-    imageFile.open(QIODevice::WriteOnly);
-    QImage image = m_modifiedImage;
+    if(options.format == ImageExport::Png)
+        options.compression = QInputDialog::getInt(this, tr("Save Image"), tr("Compression level (0 fastest, 9 smallest):"),
+                                                   options.compression, 0, 9, 1, &isAccepted);
+    else if(options.format == ImageExport::Jpeg)
+        options.quality = QInputDialog::getInt(this, tr("Save Image"), tr("Quality (0-100):"),
+                                               options.quality, 0, 100, 1, &isAccepted);
+
+    if(!isAccepted)
+        return;
+
+    Trace::Scope scope("MainWindow::on_saveButton_clicked");
+    m_exportOptions = options;
+    statusBar()->showMessage(tr("Saving %1...").arg(fileName));
+    m_exports->save(m_modifiedImage, fileName, options);
+}
 
-    image.save(&imageFile, "PNG");
+void MainWindow::showSaved(const QString &fileName)
+{
+    Trace::Scope scope("MainWindow::showSaved");
+    statusBar()->showMessage(tr("Saved %1").arg(fileName), 5000);
+}
 
+void MainWindow::showSaveError(const QString &fileName, const QString &errorMessage)
+{
+    Trace::Scope scope("MainWindow::showSaveError");
+    Q_UNUSED(fileName);
+    statusBar()->showMessage(errorMessage);
 }
 
 void MainWindow::on_loadImageButton_clicked()
 {
-    QString fileName = QFileDialog::getOpenFileName(this, tr("Open Image"), "", tr("Image files (*.png)"));
+    QString fileName = QFileDialog::getOpenFileName(this, tr("Open Image"), "", tr("Image files (*.png *.ifr)"));
 
     if(fileName.isEmpty()) {
         qDebug() << "File is empty...";
         return;
     }
 
-    if(!m_originalImage.load(fileName)) {
+    Trace::Scope scope("MainWindow::on_loadImageButton_clicked");
+    // .ifr images are mapped, not decoded
+    QString errorMessage;
+    bool isLoaded;
+
+    if(RawImage::isRawImage(fileName)) {
+        m_originalImage = RawImage::load(fileName, &errorMessage);
+        isLoaded = !m_originalImage.isNull();
+    }
+    else {
+        isLoaded = m_originalImage.load(fileName);
+    }
+
+    if(!isLoaded) {
         qDebug() << "Failed on loading image. Exiting...";
         QCoreApplication::exit();
     }
 
-    m_modifiedImage = m_originalImage;
-    QPixmap img = QPixmap::fromImage(m_originalImage);
-    ui->imageWidget->resize(img.width(), img.height());
-    ui->label->setGeometry(0,0,img.width(), img.height());
-    ui->label->setPixmap(img);
+    m_filterJobs->cancel();
+    statusBar()->clearMessage();
+    setSourceImage(m_originalImage);
+    ui->imageWidget->resize(m_originalImage.width(), m_originalImage.height());
+    ui->label->setGeometry(0,0,m_originalImage.width(), m_originalImage.height());
+    showImage(m_originalImage);
     show();
 
 }
 
 void MainWindow::on_resetButton_clicked()
 {
+    Trace::Scope scope("MainWindow::on_resetButton_clicked");
 
     ui->anglelSlider->setValue(0);
     ui->horizontalSlider->setValue(0);
@@ -156,9 +360,11 @@ void MainWindow::on_resetButton_clicked()
     ui->sobelMaxSpinBox->setValue(m_sobelMaxThreshold);
     ui->prewittMinSpinBox->setValue(m_prewittMinThreshold);
     ui->prewittMaxSpinBox->setValue(m_prewittMaxThreshold);
-    m_modifiedImage = m_originalImage;
-    QPixmap img = QPixmap::fromImage(m_originalImage);
-    ui->label->setPixmap(img);
+    // the widget changes above queued filter runs of their own
+    m_filterJobs->cancel();
+    statusBar()->clearMessage();
+    setSourceImage(m_originalImage);
+    showImage(m_originalImage);
 
     show();
 
@@ -166,12 +372,14 @@ void MainWindow::on_resetButton_clicked()
 
 void MainWindow::on_sobelMinSpinBox_valueChanged(int arg1)
 {
+    Trace::Scope scope("MainWindow::on_sobelMinSpinBox_valueChanged");
     m_sobelMinThreshold = arg1;
     on_sobelFilterButton_clicked();
 }
 
 void MainWindow::on_sobelMaxSpinBox_valueChanged(int arg1)
 {
+    Trace::Scope scope("MainWindow::on_sobelMaxSpinBox_valueChanged");
     m_sobelMaxThreshold = arg1;
     on_sobelFilterButton_clicked();
 
@@ -179,6 +387,7 @@ void MainWindow::on_sobelMaxSpinBox_valueChanged(int arg1)
 
 void MainWindow::on_prewittMinSpinBox_valueChanged(int arg1)
 {
+    Trace::Scope scope("MainWindow::on_prewittMinSpinBox_valueChanged");
     m_prewittMinThreshold = arg1;
     on_prewittButton_clicked();
 
@@ -186,6 +395,7 @@ void MainWindow::on_prewittMinSpinBox_valueChanged(int arg1)
 
 void MainWindow::on_prewittMaxSpinBox_valueChanged(int arg1)
 {
+    Trace::Scope scope("MainWindow::on_prewittMaxSpinBox_valueChanged");
     m_prewittMaxThreshold = arg1;
     on_prewittButton_clicked();
 
@@ -193,59 +403,54 @@ void MainWindow::on_prewittMaxSpinBox_valueChanged(int arg1)
 
 void MainWindow::on_lowPassRadioButton_clicked()
 {
+    Trace::Scope scope("MainWindow::on_lowPassRadioButton_clicked");
     m_fourierOp = LowPass;
 }
 
 void MainWindow::on_highPassRadioButton_clicked()
 {
+    Trace::Scope scope("MainWindow::on_highPassRadioButton_clicked");
     m_fourierOp = HighPass;
 }
 
 void MainWindow::on_bandPassRadioButton_clicked()
 {
+    Trace::Scope scope("MainWindow::on_bandPassRadioButton_clicked");
     m_fourierOp = BandPass;
 }
 
+void MainWindow::on_horizontalSlider_valueChanged(int value)
+{
+    Trace::Scope scope("MainWindow::on_horizontalSlider_valueChanged");
+    Q_UNUSED(value);
+    runFourierFilter(ui->horizontalSlider->isSliderDown());
+}
+
 void MainWindow::on_horizontalSlider_sliderReleased()
 {
-    int position = ui->horizontalSlider->value();
+    Trace::Scope scope("MainWindow::on_horizontalSlider_sliderReleased");
+    runFourierFilter(false);
+}
 
-    switch (m_fourierOp) {
-    case LowPass:
-        ui->label->setPixmap(QPixmap::fromImage(Filter::lowPassFilter(m_modifiedImage, 100 - position)));
-        ui->label->show();
-        break;
-    case HighPass:
-        ui->label->setPixmap(QPixmap::fromImage(Filter::highPassFilter(m_modifiedImage, position)));
-        ui->label->show();
-        break;
-    case BandPass:
-        ui->label->setPixmap(QPixmap::fromImage(Filter::bandPassFilter(m_modifiedImage, position, ui->horizontalSlider_2->value())));
-        ui->label->show();
-        break;
-    default:
-        break;
+void MainWindow::on_horizontalSlider_2_valueChanged(int value)
+{
+    Trace::Scope scope("MainWindow::on_horizontalSlider_2_valueChanged");
+    Q_UNUSED(value);
 
-    }
+    if(m_fourierOp == BandPass)
+        runFourierFilter(ui->horizontalSlider_2->isSliderDown());
 }
 
 void MainWindow::on_horizontalSlider_2_sliderReleased()
 {
-    int position = ui->horizontalSlider_2->value();
-
-    switch (m_fourierOp) {
-    case BandPass:
-        ui->label->setPixmap(QPixmap::fromImage(Filter::bandPassFilter(m_modifiedImage, ui->horizontalSlider->value(), position)));
-        ui->label->show();
-        break;
-    default:
-        break;
-    }
-
+    Trace::Scope scope("MainWindow::on_horizontalSlider_2_sliderReleased");
+    if(m_fourierOp == BandPass)
+        runFourierFilter(false);
 }
 
 void MainWindow::on_bandPassRadioButton_toggled(bool checked)
 {
+    Trace::Scope scope("MainWindow::on_bandPassRadioButton_toggled");
     if(checked) {
         ui->radius1label->setText("MinRadius");
         ui->radius2label->show();
@@ -261,5 +466,8 @@ void MainWindow::on_bandPassRadioButton_toggled(bool checked)
 
 void MainWindow::on_applyButton_clicked()
 {
-    m_modifiedImage = ui->label->pixmap()->toImage();
+    Trace::Scope scope("MainWindow::on_applyButton_clicked");
+    // enabled only while m_resultImage is on screen and no job is outstanding, see runFilter()
+    statusBar()->clearMessage();
+    setSourceImage(m_resultImage);
 }
@@ -3,6 +3,10 @@
 
 #include <QMainWindow>
 #include <QImage>
+#include <functional>
+#include <memory>
+#include "exportqueue.h"
+#include "filterjobrunner.h"
 class QGraphicsScene;
 class QGraphicsView;
 class QGraphicsPixmapItem;
@@ -28,7 +32,11 @@ public:
     ~MainWindow();
 
 private slots:
-    void on_anglelSlider_sliderMoved(int position);
+    void showResult(const QImage& image);
+
+    void showSaved(const QString& fileName);
+
+    void showSaveError(const QString& fileName, const QString& errorMessage);
 
     void on_checkBox_clicked(bool checked);
 
@@ -40,6 +48,8 @@ private slots:
 
     void on_anglelSlider_valueChanged(int value);
 
+    void on_anglelSlider_sliderReleased();
+
     void on_saveButton_clicked();
 
     void on_loadImageButton_clicked();
@@ -60,8 +70,12 @@ private slots:
 
     void on_bandPassRadioButton_clicked();
 
+    void on_horizontalSlider_valueChanged(int value);
+
     void on_horizontalSlider_sliderReleased();
 
+    void on_horizontalSlider_2_valueChanged(int value);
+
     void on_horizontalSlider_2_sliderReleased();
 
     void on_bandPassRadioButton_toggled(bool checked);
@@ -69,12 +83,30 @@ private slots:
     void on_applyButton_clicked();
 
 private:
+    void runFilter(const FilterJobRunner::Job& job, bool preview = false);
+    void showImage(const QImage& image);
+    void setSourceImage(const QImage& image);
+    // The image a filter job runs on, read by the job itself so the proxy is built off the GUI thread
+    std::function<QImage()> jobSource(bool preview);
+    void runRotation(bool preview);
+    void runFourierFilter(bool preview);
+
     Ui::MainWindow *ui;
     QGraphicsScene* m_scene;
     QGraphicsView* m_view;
     QGraphicsPixmapItem* m_item;
     QImage m_originalImage;
     QImage m_modifiedImage;
+    // downscaled m_modifiedImage the filters run on while a slider is dragged, built by the first preview job
+    class PreviewProxy;
+    std::shared_ptr<PreviewProxy> m_previewProxy;
+    // the full resolution image shown in ui->label
+    QImage m_resultImage;
+    bool m_previewPending;
+    FilterJobRunner* m_filterJobs;
+    ExportQueue* m_exports;
+    // format, compression and quality of the last save, offered again by the next one
+    ImageExport::Options m_exportOptions;
     bool m_useBilinearInterpolation;
     int m_sobelMinThreshold;
     int m_sobelMaxThreshold;
@@ -0,0 +1,231 @@
+#include "parallel.h"
+#include <QAtomicInteger>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThread>
+#include <QThreadPool>
+#include <memory>
+#include <vector>
+
+namespace {
+
+const int CacheBytesPerBand = 256 * 1024;
+const int MinimumBandHeight = 8;
+
+QAtomicInt s_threadCount(0);
+
+thread_local const QAtomicInt* t_cancelFlag = nullptr;
+
+bool raised(const QAtomicInt* flag)
+{
+    return flag && flag->loadAcquire() != 0;
+}
+
+QThreadPool* filterThreadPool()
+{
+    // not the global pool: callers may themselves be running on it (imagefilters-cli jobs)
+    static QThreadPool pool;
+    return &pool;
+}
+
+/*
+ * A run of band indices [first, last) packed into one word so the owner
+ * (taking from the front) and thieves (taking from the back) can both claim
+ * bands with a single compare-and-swap.
+*/
+class BandRun
+{
+public:
+    void reset(int first, int last)
+    {
+        m_range.storeRelease(pack(first, last));
+    }
+
+    bool takeFront(int* band)
+    {
+        for(;;) {
+            quint64 range = m_range.loadAcquire();
+            int first = static_cast<int>(range >> 32);
+            int last = static_cast<int>(range & 0xFFFFFFFF);
+            if(first >= last)
+                return false;
+
+            if(m_range.testAndSetOrdered(range, pack(first + 1, last))) {
+                *band = first;
+                return true;
+            }
+        }
+    }
+
+    bool takeBack(int* band)
+    {
+        for(;;) {
+            quint64 range = m_range.loadAcquire();
+            int first = static_cast<int>(range >> 32);
+            int last = static_cast<int>(range & 0xFFFFFFFF);
+            if(first >= last)
+                return false;
+
+            if(m_range.testAndSetOrdered(range, pack(first, last - 1))) {
+                *band = last - 1;
+                return true;
+            }
+        }
+    }
+
+private:
+    static quint64 pack(int first, int last)
+    {
+        return (static_cast<quint64>(static_cast<quint32>(first)) << 32) | static_cast<quint32>(last);
+    }
+
+    QAtomicInteger<quint64> m_range;
+};
+
+class BandJob
+{
+public:
+    BandJob(int begin, int end, int grain, int participants, const std::function<void(int, int)>& body) :
+        m_begin(begin),
+        m_end(end),
+        m_grain(grain),
+        m_participants(participants),
+        m_runs(new BandRun[participants]),
+        m_body(body),
+        m_cancelFlag(t_cancelFlag)
+    {
+        int bandCount = (end - begin + grain - 1) / grain;
+
+        for(int i = 0; i < participants; ++i)
+            m_runs[i].reset(bandCount * i / participants, bandCount * (i + 1) / participants);
+    }
+
+    void work(int participant)
+    {
+        int band;
+
+        // a cancelled job still claims its remaining bands, it just does not run them
+        while(m_runs[participant].takeFront(&band))
+            runBand(band);
+
+        for(int offset = 1; offset < m_participants; ++offset) {
+            BandRun& victim = m_runs[(participant + offset) % m_participants];
+            while(victim.takeBack(&band))
+                runBand(band);
+        }
+    }
+
+    QSemaphore finished;
+
+private:
+    void runBand(int band)
+    {
+        if(raised(m_cancelFlag))
+            return;
+
+        int bandBegin = m_begin + band * m_grain;
+        m_body(bandBegin, qMin(bandBegin + m_grain, m_end));
+    }
+
+    int m_begin;
+    int m_end;
+    int m_grain;
+    int m_participants;
+    std::unique_ptr<BandRun[]> m_runs;
+    const std::function<void(int, int)>& m_body;
+    const QAtomicInt* m_cancelFlag;
+};
+
+class BandWorker : public QRunnable
+{
+public:
+    BandWorker(const std::shared_ptr<BandJob>& job, int participant) : m_job(job), m_participant(participant)
+    {
+        setAutoDelete(false);
+    }
+
+    void run() override
+    {
+        // the caller may destroy this worker as soon as finished is released, keep the job alive until we return
+        std::shared_ptr<BandJob> job = m_job;
+        job->work(m_participant);
+        job->finished.release();
+    }
+
+private:
+    std::shared_ptr<BandJob> m_job;
+    int m_participant;
+};
+
+}
+
+void Parallel::setThreadCount(int threadCount)
+{
+    s_threadCount.storeRelease(qMax(0, threadCount));
+    filterThreadPool()->setMaxThreadCount(Parallel::threadCount());
+}
+
+int Parallel::threadCount()
+{
+    int count = s_threadCount.loadAcquire();
+    return count > 0 ? count : qMax(1, QThread::idealThreadCount());
+}
+
+int Parallel::bandHeight(int bytesPerRow)
+{
+    return qMax(MinimumBandHeight, CacheBytesPerBand / qMax(1, bytesPerRow));
+}
+
+void Parallel::forEachBand(int begin, int end, int grain, const std::function<void(int, int)>& body)
+{
+    if(begin >= end)
+        return;
+
+    grain = qMax(1, grain);
+    int bandCount = (end - begin + grain - 1) / grain;
+    int participants = qMin(threadCount(), bandCount);
+
+    if(participants <= 1) {
+        for(int bandBegin = begin; bandBegin < end && !raised(t_cancelFlag); bandBegin += grain)
+            body(bandBegin, qMin(bandBegin + grain, end));
+        return;
+    }
+
+    QThreadPool* pool = filterThreadPool();
+    if(pool->maxThreadCount() != threadCount())
+        pool->setMaxThreadCount(threadCount());
+
+    std::shared_ptr<BandJob> job = std::make_shared<BandJob>(begin, end, grain, participants, body);
+
+    std::vector<std::unique_ptr<BandWorker>> workers;
+    for(int i = 1; i < participants; ++i) {
+        workers.emplace_back(new BandWorker(job, i));
+        pool->start(workers.back().get());
+    }
+
+    job->work(0);
+
+    // helpers that never got a thread have nothing left to do, all bands are claimed by now
+    int running = 0;
+    for(const std::unique_ptr<BandWorker>& worker : workers) {
+        if(!pool->tryTake(worker.get()))
+            ++running;
+    }
+
+    job->finished.acquire(running);
+}
+
+Parallel::CancellationScope::CancellationScope(const QAtomicInt *flag) : m_previous(t_cancelFlag)
+{
+    t_cancelFlag = flag;
+}
+
+Parallel::CancellationScope::~CancellationScope()
+{
+    t_cancelFlag = m_previous;
+}
+
+bool Parallel::isCancelled()
+{
+    return raised(t_cancelFlag);
+}
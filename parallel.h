@@ -0,0 +1,51 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <QAtomicInt>
+#include <functional>
+
+/*
+ * Row band scheduler shared by all Filter:: functions.
+ *
+ * An output image is split into horizontal bands of whole rows, sized so a band
+ * fits in cache (see bandHeight()). Each participating thread starts with its
+ * own contiguous run of bands and, once that is exhausted, steals bands from
+ * the back of the other runs, so uneven rows (clipped rotation spans, masked
+ * spectra) still keep every core busy. The calling thread always takes part.
+ *
+ * Neighbourhood filters read the halo rows around their band directly from the
+ * source image, which is never written while a band job runs.
+*/
+namespace Parallel
+{
+// 0 restores the default of one thread per core
+void setThreadCount(int threadCount);
+int threadCount();
+
+// Rows per band for images whose rows are bytesPerRow wide
+int bandHeight(int bytesPerRow);
+
+// Calls body(bandBegin, bandEnd) for consecutive bands of at most grain rows covering [begin, end)
+void forEachBand(int begin, int end, int grain, const std::function<void(int, int)>& body);
+
+/*
+ * Cooperative cancellation of the filter running on the current thread. While
+ * a scope is alive, forEachBand() calls made from this thread stop starting
+ * bands as soon as *flag is non zero. The interrupted filter returns an
+ * incomplete image, which whoever raised the flag must discard.
+*/
+class CancellationScope
+{
+public:
+    explicit CancellationScope(const QAtomicInt* flag);
+    ~CancellationScope();
+
+private:
+    const QAtomicInt* m_previous;
+};
+
+// True once the flag of the innermost CancellationScope of this thread is raised
+bool isCancelled();
+}
+
+#endif // PARALLEL_H
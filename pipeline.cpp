@@ -0,0 +1,546 @@
+#include "pipeline.h"
+#include <cstring>
+#include "bufferpool.h"
+#include "convolution.h"
+#include "luminance.h"
+#include "parallel.h"
+#include "separable.h"
+#include "trace.h"
+
+namespace {
+
+// One step of a fused pass on luminance rows
+struct GrayStage {
+    const std::vector<uchar>* table;
+    const std::function<void(const uchar*, const uchar*, const uchar*, uchar*, int, int)>* kernel;
+};
+
+/*
+ * Rows of every stage of a fused pass, computed on demand. Each level keeps the
+ * last three rows it produced, which is all a 3x3 kernel above it reads while
+ * the rows of a band are requested in increasing order. Level 0 is the
+ * luminance of the source, level k the output of stage k-1.
+*/
+class FusedRows
+{
+public:
+    FusedRows(const QImage& source, const Filter::PointOp* sourceOp, const std::vector<GrayStage>& stages) :
+        m_source(source),
+        m_sourceOp(sourceOp),
+        m_stages(stages),
+        m_width(source.width()),
+        m_height(source.height()),
+        m_storage(3 * (stages.size() + 1) * static_cast<size_t>(source.width())),
+        m_slots(3 * (stages.size() + 1))
+    {
+        for(size_t i = 0; i < m_slots.size(); ++i) {
+            m_slots[i].y = -1;
+            m_slots[i].storage = &m_storage[i * static_cast<size_t>(m_width)];
+            m_slots[i].data = m_slots[i].storage;
+        }
+    }
+
+    const uchar* row(int level, int y)
+    {
+        Slot& slot = m_slots[3 * static_cast<size_t>(level) + static_cast<size_t>(y % 3)];
+
+        if(slot.y != y) {
+            slot.y = y;
+            slot.data = level == 0 ? sourceRow(y, slot.storage) : stageRow(m_stages[level - 1], level, y, slot.storage);
+        }
+
+        return slot.data;
+    }
+
+private:
+    struct Slot {
+        int y;
+        const uchar* data;
+        uchar* storage;
+    };
+
+    const uchar* sourceRow(int y, uchar* output) const
+    {
+        const uchar* line = m_source.constScanLine(y);
+
+        if(m_source.format() == QImage::Format_Grayscale8) {
+            if(!m_sourceOp)
+                return line;
+
+            // the op of a gray source has equal colour tables
+            const uchar* table = m_sourceOp->table(Filter::PointOp::Red);
+            for(int x = 0; x < m_width; ++x)
+                output[x] = table[line[x]];
+            return output;
+        }
+
+        const QRgb* pixels = reinterpret_cast<const QRgb*>(line);
+
+        if(!m_sourceOp) {
+            Luminance::convertRow(pixels, output, m_width);
+            return output;
+        }
+
+        const uchar* red = m_sourceOp->table(Filter::PointOp::Red);
+        const uchar* green = m_sourceOp->table(Filter::PointOp::Green);
+        const uchar* blue = m_sourceOp->table(Filter::PointOp::Blue);
+        for(int x = 0; x < m_width; ++x)
+            output[x] = static_cast<uchar>(qGray(red[qRed(pixels[x])], green[qGreen(pixels[x])], blue[qBlue(pixels[x])]));
+        return output;
+    }
+
+    const uchar* stageRow(const GrayStage& stage, int level, int y, uchar* output)
+    {
+        if(stage.table) {
+            const uchar* input = row(level - 1, y);
+            const uchar* table = stage.table->data();
+
+            for(int x = 0; x < m_width; ++x)
+                output[x] = table[input[x]];
+            return output;
+        }
+
+        // convolve3x3() computes rows 1 <= y < height-2 and columns 1 <= x < width-2, the rest is black
+        if(y < 1 || y >= m_height - 2 || m_width < 4) {
+            std::memset(output, 0, static_cast<size_t>(m_width));
+            return output;
+        }
+
+        const uchar* above = row(level - 1, y - 1);
+        const uchar* center = row(level - 1, y);
+        const uchar* below = row(level - 1, y + 1);
+
+        output[0] = 0;
+        output[m_width - 2] = 0;
+        output[m_width - 1] = 0;
+        (*stage.kernel)(above, center, below, output, 1, m_width - 2);
+
+        return output;
+    }
+
+    const QImage& m_source;
+    const Filter::PointOp* m_sourceOp;
+    const std::vector<GrayStage>& m_stages;
+    int m_width;
+    int m_height;
+    std::vector<uchar> m_storage;
+    std::vector<Slot> m_slots;
+};
+
+// Rows [firstRow, firstRow + target->height()) of image into target, converted to its format
+void copyRows(const QImage& image, int firstRow, QImage* target)
+{
+    const QImage source = image.format() == target->format() ? image : image.convertToFormat(target->format());
+    const size_t rowBytes = (static_cast<size_t>(target->width()) * target->depth() + 7) / 8;
+
+    for(int i = 0; i < target->height(); ++i)
+        std::memcpy(target->scanLine(i), source.constScanLine(firstRow + i), rowBytes);
+}
+
+std::vector<uchar> composeTables(const std::vector<uchar>& first, const std::vector<uchar>& second)
+{
+    std::vector<uchar> table(256);
+
+    for(int value = 0; value < 256; ++value)
+        table[value] = second[first[value]];
+
+    return table;
+}
+
+// The table an op applies to Grayscale8 pixels
+std::vector<uchar> luminanceTable(const Filter::PointOp& op)
+{
+    std::vector<uchar> table(256);
+    op.luminanceTable(table.data());
+    return table;
+}
+
+}
+
+bool Filter::Pipeline::isFusable(NodeType type)
+{
+    return type == PointNode || type == NeighbourhoodNode;
+}
+
+Filter::Pipeline &Filter::Pipeline::append(const Node &node)
+{
+    m_nodes.push_back(node);
+    return *this;
+}
+
+Filter::Pipeline &Filter::Pipeline::pointOp(const PointOp &op)
+{
+    Node node;
+    node.type = PointNode;
+    node.op = op;
+    node.halo = 0;
+    return append(node);
+}
+
+Filter::Pipeline &Filter::Pipeline::crazyFilter(int filterParam)
+{
+    return pointOp(PointOp::offset(filterParam).then(PointOp::opaque()));
+}
+
+Filter::Pipeline &Filter::Pipeline::sobelFilter(int minThreshold, int maxThreshold)
+{
+    Node node;
+    node.type = NeighbourhoodNode;
+    // convolve3x3() leaves the first row and the last two rows black
+    node.halo = 2;
+    node.kernel = Convolution::GradientKernel(2, minThreshold, maxThreshold);
+    return append(node);
+}
+
+Filter::Pipeline &Filter::Pipeline::prewittFilter(int minThreshold, int maxThreshold)
+{
+    Node node;
+    node.type = NeighbourhoodNode;
+    node.halo = 2;
+    node.kernel = Convolution::GradientKernel(1, minThreshold, maxThreshold);
+    return append(node);
+}
+
+Filter::Pipeline &Filter::Pipeline::grayBlurFilter()
+{
+    Node node;
+    node.type = NeighbourhoodNode;
+    node.halo = 2;
+    node.kernel = Convolution::BoxBlurKernel();
+    return append(node);
+}
+
+Filter::Pipeline &Filter::Pipeline::boxBlurFilter(int radius)
+{
+    Node node;
+    node.type = ImageNode;
+    node.run = [radius](const QImage& image) { return Filter::boxBlurFilter(image, radius); };
+    node.halo = qMax(0, radius);
+    return append(node);
+}
+
+Filter::Pipeline &Filter::Pipeline::gaussianBlurFilter(double sigma)
+{
+    Node node;
+    node.type = ImageNode;
+    node.run = [sigma](const QImage& image) { return Filter::gaussianBlurFilter(image, sigma); };
+    node.halo = 0;
+    for(int radius : Separable::gaussianBoxRadii(sigma))
+        node.halo += radius;
+    return append(node);
+}
+
+Filter::Pipeline &Filter::Pipeline::localMeanFilter(int radius)
+{
+    Node node;
+    node.type = ImageNode;
+    node.run = [radius](const QImage& image) { return Filter::localMeanFilter(image, radius); };
+    node.halo = qMax(0, radius);
+    // the sum and square sum tables of the integral image
+    node.workBytes = 2 * static_cast<int>(sizeof(quint64));
+    return append(node);
+}
+
+Filter::Pipeline &Filter::Pipeline::adaptiveThresholdFilter(int radius, int offset)
+{
+    Node node;
+    node.type = ImageNode;
+    node.run = [radius, offset](const QImage& image) { return Filter::adaptiveThresholdFilter(image, radius, offset); };
+    node.halo = qMax(0, radius);
+    node.workBytes = 2 * static_cast<int>(sizeof(quint64));
+    return append(node);
+}
+
+Filter::Pipeline &Filter::Pipeline::rotationTransform(int angleDegrees, bool bilinearInterpolation)
+{
+    Node node;
+    node.type = ImageNode;
+    node.run = [angleDegrees, bilinearInterpolation](const QImage& image) {
+        return Filter::rotationTransform(angleDegrees, image, bilinearInterpolation);
+    };
+    return append(node);
+}
+
+Filter::Pipeline &Filter::Pipeline::warpTransform(const Warp &warp)
+{
+    Node node;
+    node.type = WarpNode;
+    node.warp = warp;
+    return append(node);
+}
+
+Filter::Pipeline &Filter::Pipeline::warpTransform(const Warp &warp, Sampling sampling)
+{
+    Node node;
+    node.type = WarpNode;
+    node.warp = warp;
+    node.hasSampling = true;
+    node.sampling = sampling;
+    return append(node);
+}
+
+Filter::Pipeline &Filter::Pipeline::lowPassFilter(double radius, MaskShape shape, int order)
+{
+    Node node;
+    node.type = ImageNode;
+    node.run = [radius, shape, order](const QImage& image) { return Filter::lowPassFilter(image, radius, shape, order); };
+    return append(node);
+}
+
+Filter::Pipeline &Filter::Pipeline::highPassFilter(double radius, MaskShape shape, int order)
+{
+    Node node;
+    node.type = ImageNode;
+    node.run = [radius, shape, order](const QImage& image) { return Filter::highPassFilter(image, radius, shape, order); };
+    return append(node);
+}
+
+Filter::Pipeline &Filter::Pipeline::bandPassFilter(double minRadius, double maxRadius, MaskShape shape, int order)
+{
+    Node node;
+    node.type = ImageNode;
+    node.run = [minRadius, maxRadius, shape, order](const QImage& image) {
+        return Filter::bandPassFilter(image, minRadius, maxRadius, shape, order);
+    };
+    return append(node);
+}
+
+Filter::Pipeline &Filter::Pipeline::highPassFilterMagnitude(double radius)
+{
+    Node node;
+    node.type = ImageNode;
+    node.run = [radius](const QImage& image) { return Filter::highPassFilterMagnitude(image, radius); };
+    return append(node);
+}
+
+bool Filter::Pipeline::isEmpty() const
+{
+    return m_nodes.empty();
+}
+
+// One past the last node of the pass starting at first
+int Filter::Pipeline::passEnd(int first) const
+{
+    const int count = static_cast<int>(m_nodes.size());
+    NodeType type = m_nodes[first].type;
+    int last = first + 1;
+
+    if(isFusable(type)) {
+        while(last < count && isFusable(m_nodes[last].type))
+            ++last;
+    }
+    else if(type == WarpNode) {
+        while(last < count && m_nodes[last].type == WarpNode)
+            ++last;
+    }
+
+    return last;
+}
+
+int Filter::Pipeline::passCount() const
+{
+    int passes = 0;
+
+    for(int first = 0; first < static_cast<int>(m_nodes.size()); first = passEnd(first))
+        ++passes;
+
+    return passes;
+}
+
+int Filter::Pipeline::halo() const
+{
+    int rows = 0;
+
+    for(const Node& node : m_nodes) {
+        if(node.halo < 0)
+            return -1;
+        rows += node.halo;
+    }
+
+    return rows;
+}
+
+int Filter::Pipeline::peakBytesPerPixel(int bytesPerPixel) const
+{
+    int workBytes = 0;
+
+    for(const Node& node : m_nodes)
+        workBytes = qMax(workBytes, node.workBytes);
+
+    // the input, the result of the previous pass, one intermediate image and the output
+    return 4 * bytesPerPixel + workBytes;
+}
+
+QImage Filter::Pipeline::apply(const QImage &originalImage) const
+{
+    // the pixels are counted by the filters of the steps
+    Trace::Scope scope("Filter::Pipeline::apply");
+    return applyPasses(originalImage, 0, static_cast<int>(m_nodes.size()));
+}
+
+bool Filter::Pipeline::apply(const QImage &originalImage, int firstRow, QImage *target) const
+{
+    Trace::Scope scope("Filter::Pipeline::apply");
+    const int count = static_cast<int>(m_nodes.size());
+
+    if(originalImage.isNull())
+        return false;
+
+    if(count == 0) {
+        copyRows(originalImage, firstRow, target);
+        return true;
+    }
+
+    // every pass but the last one produces a whole image
+    int lastPass = 0;
+    for(int first = 0; first < count; first = passEnd(first))
+        lastPass = first;
+
+    const QImage image = applyPasses(originalImage, 0, lastPass);
+
+    if(image.isNull())
+        return false;
+
+    if(isFusable(m_nodes[lastPass].type)) {
+        fusedPass(image, lastPass, count, firstRow, target->height(), target);
+        return true;
+    }
+
+    const QImage result = applyPasses(image, lastPass, count);
+
+    if(result.isNull())
+        return false;
+
+    copyRows(result, firstRow, target);
+    return true;
+}
+
+// Runs the nodes [first, last), first and last on pass boundaries
+QImage Filter::Pipeline::applyPasses(const QImage &originalImage, int first, int last) const
+{
+    QImage image = originalImage;
+
+    while(first < last) {
+        const int end = passEnd(first);
+        const Node& node = m_nodes[first];
+
+        if(isFusable(node.type)) {
+            image = fusedPass(image, first, end, 0, image.height(), nullptr);
+        }
+        else if(node.type == WarpNode) {
+            Warp warp;
+            Sampling sampling = BilinearSampling;
+            for(int i = first; i < end; ++i) {
+                warp.map(m_nodes[i].warp);
+                if(m_nodes[i].hasSampling)
+                    sampling = m_nodes[i].sampling;
+            }
+            image = warp.apply(image, sampling);
+        }
+        else {
+            image = node.run(image);
+        }
+
+        first = end;
+    }
+
+    return image;
+}
+
+/*
+ * Point steps in front of the first neighbourhood step work on the colour
+ * channels, as crazyFilter() does; from the first neighbourhood step on the
+ * pass works on Grayscale8 luminance rows, as convolve3x3() does.
+ *
+ * Computes rows [firstRow, firstRow + rowCount) of the result. With a target
+ * they are written into it and the return value is only the image they were
+ * computed in, which is target itself for Grayscale8 targets.
+*/
+QImage Filter::Pipeline::fusedPass(const QImage &originalImage, int first, int last, int firstRow, int rowCount, QImage *target) const
+{
+    QImage image = originalImage;
+
+    switch(image.format()) {
+    case QImage::Format_Grayscale8:
+    case QImage::Format_RGB32:
+    case QImage::Format_ARGB32:
+        break;
+    default:
+        image = image.convertToFormat(QImage::Format_ARGB32);
+        break;
+    }
+
+    const int width = image.width();
+    const bool isGray = image.format() == QImage::Format_Grayscale8;
+
+    // fused steps bypass the filter entry points, so the pass counts its own rows
+    Trace::Scope scope("Filter::Pipeline::fusedPass", static_cast<qint64>(width) * rowCount);
+
+    // consecutive point steps collapse into one op, on gray sources into their luminance tables
+    PointOp sourceOp;
+    int next = first;
+
+    for(; next < last && m_nodes[next].type == PointNode; ++next) {
+        const PointOp& op = m_nodes[next].op;
+        sourceOp = isGray ? sourceOp.then(PointOp::fromTable(luminanceTable(op).data())) : sourceOp.then(op);
+    }
+
+    if(next == last) {
+        const QImage result = sourceOp.apply(originalImage);
+        if(target)
+            copyRows(result, firstRow, target);
+        return result;
+    }
+
+    // luminance stages, with the tables of consecutive point steps composed as well
+    std::vector<std::vector<uchar>> tables;
+    tables.reserve(static_cast<size_t>(last - next));
+    std::vector<GrayStage> stages;
+
+    for(int i = next; i < last; ++i) {
+        const Node& node = m_nodes[i];
+
+        if(node.type == NeighbourhoodNode) {
+            GrayStage stage = { nullptr, &node.kernel };
+            stages.push_back(stage);
+        }
+        else if(!stages.empty() && stages.back().table) {
+            tables.back() = composeTables(tables.back(), luminanceTable(node.op));
+        }
+        else {
+            tables.push_back(luminanceTable(node.op));
+            GrayStage stage = { &tables.back(), nullptr };
+            stages.push_back(stage);
+        }
+    }
+
+    // a copy of target would share its pixels and make bits() detach, it is written through the pointer
+    const bool isInPlace = target && target->format() == QImage::Format_Grayscale8;
+    QImage resultImage = isInPlace ? QImage() : BufferPool::image(width, rowCount, QImage::Format_Grayscale8);
+    uchar* resultBits = isInPlace ? target->bits() : resultImage.bits();
+    const int resultStride = isInPlace ? target->bytesPerLine() : resultImage.bytesPerLine();
+    const int outputLevel = static_cast<int>(stages.size());
+    const PointOp* source = sourceOp.isIdentity() ? nullptr : &sourceOp;
+
+    /*
+     * Every band primes its own windows with the halo rows it needs, so bands are independent.
+     * The windows stay in cache whatever the band height; taller bands only cut the share of
+     * halo rows each level computes twice.
+    */
+    const int grain = qMax(Parallel::bandHeight(width), 8 * outputLevel);
+
+    Parallel::forEachBand(firstRow, firstRow + rowCount, grain, [&](int bandFirstRow, int bandLastRow) {
+        FusedRows rows(image, source, stages);
+
+        for(int i = bandFirstRow; i < bandLastRow; ++i)
+            std::memcpy(resultBits + (i - firstRow) * resultStride, rows.row(outputLevel, i), static_cast<size_t>(width));
+    });
+
+    if(isInPlace)
+        return *target;
+
+    if(target)
+        copyRows(resultImage, 0, target);
+
+    return resultImage;
+}
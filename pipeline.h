@@ -0,0 +1,112 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <QImage>
+#include <functional>
+#include <vector>
+#include "filter.h"
+#include "pointop.h"
+
+namespace Filter
+{
+/*
+ * A chain of filters declared up front and run in as few passes as possible.
+ *
+ * Consecutive point (PointOp, crazy) and 3x3 neighbourhood (blur, Sobel, Prewitt) steps
+ * are fused into one pass over row bands: each band streams through all of
+ * them with a window of three rows per step, so none of their intermediate
+ * images is ever allocated, and the result is the same as calling the filters
+ * one after the other. Adjacent warps are composed into one resample (see
+ * Warp), using the last sampling given among them. Rotation, the large blurs, the
+ * window filters and the Fourier filters need their whole input, so they run
+ * on their own between fused passes.
+*/
+class Pipeline
+{
+public:
+    Pipeline& pointOp(const PointOp& op);
+    Pipeline& crazyFilter(int filterParam);
+    Pipeline& sobelFilter(int minThreshold, int maxThreshold);
+    Pipeline& prewittFilter(int minThreshold, int maxThreshold);
+    Pipeline& grayBlurFilter();
+    Pipeline& boxBlurFilter(int radius);
+    Pipeline& gaussianBlurFilter(double sigma);
+    Pipeline& localMeanFilter(int radius);
+    Pipeline& adaptiveThresholdFilter(int radius, int offset);
+    Pipeline& rotationTransform(int angleDegrees, bool bilinearInterpolation = false);
+    // without a sampling the warp takes the one of the warps it is composed with
+    Pipeline& warpTransform(const Warp& warp);
+    Pipeline& warpTransform(const Warp& warp, Sampling sampling);
+    Pipeline& lowPassFilter(double radius, MaskShape shape = IdealMask, int order = 2);
+    Pipeline& highPassFilter(double radius, MaskShape shape = IdealMask, int order = 2);
+    Pipeline& bandPassFilter(double minRadius, double maxRadius, MaskShape shape = IdealMask, int order = 2);
+    Pipeline& highPassFilterMagnitude(double radius);
+
+    bool isEmpty() const;
+
+    // Passes over the image apply() makes, each one allocates one image
+    int passCount() const;
+
+    /*
+     * Rows above and below an output row that can change it, -1 when a step
+     * (rotation, warps, Fourier filters) needs the whole image. Running apply()
+     * on a strip extended by this many rows on each side gives the rows of the
+     * whole image result inside the strip.
+    */
+    int halo() const;
+
+    // Upper bound of the bytes per pixel apply() has allocated at once, input included
+    int peakBytesPerPixel(int bytesPerPixel) const;
+
+    QImage apply(const QImage& originalImage) const;
+
+    /*
+     * Writes rows [firstRow, firstRow + target->height()) of the apply() result
+     * straight into target, e.g. an image over a mapped .ifr file, whose width
+     * must be that of the result. A fused last pass computes only those rows
+     * and writes them in place when target is Grayscale8; other results have
+     * their rows converted to target's format. False when a step fails.
+    */
+    bool apply(const QImage& originalImage, int firstRow, QImage* target) const;
+
+private:
+    enum NodeType {
+        PointNode,
+        NeighbourhoodNode,
+        WarpNode,
+        ImageNode
+    };
+
+    typedef std::function<void(const uchar*, const uchar*, const uchar*, uchar*, int, int)> Kernel;
+
+    struct Node {
+        Node() : type(ImageNode), hasSampling(false), sampling(BilinearSampling), halo(-1), workBytes(0) {}
+
+        NodeType type;
+        // PointNode
+        PointOp op;
+        // NeighbourhoodNode: row kernel of Convolution::convolve3x3()
+        Kernel kernel;
+        // WarpNode
+        Warp warp;
+        bool hasSampling;
+        Sampling sampling;
+        // ImageNode
+        std::function<QImage(const QImage&)> run;
+        // see Pipeline::halo(), and the bytes per pixel the step needs besides images
+        int halo;
+        int workBytes;
+    };
+
+    static bool isFusable(NodeType type);
+    int passEnd(int first) const;
+    QImage fusedPass(const QImage& originalImage, int first, int last, int firstRow, int rowCount, QImage* target) const;
+    QImage applyPasses(const QImage& originalImage, int first, int last) const;
+
+    Pipeline& append(const Node& node);
+
+    std::vector<Node> m_nodes;
+};
+}
+
+#endif // PIPELINE_H
@@ -0,0 +1,351 @@
+#include "pointop.h"
+#include <QtMath>
+#include <cstring>
+#include "bufferpool.h"
+#include "parallel.h"
+
+#if defined(__SSSE3__) || defined(__AVX2__)
+#define POINTOP_SSSE3
+#include <tmmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+#define POINTOP_AVX2
+#include <immintrin.h>
+#endif
+
+/*
+ * 256-entry byte lookups with 16-entry shuffles: round k looks up the bytes
+ * whose high nibble is k. Subtracting 16k (wrapping) brings them to 0-15 and
+ * the saturating add of 0x70 pushes every other byte to 0x80 or above, which
+ * the shuffle turns into zero, so the sixteen rounds can simply be or-ed.
+*/
+#ifdef POINTOP_SSSE3
+static inline __m128i lookupSsse3(__m128i input, const __m128i* parts)
+{
+    const __m128i bias = _mm_set1_epi8(0x70);
+    const __m128i step = _mm_set1_epi8(16);
+    __m128i result = _mm_setzero_si128();
+
+    for(int k = 0; k < 16; ++k) {
+        result = _mm_or_si128(result, _mm_shuffle_epi8(parts[k], _mm_adds_epu8(input, bias)));
+        input = _mm_sub_epi8(input, step);
+    }
+
+    return result;
+}
+#endif
+
+#ifdef POINTOP_AVX2
+static inline __m256i lookupAvx2(__m256i input, const __m256i* parts)
+{
+    const __m256i bias = _mm256_set1_epi8(0x70);
+    const __m256i step = _mm256_set1_epi8(16);
+    __m256i result = _mm256_setzero_si256();
+
+    for(int k = 0; k < 16; ++k) {
+        result = _mm256_or_si256(result, _mm256_shuffle_epi8(parts[k], _mm256_adds_epu8(input, bias)));
+        input = _mm256_sub_epi8(input, step);
+    }
+
+    return result;
+}
+#endif
+
+/*
+ * Looks up whole vectors of the first count bytes in table. Every 32-bit lane becomes
+ * (lookup & lookupMask) | (input & keepMask) | constantBits, which lets 32-bit pixels keep
+ * or set their alpha byte. Returns the number of bytes done, the caller finishes the row.
+*/
+static int lookupVectors(const uchar* input, uchar* output, int count, const uchar* table,
+                         quint32 lookupMask, quint32 keepMask, quint32 constantBits)
+{
+    int done = 0;
+
+#if defined(POINTOP_AVX2)
+    __m256i parts[16];
+    for(int k = 0; k < 16; ++k)
+        parts[k] = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(table + 16 * k)));
+
+    const __m256i lookupBits = _mm256_set1_epi32(static_cast<int>(lookupMask));
+    const __m256i keepBits = _mm256_set1_epi32(static_cast<int>(keepMask));
+    const __m256i constant = _mm256_set1_epi32(static_cast<int>(constantBits));
+
+    for(; done + 32 <= count; done += 32) {
+        __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input + done));
+        __m256i result = _mm256_and_si256(lookupAvx2(pixels, parts), lookupBits);
+        result = _mm256_or_si256(result, _mm256_or_si256(_mm256_and_si256(pixels, keepBits), constant));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(output + done), result);
+    }
+#elif defined(POINTOP_SSSE3)
+    __m128i parts[16];
+    for(int k = 0; k < 16; ++k)
+        parts[k] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(table + 16 * k));
+
+    const __m128i lookupBits = _mm_set1_epi32(static_cast<int>(lookupMask));
+    const __m128i keepBits = _mm_set1_epi32(static_cast<int>(keepMask));
+    const __m128i constant = _mm_set1_epi32(static_cast<int>(constantBits));
+
+    for(; done + 16 <= count; done += 16) {
+        __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + done));
+        __m128i result = _mm_and_si128(lookupSsse3(pixels, parts), lookupBits);
+        result = _mm_or_si128(result, _mm_or_si128(_mm_and_si128(pixels, keepBits), constant));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + done), result);
+    }
+#else
+    Q_UNUSED(input);
+    Q_UNUSED(output);
+    Q_UNUSED(count);
+    Q_UNUSED(table);
+    Q_UNUSED(lookupMask);
+    Q_UNUSED(keepMask);
+    Q_UNUSED(constantBits);
+#endif
+
+    return done;
+}
+
+static bool isConstant(const uchar* table)
+{
+    for(int value = 1; value < 256; ++value) {
+        if(table[value] != table[0])
+            return false;
+    }
+
+    return true;
+}
+
+Filter::PointOp::PointOp()
+{
+    for(int channel = 0; channel < 4; ++channel)
+        for(int value = 0; value < 256; ++value)
+            m_tables[channel][value] = static_cast<uchar>(value);
+}
+
+Filter::PointOp Filter::PointOp::fromTable(const uchar *table)
+{
+    PointOp op;
+
+    for(int channel = Red; channel <= Blue; ++channel)
+        std::memcpy(op.m_tables[channel], table, 256);
+
+    return op;
+}
+
+Filter::PointOp Filter::PointOp::offset(int offset)
+{
+    uchar table[256];
+
+    for(int value = 0; value < 256; ++value)
+        table[value] = static_cast<uchar>((value + offset) & 0xFF);
+
+    return fromTable(table);
+}
+
+Filter::PointOp Filter::PointOp::gain(double gain, double bias)
+{
+    uchar table[256];
+
+    for(int value = 0; value < 256; ++value)
+        table[value] = static_cast<uchar>(qBound(0, qRound(value * gain + bias), 255));
+
+    return fromTable(table);
+}
+
+Filter::PointOp Filter::PointOp::gamma(double gamma)
+{
+    if(gamma <= 0)
+        return PointOp();
+
+    uchar table[256];
+
+    for(int value = 0; value < 256; ++value)
+        table[value] = static_cast<uchar>(qBound(0, qRound(255.0 * qPow(value / 255.0, 1.0 / gamma)), 255));
+
+    return fromTable(table);
+}
+
+Filter::PointOp Filter::PointOp::invert()
+{
+    uchar table[256];
+
+    for(int value = 0; value < 256; ++value)
+        table[value] = static_cast<uchar>(255 - value);
+
+    return fromTable(table);
+}
+
+Filter::PointOp Filter::PointOp::threshold(int level)
+{
+    uchar table[256];
+
+    for(int value = 0; value < 256; ++value)
+        table[value] = value >= level ? 255 : 0;
+
+    return fromTable(table);
+}
+
+Filter::PointOp Filter::PointOp::curve(const QVector<QPoint> &points)
+{
+    if(points.isEmpty())
+        return PointOp();
+
+    uchar table[256];
+    int next = 0;
+
+    for(int value = 0; value < 256; ++value) {
+        while(next < points.size() && points.at(next).x() <= value)
+            ++next;
+
+        int output;
+
+        if(next == 0) {
+            output = points.first().y();
+        }
+        else if(next == points.size()) {
+            output = points.last().y();
+        }
+        else {
+            const QPoint& from = points.at(next - 1);
+            const QPoint& to = points.at(next);
+            output = from.y() + qRound(static_cast<double>(to.y() - from.y()) * (value - from.x()) / (to.x() - from.x()));
+        }
+
+        table[value] = static_cast<uchar>(qBound(0, output, 255));
+    }
+
+    return fromTable(table);
+}
+
+Filter::PointOp Filter::PointOp::opaque()
+{
+    PointOp op;
+    std::memset(op.m_tables[Alpha], 255, 256);
+    return op;
+}
+
+Filter::PointOp Filter::PointOp::channels(const PointOp &red, const PointOp &green, const PointOp &blue)
+{
+    PointOp op;
+    std::memcpy(op.m_tables[Red], red.m_tables[Red], 256);
+    std::memcpy(op.m_tables[Green], green.m_tables[Green], 256);
+    std::memcpy(op.m_tables[Blue], blue.m_tables[Blue], 256);
+    return op;
+}
+
+Filter::PointOp Filter::PointOp::then(const PointOp &next) const
+{
+    PointOp op;
+
+    for(int channel = 0; channel < 4; ++channel)
+        for(int value = 0; value < 256; ++value)
+            op.m_tables[channel][value] = next.m_tables[channel][m_tables[channel][value]];
+
+    return op;
+}
+
+bool Filter::PointOp::isIdentity() const
+{
+    return std::memcmp(m_tables, PointOp().m_tables, sizeof(m_tables)) == 0;
+}
+
+const uchar *Filter::PointOp::table(Channel channel) const
+{
+    return m_tables[channel];
+}
+
+void Filter::PointOp::luminanceTable(uchar *table) const
+{
+    for(int value = 0; value < 256; ++value)
+        table[value] = static_cast<uchar>(qGray(m_tables[Red][value], m_tables[Green][value], m_tables[Blue][value]));
+}
+
+QImage Filter::PointOp::apply(const QImage &originalImage) const
+{
+    if(originalImage.isNull())
+        return QImage();
+
+    QImage image = originalImage;
+
+    switch(image.format()) {
+    case QImage::Format_Grayscale8:
+    case QImage::Format_RGB32:
+    case QImage::Format_ARGB32:
+        break;
+    default:
+        image = image.convertToFormat(QImage::Format_ARGB32);
+        break;
+    }
+
+    const int width = image.width();
+    const int height = image.height();
+    const bool isGray = image.format() == QImage::Format_Grayscale8;
+    // RGB32 keeps its alpha byte at 255 whatever the alpha table says
+    const bool isOpaque = image.format() == QImage::Format_RGB32;
+
+    QImage resultImage = BufferPool::image(width, height, image.format());
+    uchar* resultBits = resultImage.bits();
+    const int resultStride = resultImage.bytesPerLine();
+
+    uchar gray[256];
+    luminanceTable(gray);
+
+    // whole scanlines go through one table when every byte but alpha shares it
+    const uchar* sharedTable = nullptr;
+    quint32 lookupMask = 0xFFFFFFFF;
+    quint32 keepMask = 0;
+    quint32 constantBits = 0;
+
+    if(isGray) {
+        sharedTable = gray;
+    }
+    else if(std::memcmp(m_tables[Red], m_tables[Green], 256) == 0 && std::memcmp(m_tables[Red], m_tables[Blue], 256) == 0) {
+        const uchar* alpha = m_tables[Alpha];
+
+        if(isOpaque || isConstant(alpha)) {
+            sharedTable = m_tables[Red];
+            lookupMask = 0x00FFFFFF;
+            constantBits = static_cast<quint32>(isOpaque ? 255 : alpha[0]) << 24;
+        }
+        else if(std::memcmp(alpha, PointOp().m_tables[Alpha], 256) == 0) {
+            sharedTable = m_tables[Red];
+            lookupMask = 0x00FFFFFF;
+            keepMask = 0xFF000000;
+        }
+    }
+
+    const uchar* red = m_tables[Red];
+    const uchar* green = m_tables[Green];
+    const uchar* blue = m_tables[Blue];
+    const uchar* alpha = m_tables[Alpha];
+    const int rowBytes = isGray ? width : width * 4;
+
+    Parallel::forEachBand(0, height, Parallel::bandHeight(image.bytesPerLine()), [&](int firstRow, int lastRow) {
+        for(int i = firstRow; i < lastRow; ++i) {
+            const uchar* originalLine = image.constScanLine(i);
+            uchar* resultLine = resultBits + i * resultStride;
+
+            int done = sharedTable ? lookupVectors(originalLine, resultLine, rowBytes, sharedTable, lookupMask, keepMask, constantBits) : 0;
+
+            if(isGray) {
+                for(int j = done; j < width; ++j)
+                    resultLine[j] = gray[originalLine[j]];
+                continue;
+            }
+
+            const QRgb* originalPixels = reinterpret_cast<const QRgb*>(originalLine);
+            QRgb* resultPixels = reinterpret_cast<QRgb*>(resultLine);
+
+            for(int j = done / 4; j < width; ++j) {
+                QRgb pixel = originalPixels[j];
+                resultPixels[j] = qRgba(red[qRed(pixel)], green[qGreen(pixel)], blue[qBlue(pixel)],
+                                        isOpaque ? 255 : alpha[qAlpha(pixel)]);
+            }
+        }
+    });
+
+    if(resultImage.format() != originalImage.format())
+        return resultImage.convertToFormat(originalImage.format());
+
+    return resultImage;
+}
@@ -0,0 +1,69 @@
+#ifndef POINTOP_H
+#define POINTOP_H
+
+#include <QImage>
+#include <QPoint>
+#include <QVector>
+
+namespace Filter
+{
+/*
+ * Intensity transform held as one 256-entry lookup table per channel. Ops
+ * compose by composing their tables, so a chain of them still costs one
+ * lookup per sample and one pass over the image. The colour ops below treat
+ * red, green and blue alike and leave alpha alone.
+ *
+ * Grayscale8 pixels go through the luminance of the three colour tables, which
+ * is the colour table itself when they are equal. Scanlines whose channels all
+ * share one table (gray images, or equal colour tables with alpha kept or
+ * constant) are looked up 16 or 32 bytes at a time with byte shuffles on
+ * SSSE3/AVX2 builds.
+*/
+class PointOp
+{
+public:
+    enum Channel {
+        Red,
+        Green,
+        Blue,
+        Alpha
+    };
+
+    // Identity
+    PointOp();
+
+    // (value + offset) mod 256
+    static PointOp offset(int offset);
+    // value * gain + bias, clamped to 0-255
+    static PointOp gain(double gain, double bias = 0);
+    // 255 * (value/255)^(1/gamma), gamma above 1 brightens
+    static PointOp gamma(double gamma);
+    static PointOp invert();
+    // 255 from level up, 0 below
+    static PointOp threshold(int level);
+    // Linear between (input, output) control points sorted by input, flat past the ends
+    static PointOp curve(const QVector<QPoint>& points);
+    // Alpha becomes 255
+    static PointOp opaque();
+    // The red table of red, green table of green and blue table of blue
+    static PointOp channels(const PointOp& red, const PointOp& green, const PointOp& blue);
+    // Any 256-entry table for red, green and blue
+    static PointOp fromTable(const uchar* table);
+
+    // This op followed by next
+    PointOp then(const PointOp& next) const;
+
+    bool isIdentity() const;
+    const uchar* table(Channel channel) const;
+
+    // The table Grayscale8 pixels go through
+    void luminanceTable(uchar* table) const;
+
+    QImage apply(const QImage& originalImage) const;
+
+private:
+    uchar m_tables[4][256];
+};
+}
+
+#endif // POINTOP_H
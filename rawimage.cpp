@@ -0,0 +1,233 @@
+#include "rawimage.h"
+#include <QDir>
+#include <QFile>
+#include <cstring>
+#include <memory>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#else
+#include <cstdio>
+#endif
+
+static const char Magic[8] = { 'I', 'F', 'R', 'A', 'W', '\r', '\n', '\x1a' };
+static const quint32 ByteOrderMark = 0x01020304;
+static const quint32 Version = 1;
+// Rows and the pixel data start on multiples of this many bytes
+static const int RowAlignment = 64;
+
+struct FileHeader {
+    char magic[8];
+    quint32 byteOrder;
+    quint32 version;
+    quint32 format;
+    qint32 width;
+    qint32 height;
+    qint32 bytesPerLine;
+    quint64 dataOffset;
+    char reserved[24];
+};
+
+static_assert(sizeof(FileHeader) == RowAlignment, "the header fills the first row slot");
+
+// Mapping behind an image returned by load() or create(), released by the image
+struct Mapping {
+    explicit Mapping(const QString& fileName) : file(fileName), data(nullptr) {}
+    ~Mapping()
+    {
+        if(data)
+            file.unmap(data);
+    }
+
+    QFile file;
+    uchar* data;
+};
+
+static void releaseMapping(void* info)
+{
+    delete static_cast<Mapping*>(info);
+}
+
+// Bytes per pixel of formats stored as they are, 0 for the ones saved as ARGB32
+static int storedBytesPerPixel(QImage::Format format)
+{
+    switch(format) {
+    case QImage::Format_Invalid:
+    case QImage::Format_Mono:
+    case QImage::Format_MonoLSB:
+    case QImage::Format_Indexed8:
+        return 0;
+    default:
+        break;
+    }
+
+    return QImage(1, 1, format).depth() / 8;
+}
+
+static int alignedBytesPerLine(int width, int bytesPerPixel)
+{
+    const qint64 bytes = static_cast<qint64>(width) * bytesPerPixel;
+    return static_cast<int>((bytes + RowAlignment - 1) / RowAlignment * RowAlignment);
+}
+
+QString RawImage::suffix()
+{
+    return QStringLiteral("ifr");
+}
+
+bool RawImage::isRawImage(const QString &fileName)
+{
+    QFile file(fileName);
+    char magic[sizeof(Magic)];
+
+    return file.open(QIODevice::ReadOnly) && file.read(magic, sizeof(magic)) == sizeof(magic) &&
+           std::memcmp(magic, Magic, sizeof(Magic)) == 0;
+}
+
+QImage RawImage::load(const QString &fileName, QString *errorMessage)
+{
+    std::unique_ptr<Mapping> mapping(new Mapping(fileName));
+
+    if(!mapping->file.open(QIODevice::ReadOnly)) {
+        *errorMessage = QStringLiteral("%1: %2").arg(fileName, mapping->file.errorString());
+        return QImage();
+    }
+
+    FileHeader header;
+    const qint64 fileSize = mapping->file.size();
+
+    if(mapping->file.read(reinterpret_cast<char*>(&header), sizeof(header)) != sizeof(header) ||
+       std::memcmp(header.magic, Magic, sizeof(Magic)) != 0) {
+        *errorMessage = QStringLiteral("%1: not an .ifr image").arg(fileName);
+        return QImage();
+    }
+
+    if(header.byteOrder != ByteOrderMark || header.version != Version) {
+        *errorMessage = QStringLiteral("%1: .ifr image of another byte order or version").arg(fileName);
+        return QImage();
+    }
+
+    const QImage::Format format = static_cast<QImage::Format>(header.format);
+    const int bytesPerPixel = header.format < QImage::NImageFormats ? storedBytesPerPixel(format) : 0;
+
+    if(bytesPerPixel == 0 || header.width <= 0 || header.height <= 0 ||
+       header.bytesPerLine < alignedBytesPerLine(header.width, bytesPerPixel) || header.bytesPerLine % RowAlignment != 0 ||
+       header.dataOffset < sizeof(header) || header.dataOffset % RowAlignment != 0 ||
+       static_cast<quint64>(fileSize) < header.dataOffset + static_cast<quint64>(header.bytesPerLine) * header.height) {
+        *errorMessage = QStringLiteral("%1: corrupt or truncated .ifr image").arg(fileName);
+        return QImage();
+    }
+
+    mapping->data = mapping->file.map(0, fileSize);
+
+    if(!mapping->data) {
+        *errorMessage = QStringLiteral("%1: %2").arg(fileName, mapping->file.errorString());
+        return QImage();
+    }
+
+    const uchar* pixels = mapping->data + header.dataOffset;
+    QImage image(pixels, header.width, header.height, header.bytesPerLine, format, releaseMapping, mapping.get());
+
+    if(image.isNull()) {
+        *errorMessage = QStringLiteral("%1: could not wrap the mapping").arg(fileName);
+        return QImage();
+    }
+
+    mapping.release();
+    return image;
+}
+
+QImage RawImage::create(const QString &fileName, int width, int height, QImage::Format format, QString *errorMessage)
+{
+    const int bytesPerPixel = storedBytesPerPixel(format);
+
+    if(bytesPerPixel == 0 || width <= 0 || height <= 0) {
+        *errorMessage = QStringLiteral("%1: cannot store a %2x%3 image of format %4").arg(fileName).arg(width).arg(height).arg(format);
+        return QImage();
+    }
+
+    const int bytesPerLine = alignedBytesPerLine(width, bytesPerPixel);
+    const qint64 fileSize = RowAlignment + static_cast<qint64>(bytesPerLine) * height;
+
+    std::unique_ptr<Mapping> mapping(new Mapping(fileName));
+
+    if(!mapping->file.open(QIODevice::ReadWrite | QIODevice::Truncate) || !mapping->file.resize(fileSize) ||
+       !(mapping->data = mapping->file.map(0, fileSize))) {
+        *errorMessage = QStringLiteral("%1: %2").arg(fileName, mapping->file.errorString());
+        return QImage();
+    }
+
+    FileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, Magic, sizeof(Magic));
+    header.byteOrder = ByteOrderMark;
+    header.version = Version;
+    header.format = static_cast<quint32>(format);
+    header.width = width;
+    header.height = height;
+    header.bytesPerLine = bytesPerLine;
+    header.dataOffset = RowAlignment;
+    std::memcpy(mapping->data, &header, sizeof(header));
+
+    QImage image(mapping->data + RowAlignment, width, height, bytesPerLine, format, releaseMapping, mapping.get());
+
+    if(image.isNull()) {
+        *errorMessage = QStringLiteral("%1: could not wrap the mapping").arg(fileName);
+        return QImage();
+    }
+
+    mapping.release();
+    return image;
+}
+
+bool RawImage::save(const QImage &image, const QString &fileName, QString *errorMessage)
+{
+    if(image.isNull()) {
+        *errorMessage = QStringLiteral("%1: no image to save").arg(fileName);
+        return false;
+    }
+
+    const QImage source = storedBytesPerPixel(image.format()) > 0 ? image : image.convertToFormat(QImage::Format_ARGB32);
+    const QString partFileName = fileName + QStringLiteral(".part");
+    QImage target = create(partFileName, source.width(), source.height(), source.format(), errorMessage);
+
+    if(target.isNull())
+        return false;
+
+    const size_t rowBytes = static_cast<size_t>(source.width()) * (source.depth() / 8);
+    uchar* bits = target.bits();
+    const int stride = target.bytesPerLine();
+
+    for(int i = 0; i < source.height(); ++i)
+        std::memcpy(bits + i * static_cast<qint64>(stride), source.constScanLine(i), rowBytes);
+
+    // unmaps the file
+    target = QImage();
+
+    // a failed replace keeps the old file, the new one is dropped
+    if(!replaceFile(partFileName, fileName, errorMessage)) {
+        QFile::remove(partFileName);
+        return false;
+    }
+
+    return true;
+}
+
+bool RawImage::replaceFile(const QString &sourceFileName, const QString &fileName, QString *errorMessage)
+{
+#if defined(Q_OS_WIN)
+    const QString source = QDir::toNativeSeparators(sourceFileName);
+    const QString target = QDir::toNativeSeparators(fileName);
+    const bool isReplaced = MoveFileExW(reinterpret_cast<const wchar_t*>(source.utf16()), reinterpret_cast<const wchar_t*>(target.utf16()),
+                                        MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    const bool isReplaced = ::rename(QFile::encodeName(sourceFileName).constData(), QFile::encodeName(fileName).constData()) == 0;
+#endif
+
+    if(!isReplaced) {
+        *errorMessage = QStringLiteral("%1: could not replace the file: %2").arg(fileName, qt_error_string());
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,51 @@
+#ifndef RAWIMAGE_H
+#define RAWIMAGE_H
+
+#include <QImage>
+#include <QString>
+
+/*
+ * Uncompressed .ifr image files for intermediate results that are read back
+ * soon: a 64 byte header (size, QImage format, stride) followed by the rows
+ * exactly as QImage holds them in memory, each padded to a multiple of 64
+ * bytes. Loading maps the file and wraps the mapping as a QImage, so neither
+ * decoding nor copying happens and pages come in from the page cache as rows
+ * are touched.
+ *
+ * Pixels are stored in host byte order; files written on a host of the other
+ * byte order are rejected. Formats below 8 bits per pixel or with a colour
+ * table are saved as ARGB32.
+*/
+namespace RawImage
+{
+// "ifr"
+QString suffix();
+
+// True when the file starts with the .ifr header
+bool isRawImage(const QString& fileName);
+
+/*
+ * Read only image over a mapping of the file, unmapped when the last copy of
+ * the image goes away. Writing to it detaches into an ordinary image.
+*/
+QImage load(const QString& fileName, QString* errorMessage);
+
+/*
+ * Creates (or replaces) the file for a width x height image of format and
+ * returns an image over a writable mapping of it: whatever is written through
+ * bits() or scanLine() of that image, while it is not shared, lands in the file.
+*/
+QImage create(const QString& fileName, int width, int height, QImage::Format format, QString* errorMessage);
+
+// Writes image next to fileName first and renames it over fileName, so mappings of an old fileName stay valid
+bool save(const QImage& image, const QString& fileName, QString* errorMessage);
+
+/*
+ * Renames sourceFileName over fileName in one step (rename() on POSIX,
+ * MoveFileEx() on Windows): readers see the old or the new file, never none,
+ * and fileName is left as it was when the rename fails.
+*/
+bool replaceFile(const QString& sourceFileName, const QString& fileName, QString* errorMessage);
+}
+
+#endif // RAWIMAGE_H
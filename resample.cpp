@@ -0,0 +1,463 @@
+#include "resample.h"
+#include <cmath>
+
+#if defined(__AVX2__)
+#define RESAMPLE_AVX2
+#include <immintrin.h>
+#endif
+
+using Resample::Fixed;
+using Resample::FixedBits;
+using Resample::RowMapping;
+
+static Fixed floorDiv(Fixed numerator, Fixed denominator)
+{
+    // denominator > 0
+    return numerator >= 0 ? numerator / denominator : -((-numerator + denominator - 1) / denominator);
+}
+
+static Fixed ceilDiv(Fixed numerator, Fixed denominator)
+{
+    return -floorDiv(-numerator, denominator);
+}
+
+// Narrows [*begin, *end) to the j with minimum <= start + j*step <= maximum
+static bool clipAxis(Fixed start, Fixed step, Fixed minimum, Fixed maximum, int* begin, int* end)
+{
+    Fixed first;
+    Fixed last;
+
+    if(step == 0) {
+        if(start < minimum || start > maximum)
+            return false;
+        return *begin < *end;
+    }
+
+    if(step > 0) {
+        first = ceilDiv(minimum - start, step);
+        last = floorDiv(maximum - start, step);
+    }
+    else {
+        first = ceilDiv(start - maximum, -step);
+        last = floorDiv(start - minimum, -step);
+    }
+
+    if(first > *begin)
+        *begin = static_cast<int>(qMin<Fixed>(first, *end));
+    if(last + 1 < *end)
+        *end = static_cast<int>(qMax<Fixed>(last + 1, *begin));
+
+    return *begin < *end;
+}
+
+Fixed Resample::toFixed(double value)
+{
+    return static_cast<Fixed>(std::llround(std::ldexp(value, FixedBits)));
+}
+
+bool Resample::clipRow(const RowMapping &row, int left, int top, int right, int bottom, int *begin, int *end)
+{
+    if(left >= right || top >= bottom)
+        return false;
+
+    return clipAxis(row.x, row.dx, Fixed(left) << FixedBits, (Fixed(right) << FixedBits) - 1, begin, end) &&
+           clipAxis(row.y, row.dy, Fixed(top) << FixedBits, (Fixed(bottom) << FixedBits) - 1, begin, end);
+}
+
+namespace {
+
+// 8-bit weights: fx, fy in [0, 256), the four weights add up to 65536
+inline int blendChannel(int p00, int p01, int p10, int p11, int fx, int fy)
+{
+    int top = p00 * (256 - fx) + p01 * fx;
+    int bottom = p10 * (256 - fx) + p11 * fx;
+
+    return (top * (256 - fy) + bottom * fy + 32768) >> 16;
+}
+
+struct GrayPixels {
+    typedef uchar Pixel;
+    enum { Bits = 8 };
+
+    static Pixel blend(Pixel p00, Pixel p01, Pixel p10, Pixel p11, int fx, int fy)
+    {
+        return static_cast<Pixel>(blendChannel(p00, p01, p10, p11, fx, fy));
+    }
+};
+
+struct RgbPixels {
+    typedef QRgb Pixel;
+    enum { Bits = 32 };
+
+    static Pixel blend(Pixel p00, Pixel p01, Pixel p10, Pixel p11, int fx, int fy)
+    {
+        Pixel result = 0;
+
+        for(int shift = 0; shift < 32; shift += 8) {
+            int value = blendChannel((p00 >> shift) & 0xff, (p01 >> shift) & 0xff,
+                                     (p10 >> shift) & 0xff, (p11 >> shift) & 0xff, fx, fy);
+            result |= static_cast<Pixel>(value) << shift;
+        }
+
+        return result;
+    }
+};
+
+// Positions of an affine row, advanced by a constant step
+class AffineWalk
+{
+public:
+    AffineWalk(const RowMapping& row, int begin)
+        : m_x(row.x + begin * row.dx), m_y(row.y + begin * row.dy), m_dx(row.dx), m_dy(row.dy)
+    {
+    }
+
+    Fixed x() const { return m_x; }
+    Fixed y() const { return m_y; }
+
+    void next()
+    {
+        m_x += m_dx;
+        m_y += m_dy;
+    }
+
+private:
+    Fixed m_x;
+    Fixed m_y;
+    Fixed m_dx;
+    Fixed m_dy;
+};
+
+// Positions precomputed per column
+class PointWalk
+{
+public:
+    PointWalk(const Fixed* x, const Fixed* y, int begin)
+        : m_x(x + begin), m_y(y + begin)
+    {
+    }
+
+    Fixed x() const { return *m_x; }
+    Fixed y() const { return *m_y; }
+
+    void next()
+    {
+        ++m_x;
+        ++m_y;
+    }
+
+private:
+    const Fixed* m_x;
+    const Fixed* m_y;
+};
+
+/*
+ * Catmull-Rom weights of the taps at -1, 0, 1 and 2 for every 8-bit fraction,
+ * scaled so each set adds up to 256
+*/
+class BicubicWeights
+{
+public:
+    BicubicWeights()
+    {
+        for(int fraction = 0; fraction < 256; ++fraction) {
+            double t = fraction / 256.0;
+            double t2 = t * t;
+            double t3 = t2 * t;
+
+            int* weights = m_weights[fraction];
+            weights[0] = qRound(128.0 * (-t3 + 2.0*t2 - t));
+            weights[2] = qRound(128.0 * (-3.0*t3 + 4.0*t2 + t));
+            weights[3] = qRound(128.0 * (t3 - t2));
+            weights[1] = 256 - weights[0] - weights[2] - weights[3];
+        }
+    }
+
+    const int* operator[](int fraction) const { return m_weights[fraction]; }
+
+private:
+    int m_weights[256][4];
+};
+
+const BicubicWeights& bicubicWeights()
+{
+    static const BicubicWeights weights;
+    return weights;
+}
+
+}
+
+template <typename Pixels, typename Walk>
+static void nearestSpan(const QImage& source, Walk walk, uchar* output, int begin, int end)
+{
+    typedef typename Pixels::Pixel Pixel;
+
+    const uchar* sourceBits = source.constBits();
+    const qint64 sourceStride = source.bytesPerLine();
+    Pixel* outputPixels = reinterpret_cast<Pixel*>(output);
+
+    for(int j = begin; j < end; ++j) {
+        const Pixel* sourceLine = reinterpret_cast<const Pixel*>(sourceBits + (walk.y() >> FixedBits) * sourceStride);
+        outputPixels[j] = sourceLine[walk.x() >> FixedBits];
+
+        walk.next();
+    }
+}
+
+// Clamp is only needed on the columns whose neighbours fall outside the source
+template <typename Pixels, bool Clamp, typename Walk>
+static void bilinearSpan(const QImage& source, Walk walk, uchar* output, int begin, int end)
+{
+    typedef typename Pixels::Pixel Pixel;
+
+    const uchar* sourceBits = source.constBits();
+    const qint64 sourceStride = source.bytesPerLine();
+    const int lastX = source.width() - 1;
+    const int lastY = source.height() - 1;
+    Pixel* outputPixels = reinterpret_cast<Pixel*>(output);
+
+    for(int j = begin; j < end; ++j) {
+        int x0 = static_cast<int>(walk.x() >> FixedBits);
+        int y0 = static_cast<int>(walk.y() >> FixedBits);
+        int fx = static_cast<int>(walk.x() >> (FixedBits - 8)) & 255;
+        int fy = static_cast<int>(walk.y() >> (FixedBits - 8)) & 255;
+        int x1 = x0 + 1;
+        int y1 = y0 + 1;
+
+        if(Clamp) {
+            x0 = qBound(0, x0, lastX);
+            x1 = qBound(0, x1, lastX);
+            y0 = qBound(0, y0, lastY);
+            y1 = qBound(0, y1, lastY);
+        }
+
+        const Pixel* line0 = reinterpret_cast<const Pixel*>(sourceBits + y0 * sourceStride);
+        const Pixel* line1 = reinterpret_cast<const Pixel*>(sourceBits + y1 * sourceStride);
+
+        outputPixels[j] = Pixels::blend(line0[x0], line0[x1], line1[x0], line1[x1], fx, fy);
+
+        walk.next();
+    }
+}
+
+template <typename Pixels, bool Clamp, typename Walk>
+static void bicubicSpan(const QImage& source, Walk walk, uchar* output, int begin, int end)
+{
+    typedef typename Pixels::Pixel Pixel;
+
+    const BicubicWeights& weights = bicubicWeights();
+    const uchar* sourceBits = source.constBits();
+    const qint64 sourceStride = source.bytesPerLine();
+    const int lastX = source.width() - 1;
+    const int lastY = source.height() - 1;
+    Pixel* outputPixels = reinterpret_cast<Pixel*>(output);
+
+    for(int j = begin; j < end; ++j) {
+        int x0 = static_cast<int>(walk.x() >> FixedBits);
+        int y0 = static_cast<int>(walk.y() >> FixedBits);
+        const int* weightsX = weights[static_cast<int>(walk.x() >> (FixedBits - 8)) & 255];
+        const int* weightsY = weights[static_cast<int>(walk.y() >> (FixedBits - 8)) & 255];
+
+        int columns[4];
+        const Pixel* lines[4];
+
+        for(int k = 0; k < 4; ++k) {
+            columns[k] = Clamp ? qBound(0, x0 - 1 + k, lastX) : x0 - 1 + k;
+            int y = Clamp ? qBound(0, y0 - 1 + k, lastY) : y0 - 1 + k;
+            lines[k] = reinterpret_cast<const Pixel*>(sourceBits + y * sourceStride);
+        }
+
+        Pixel result = 0;
+
+        for(int shift = 0; shift < Pixels::Bits; shift += 8) {
+            int sum = 0;
+
+            for(int row = 0; row < 4; ++row) {
+                int horizontal = 0;
+                for(int k = 0; k < 4; ++k)
+                    horizontal += ((lines[row][columns[k]] >> shift) & 0xff) * weightsX[k];
+                sum += horizontal * weightsY[row];
+            }
+
+            // the negative lobes can over- and undershoot
+            result |= static_cast<Pixel>(qBound(0, (sum + 32768) >> 16, 255)) << shift;
+        }
+
+        outputPixels[j] = result;
+
+        walk.next();
+    }
+}
+
+#ifdef RESAMPLE_AVX2
+
+/*
+ * Bilinear samples of eight 32-bit pixels per step with gathered neighbours,
+ * bit exact with bilinearSpan(). All neighbours of [begin, end) must lie inside
+ * the source. Returns the first column left for the scalar loop.
+ *
+ * The positions of the even and odd columns are kept in two vectors of 64-bit
+ * lanes, so one blend puts the 32-bit integer (or fraction) parts of all eight
+ * columns in order.
+*/
+static int bilinearSpanAvx2(const QImage& source, const RowMapping& row, uchar* output, int begin, int end)
+{
+    const int* sourcePixels = reinterpret_cast<const int*>(source.constBits());
+    const int sourceStride = source.bytesPerLine() / 4;
+    quint32* outputPixels = reinterpret_cast<quint32*>(output);
+
+    const Fixed x = row.x + begin * row.dx;
+    const Fixed y = row.y + begin * row.dy;
+
+    __m256i xEven = _mm256_add_epi64(_mm256_set1_epi64x(x), _mm256_set_epi64x(6 * row.dx, 4 * row.dx, 2 * row.dx, 0));
+    __m256i xOdd = _mm256_add_epi64(_mm256_set1_epi64x(x), _mm256_set_epi64x(7 * row.dx, 5 * row.dx, 3 * row.dx, row.dx));
+    __m256i yEven = _mm256_add_epi64(_mm256_set1_epi64x(y), _mm256_set_epi64x(6 * row.dy, 4 * row.dy, 2 * row.dy, 0));
+    __m256i yOdd = _mm256_add_epi64(_mm256_set1_epi64x(y), _mm256_set_epi64x(7 * row.dy, 5 * row.dy, 3 * row.dy, row.dy));
+    const __m256i stepX = _mm256_set1_epi64x(8 * row.dx);
+    const __m256i stepY = _mm256_set1_epi64x(8 * row.dy);
+
+    const __m256i stride = _mm256_set1_epi32(sourceStride);
+    const __m256i channelMask = _mm256_set1_epi32(0xff);
+    const __m256i rounding = _mm256_set1_epi32(32768);
+
+    int j = begin;
+
+    for(; j + 8 <= end; j += 8) {
+        __m256i x0 = _mm256_blend_epi32(_mm256_srli_epi64(xEven, 32), xOdd, 0xaa);
+        __m256i y0 = _mm256_blend_epi32(_mm256_srli_epi64(yEven, 32), yOdd, 0xaa);
+        __m256i fx = _mm256_srli_epi32(_mm256_blend_epi32(xEven, _mm256_slli_epi64(xOdd, 32), 0xaa), 24);
+        __m256i fy = _mm256_srli_epi32(_mm256_blend_epi32(yEven, _mm256_slli_epi64(yOdd, 32), 0xaa), 24);
+
+        __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(y0, stride), x0);
+        __m256i p00 = _mm256_i32gather_epi32(sourcePixels, index, 4);
+        __m256i p01 = _mm256_i32gather_epi32(sourcePixels + 1, index, 4);
+        __m256i p10 = _mm256_i32gather_epi32(sourcePixels + sourceStride, index, 4);
+        __m256i p11 = _mm256_i32gather_epi32(sourcePixels + sourceStride + 1, index, 4);
+
+        __m256i result = _mm256_setzero_si256();
+
+        for(int shift = 0; shift < 32; shift += 8) {
+            const __m128i count = _mm_cvtsi32_si128(shift);
+            __m256i c00 = _mm256_and_si256(_mm256_srl_epi32(p00, count), channelMask);
+            __m256i c01 = _mm256_and_si256(_mm256_srl_epi32(p01, count), channelMask);
+            __m256i c10 = _mm256_and_si256(_mm256_srl_epi32(p10, count), channelMask);
+            __m256i c11 = _mm256_and_si256(_mm256_srl_epi32(p11, count), channelMask);
+
+            // p0*(256-f) + p1*f = p0*256 + (p1-p0)*f, the differences fit the low 16 bits of madd
+            __m256i top = _mm256_add_epi32(_mm256_slli_epi32(c00, 8), _mm256_madd_epi16(_mm256_sub_epi32(c01, c00), fx));
+            __m256i bottom = _mm256_add_epi32(_mm256_slli_epi32(c10, 8), _mm256_madd_epi16(_mm256_sub_epi32(c11, c10), fx));
+            __m256i value = _mm256_add_epi32(_mm256_slli_epi32(top, 8), _mm256_mullo_epi32(_mm256_sub_epi32(bottom, top), fy));
+
+            value = _mm256_srli_epi32(_mm256_add_epi32(value, rounding), 16);
+            result = _mm256_or_si256(result, _mm256_sll_epi32(value, count));
+        }
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(outputPixels + j), result);
+
+        xEven = _mm256_add_epi64(xEven, stepX);
+        xOdd = _mm256_add_epi64(xOdd, stepX);
+        yEven = _mm256_add_epi64(yEven, stepY);
+        yOdd = _mm256_add_epi64(yOdd, stepY);
+    }
+
+    return j;
+}
+
+#endif
+
+template <typename Pixels>
+static void bilinearInnerSpan(const QImage& source, const RowMapping& row, uchar* output, int begin, int end)
+{
+    bilinearSpan<Pixels, false>(source, AffineWalk(row, begin), output, begin, end);
+}
+
+#ifdef RESAMPLE_AVX2
+template <>
+void bilinearInnerSpan<RgbPixels>(const QImage& source, const RowMapping& row, uchar* output, int begin, int end)
+{
+    int scalarBegin = bilinearSpanAvx2(source, row, output, begin, end);
+    bilinearSpan<RgbPixels, false>(source, AffineWalk(row, scalarBegin), output, scalarBegin, end);
+}
+#endif
+
+template <typename Pixels>
+static void bilinearRowOf(const QImage& source, const RowMapping& row, uchar* output, int begin, int end)
+{
+    // inner span: both neighbours inside the source
+    int innerBegin = begin;
+    int innerEnd = end;
+
+    if(!Resample::clipRow(row, 0, 0, source.width() - 1, source.height() - 1, &innerBegin, &innerEnd)) {
+        bilinearSpan<Pixels, true>(source, AffineWalk(row, begin), output, begin, end);
+        return;
+    }
+
+    bilinearSpan<Pixels, true>(source, AffineWalk(row, begin), output, begin, innerBegin);
+    bilinearInnerSpan<Pixels>(source, row, output, innerBegin, innerEnd);
+    bilinearSpan<Pixels, true>(source, AffineWalk(row, innerEnd), output, innerEnd, end);
+}
+
+template <typename Pixels>
+static void bicubicRowOf(const QImage& source, const RowMapping& row, uchar* output, int begin, int end)
+{
+    // inner span: all 16 taps inside the source
+    int innerBegin = begin;
+    int innerEnd = end;
+
+    if(!Resample::clipRow(row, 1, 1, source.width() - 2, source.height() - 2, &innerBegin, &innerEnd)) {
+        bicubicSpan<Pixels, true>(source, AffineWalk(row, begin), output, begin, end);
+        return;
+    }
+
+    bicubicSpan<Pixels, true>(source, AffineWalk(row, begin), output, begin, innerBegin);
+    bicubicSpan<Pixels, false>(source, AffineWalk(row, innerBegin), output, innerBegin, innerEnd);
+    bicubicSpan<Pixels, true>(source, AffineWalk(row, innerEnd), output, innerEnd, end);
+}
+
+void Resample::nearestRow(const QImage &source, const RowMapping &row, uchar *output, int begin, int end)
+{
+    if(source.format() == QImage::Format_Grayscale8)
+        nearestSpan<GrayPixels>(source, AffineWalk(row, begin), output, begin, end);
+    else
+        nearestSpan<RgbPixels>(source, AffineWalk(row, begin), output, begin, end);
+}
+
+void Resample::bilinearRow(const QImage &source, const RowMapping &row, uchar *output, int begin, int end)
+{
+    if(source.format() == QImage::Format_Grayscale8)
+        bilinearRowOf<GrayPixels>(source, row, output, begin, end);
+    else
+        bilinearRowOf<RgbPixels>(source, row, output, begin, end);
+}
+
+void Resample::bicubicRow(const QImage &source, const RowMapping &row, uchar *output, int begin, int end)
+{
+    if(source.format() == QImage::Format_Grayscale8)
+        bicubicRowOf<GrayPixels>(source, row, output, begin, end);
+    else
+        bicubicRowOf<RgbPixels>(source, row, output, begin, end);
+}
+
+void Resample::nearestPoints(const QImage &source, const Fixed *x, const Fixed *y, uchar *output, int begin, int end)
+{
+    if(source.format() == QImage::Format_Grayscale8)
+        nearestSpan<GrayPixels>(source, PointWalk(x, y, begin), output, begin, end);
+    else
+        nearestSpan<RgbPixels>(source, PointWalk(x, y, begin), output, begin, end);
+}
+
+void Resample::bilinearPoints(const QImage &source, const Fixed *x, const Fixed *y, uchar *output, int begin, int end)
+{
+    if(source.format() == QImage::Format_Grayscale8)
+        bilinearSpan<GrayPixels, true>(source, PointWalk(x, y, begin), output, begin, end);
+    else
+        bilinearSpan<RgbPixels, true>(source, PointWalk(x, y, begin), output, begin, end);
+}
+
+void Resample::bicubicPoints(const QImage &source, const Fixed *x, const Fixed *y, uchar *output, int begin, int end)
+{
+    if(source.format() == QImage::Format_Grayscale8)
+        bicubicSpan<GrayPixels, true>(source, PointWalk(x, y, begin), output, begin, end);
+    else
+        bicubicSpan<RgbPixels, true>(source, PointWalk(x, y, begin), output, begin, end);
+}
@@ -0,0 +1,60 @@
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+#include <QImage>
+
+/*
+ * Row samplers for affine and projective image transforms.
+ *
+ * The source position of destination column j in one row is
+ *   (x + j*dx, y + j*dy)
+ * kept in 32.32 fixed point and advanced incrementally. clipRow() solves for
+ * the columns whose position lies inside a source rectangle, so the samplers
+ * walk a span without any per pixel bounds test. Projective rows have no
+ * constant step, their positions are computed by the caller and passed as
+ * arrays to the *Points() samplers.
+ *
+ * Sources are Grayscale8 or 32-bit (RGB32/ARGB32) images and the output row
+ * has the same format. Bilinear and bicubic positions are in sample space,
+ * where the integer positions are the pixels themselves; their neighbours are
+ * clamped to the image, so positions between the border pixels and the image
+ * edge are fine.
+*/
+namespace Resample
+{
+typedef qint64 Fixed;
+
+const int FixedBits = 32;
+
+Fixed toFixed(double value);
+
+struct RowMapping {
+    Fixed x;
+    Fixed y;
+    Fixed dx;
+    Fixed dy;
+};
+
+/*
+ * Narrows [*begin, *end) to the columns whose source position satisfies
+ * left <= x < right and top <= y < bottom.
+ * Return false when no column is left
+*/
+bool clipRow(const RowMapping& row, int left, int top, int right, int bottom, int* begin, int* end);
+
+// Nearest neighbour, columns [begin, end) must come from clipRow() over the whole source
+void nearestRow(const QImage& source, const RowMapping& row, uchar* output, int begin, int end);
+
+// Bilinear interpolation with 8-bit weights, positions within one pixel of the source
+void bilinearRow(const QImage& source, const RowMapping& row, uchar* output, int begin, int end);
+
+// Catmull-Rom bicubic interpolation with 8-bit weights, positions within one pixel of the source
+void bicubicRow(const QImage& source, const RowMapping& row, uchar* output, int begin, int end);
+
+// The same samplers with the position of column j in (x[j], y[j])
+void nearestPoints(const QImage& source, const Fixed* x, const Fixed* y, uchar* output, int begin, int end);
+void bilinearPoints(const QImage& source, const Fixed* x, const Fixed* y, uchar* output, int begin, int end);
+void bicubicPoints(const QImage& source, const Fixed* x, const Fixed* y, uchar* output, int begin, int end);
+}
+
+#endif // RESAMPLE_H
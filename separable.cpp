@@ -0,0 +1,322 @@
+#include "separable.h"
+#include <QtMath>
+#include <algorithm>
+#include <cstring>
+#include "bufferpool.h"
+#include "parallel.h"
+
+// Fixed point weights of convolve(), 1.0 is 1 << WeightBits
+static const int WeightBits = 14;
+
+/*
+ * Bytes per column strip of the vertical pass. Every row of a strip is a separate
+ * memory stream, so wide strips keep the prefetcher and the TLB busy on whole
+ * pages; narrower ones are only used to give every thread a few strips.
+*/
+static const int MinimumStripBytes = 256;
+static const int MaximumStripBytes = 2048;
+
+static int stripBytes(int rowBytes)
+{
+    const int bytes = rowBytes / (2 * Parallel::threadCount());
+    return qBound(MinimumStripBytes, bytes - bytes % 64, MaximumStripBytes);
+}
+
+// Rows are read and written straight on scanlines, so filter in a format with a fixed pixel size
+static QImage::Format filterFormat(QImage::Format format)
+{
+    if(format == QImage::Format_Grayscale8 || format == QImage::Format_RGB32 || format == QImage::Format_ARGB32)
+        return format;
+
+    return QImage::Format_ARGB32;
+}
+
+static inline uchar clampToByte(int value)
+{
+    return static_cast<uchar>(qBound(0, value, 255));
+}
+
+// Copies a row into padded with radius edge pixels in front and radius + 1 behind it
+template <int Channels>
+static void padRow(const uchar* input, uchar* padded, int width, int radius)
+{
+    const uchar* last = input + (width - 1) * Channels;
+
+    for(int x = 0; x < radius; ++x)
+        std::memcpy(padded + x * Channels, input, Channels);
+
+    std::memcpy(padded + radius * Channels, input, static_cast<size_t>(width) * Channels);
+
+    for(int x = radius + width; x <= 2 * radius + width; ++x)
+        std::memcpy(padded + x * Channels, last, Channels);
+}
+
+// output[x] is the average of padded[x] .. padded[x + 2*radius], per channel
+template <int Channels>
+static void boxRow(const uchar* padded, uchar* output, int width, int radius)
+{
+    const int size = 2 * radius + 1;
+    // size is odd, so an average never lies exactly halfway between two integers
+    const float scale = 1.0f / size;
+    int sums[Channels];
+
+    for(int c = 0; c < Channels; ++c) {
+        sums[c] = 0;
+        for(int k = 0; k < size; ++k)
+            sums[c] += padded[k * Channels + c];
+    }
+
+    for(int x = 0; x < width; ++x) {
+        const uchar* leaving = padded + x * Channels;
+        const uchar* entering = leaving + size * Channels;
+
+        for(int c = 0; c < Channels; ++c) {
+            output[x * Channels + c] = static_cast<uchar>(sums[c] * scale + 0.5f);
+            sums[c] += entering[c] - leaving[c];
+        }
+    }
+}
+
+template <int Channels>
+static void kernelRow(const uchar* padded, uchar* output, int width, const std::vector<int>& weights)
+{
+    const int size = static_cast<int>(weights.size());
+
+    for(int x = 0; x < width; ++x) {
+        for(int c = 0; c < Channels; ++c) {
+            int sum = 1 << (WeightBits - 1);
+
+            for(int k = 0; k < size; ++k)
+                sum += weights[k] * padded[(x + k) * Channels + c];
+
+            output[x * Channels + c] = clampToByte(sum >> WeightBits);
+        }
+    }
+}
+
+// Box averages down columns [0, columns), the window of row y covers rows y-radius .. y+radius clamped to the image
+static void boxColumns(const uchar* input, int inputStride, uchar* output, int outputStride, int columns, int height, int radius)
+{
+    const float scale = 1.0f / (2 * radius + 1);
+    std::vector<int> sums(static_cast<size_t>(columns));
+
+    for(int c = 0; c < columns; ++c)
+        sums[c] = (radius + 1) * input[c];
+
+    for(int k = 1; k <= radius; ++k) {
+        const uchar* row = input + static_cast<size_t>(qMin(k, height - 1)) * inputStride;
+        for(int c = 0; c < columns; ++c)
+            sums[c] += row[c];
+    }
+
+    for(int y = 0; y < height; ++y) {
+        uchar* outputRow = output + static_cast<size_t>(y) * outputStride;
+        const uchar* entering = input + static_cast<size_t>(qMin(y + radius + 1, height - 1)) * inputStride;
+        const uchar* leaving = input + static_cast<size_t>(qMax(y - radius, 0)) * inputStride;
+
+        for(int c = 0; c < columns; ++c) {
+            outputRow[c] = static_cast<uchar>(sums[c] * scale + 0.5f);
+            sums[c] += entering[c] - leaving[c];
+        }
+    }
+}
+
+static void kernelColumns(const uchar* input, int inputStride, uchar* output, int outputStride, int columns, int height,
+                          const std::vector<int>& weights)
+{
+    const int size = static_cast<int>(weights.size());
+    const int radius = size / 2;
+    std::vector<int> sums(static_cast<size_t>(columns));
+
+    for(int y = 0; y < height; ++y) {
+        std::fill(sums.begin(), sums.end(), 1 << (WeightBits - 1));
+
+        for(int k = 0; k < size; ++k) {
+            const uchar* row = input + static_cast<size_t>(qBound(0, y - radius + k, height - 1)) * inputStride;
+            const int weight = weights[k];
+
+            for(int c = 0; c < columns; ++c)
+                sums[c] += weight * row[c];
+        }
+
+        uchar* outputRow = output + static_cast<size_t>(y) * outputStride;
+        for(int c = 0; c < columns; ++c)
+            outputRow[c] = clampToByte(sums[c] >> WeightBits);
+    }
+}
+
+template <int Channels>
+static void boxRows(const QImage& image, uchar* rows, int rowBytes, int firstRow, int lastRow, const std::vector<int>& radii)
+{
+    const int width = image.width();
+    const int maxRadius = *std::max_element(radii.begin(), radii.end());
+    std::vector<uchar> padded(static_cast<size_t>(width + 2 * maxRadius + 1) * Channels);
+
+    for(int i = firstRow; i < lastRow; ++i) {
+        const uchar* input = image.constScanLine(i);
+        uchar* output = rows + static_cast<size_t>(i) * rowBytes;
+
+        // every pass copies its input into padded first, so later passes work in place
+        for(int radius : radii) {
+            padRow<Channels>(input, padded.data(), width, radius);
+            boxRow<Channels>(padded.data(), output, width, radius);
+            input = output;
+        }
+    }
+}
+
+template <int Channels>
+static void kernelRows(const QImage& image, uchar* rows, int rowBytes, int firstRow, int lastRow, const std::vector<int>& weights)
+{
+    const int width = image.width();
+    const int radius = static_cast<int>(weights.size()) / 2;
+    std::vector<uchar> padded(static_cast<size_t>(width + 2 * radius + 1) * Channels);
+
+    for(int i = firstRow; i < lastRow; ++i) {
+        padRow<Channels>(image.constScanLine(i), padded.data(), width, radius);
+        kernelRow<Channels>(padded.data(), rows + static_cast<size_t>(i) * rowBytes, width, weights);
+    }
+}
+
+/*
+ * Runs rowPass(image, rows, rowBytes, firstRow, lastRow) over row bands into a
+ * packed intermediate image, then columnPass(rows, rowBytes, output, outputStride,
+ * columns, height) over strips of it into the result. A strip is walked top to
+ * bottom in one go, so the vertical running sums are primed once per strip.
+*/
+template <typename RowPass, typename ColumnPass>
+static QImage separablePasses(const QImage& source, const RowPass& rowPass, const ColumnPass& columnPass)
+{
+    if(source.isNull())
+        return QImage();
+
+    const QImage::Format format = filterFormat(source.format());
+    const QImage image = source.format() == format ? source : source.convertToFormat(format);
+
+    const int width = image.width();
+    const int height = image.height();
+    const int rowBytes = width * (format == QImage::Format_Grayscale8 ? 1 : 4);
+
+    // the horizontal pass writes every byte, so the pooled block needs no clearing
+    BufferPool::Buffer rowBuffer = BufferPool::acquire(static_cast<size_t>(rowBytes) * height);
+    uchar* rows = rowBuffer.as<uchar>();
+
+    if(!rows)
+        return QImage();
+
+    Parallel::forEachBand(0, height, Parallel::bandHeight(rowBytes), [&](int firstRow, int lastRow) {
+        rowPass(image, rows, rowBytes, firstRow, lastRow);
+    });
+
+    QImage resultImage = BufferPool::image(width, height, format);
+    uchar* resultBits = resultImage.bits();
+    const int resultStride = resultImage.bytesPerLine();
+    const int strip = stripBytes(rowBytes);
+    const int strips = (rowBytes + strip - 1) / strip;
+
+    Parallel::forEachBand(0, strips, 1, [&](int firstStrip, int lastStrip) {
+        for(int index = firstStrip; index < lastStrip; ++index) {
+            const int offset = index * strip;
+            columnPass(rows + offset, rowBytes, resultBits + offset, resultStride, qMin(strip, rowBytes - offset), height);
+        }
+    });
+
+    if(format != source.format())
+        return resultImage.convertToFormat(source.format());
+
+    return resultImage;
+}
+
+QImage Separable::boxBlur(const QImage &source, const std::vector<int> &radii)
+{
+    if(radii.empty())
+        return source;
+
+    auto rowPass = [&radii](const QImage& image, uchar* rows, int rowBytes, int firstRow, int lastRow) {
+        if(image.format() == QImage::Format_Grayscale8)
+            boxRows<1>(image, rows, rowBytes, firstRow, lastRow, radii);
+        else
+            boxRows<4>(image, rows, rowBytes, firstRow, lastRow, radii);
+    };
+
+    auto columnPass = [&radii](const uchar* rows, int rowBytes, uchar* output, int outputStride, int columns, int height) {
+        const int passes = static_cast<int>(radii.size());
+        std::vector<uchar> buffers[2];
+
+        if(passes > 1) {
+            buffers[0].resize(static_cast<size_t>(columns) * height);
+            buffers[1].resize(static_cast<size_t>(columns) * height);
+        }
+
+        // passes in between ping-pong on packed copies of the strip
+        for(int pass = 0; pass < passes; ++pass) {
+            const uchar* input = pass == 0 ? rows : buffers[(pass - 1) % 2].data();
+            const int inputStride = pass == 0 ? rowBytes : columns;
+            const bool isLast = pass == passes - 1;
+
+            boxColumns(input, inputStride, isLast ? output : buffers[pass % 2].data(), isLast ? outputStride : columns,
+                       columns, height, radii[pass]);
+        }
+    };
+
+    return separablePasses(source, rowPass, columnPass);
+}
+
+static std::vector<int> fixedWeights(const std::vector<double>& kernel)
+{
+    std::vector<int> weights(kernel.size());
+
+    for(size_t k = 0; k < kernel.size(); ++k)
+        weights[k] = qRound(kernel[k] * (1 << WeightBits));
+
+    return weights;
+}
+
+QImage Separable::convolve(const QImage &source, const std::vector<double> &horizontal, const std::vector<double> &vertical)
+{
+    if(horizontal.size() % 2 == 0 || vertical.size() % 2 == 0)
+        return QImage();
+
+    const std::vector<int> horizontalWeights = fixedWeights(horizontal);
+    const std::vector<int> verticalWeights = fixedWeights(vertical);
+
+    auto rowPass = [&horizontalWeights](const QImage& image, uchar* rows, int rowBytes, int firstRow, int lastRow) {
+        if(image.format() == QImage::Format_Grayscale8)
+            kernelRows<1>(image, rows, rowBytes, firstRow, lastRow, horizontalWeights);
+        else
+            kernelRows<4>(image, rows, rowBytes, firstRow, lastRow, horizontalWeights);
+    };
+
+    auto columnPass = [&verticalWeights](const uchar* rows, int rowBytes, uchar* output, int outputStride, int columns, int height) {
+        kernelColumns(rows, rowBytes, output, outputStride, columns, height, verticalWeights);
+    };
+
+    return separablePasses(source, rowPass, columnPass);
+}
+
+/*
+ * Box sizes from Kovesi, "Fast Almost-Gaussian Filtering": the first passes
+ * use the odd size wl just below the ideal width, the rest wl + 2, with the
+ * split chosen so the variances of the boxes add up to sigma^2.
+*/
+std::vector<int> Separable::gaussianBoxRadii(double sigma, int passes)
+{
+    std::vector<int> radii;
+
+    if(passes < 1 || sigma <= 0)
+        return radii;
+
+    const double variance = 12.0 * sigma * sigma;
+    int lowerSize = qFloor(qSqrt(variance / passes + 1));
+
+    if(lowerSize % 2 == 0)
+        --lowerSize;
+
+    const int lowerPasses = qRound((variance - passes * lowerSize * lowerSize - 4.0 * passes * lowerSize - 3.0 * passes) /
+                                   (-4.0 * lowerSize - 4.0));
+
+    for(int pass = 0; pass < passes; ++pass)
+        radii.push_back(((pass < lowerPasses ? lowerSize : lowerSize + 2) - 1) / 2);
+
+    return radii;
+}
@@ -0,0 +1,37 @@
+#ifndef SEPARABLE_H
+#define SEPARABLE_H
+
+#include <QImage>
+#include <vector>
+
+/*
+ * Separable convolution: a horizontal 1D pass over row bands followed by a
+ * vertical 1D pass over strips of columns, so a (2r+1)x(2r+1) kernel costs
+ * 2(2r+1) taps per pixel instead of (2r+1)^2.
+ *
+ * Box kernels use running sums, every output pixel adds the sample entering
+ * the window and subtracts the one leaving it, which makes their cost per
+ * pixel independent of the radius. A Gaussian is approximated by repeated box
+ * passes (see gaussianBoxRadii()).
+ *
+ * Every channel is filtered on its own: Grayscale8 images keep one channel,
+ * RGB32/ARGB32 images four, other formats go through ARGB32 and come back in
+ * their own format. Samples past the image edge repeat the edge pixel. The
+ * horizontal result is rounded to 8 bits before the vertical pass.
+*/
+namespace Separable
+{
+// Box blurs of radius radii[0], radii[1], ... one after the other
+QImage boxBlur(const QImage& source, const std::vector<int>& radii);
+
+/*
+ * Convolves with the odd length kernels horizontal and vertical, centered on
+ * their middle weight. Weights are used as given, results are clamped to 0-255.
+*/
+QImage convolve(const QImage& source, const std::vector<double>& horizontal, const std::vector<double>& vertical);
+
+// Radii of passes box blurs whose combination approximates a Gaussian of standard deviation sigma
+std::vector<int> gaussianBoxRadii(double sigma, int passes = 3);
+}
+
+#endif // SEPARABLE_H
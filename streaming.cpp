@@ -0,0 +1,477 @@
+#include "streaming.h"
+#include <QAtomicInt>
+#include <QFileInfo>
+#include <QSemaphore>
+#include <QRunnable>
+#include <QThreadPool>
+#include <cctype>
+#include <cstring>
+#include <vector>
+#include "rawimage.h"
+
+// Strips in flight: the one being filtered and the one being read
+static const int PrefetchWindows = 2;
+// Stride of the reads that fault in the pages of a mapped strip
+static const qint64 PageSize = 4096;
+
+// Next whitespace separated token of a PNM header, # comments skipped
+static bool readHeaderToken(QFile& file, QByteArray* token)
+{
+    *token = QByteArray();
+    char c;
+
+    while(file.getChar(&c)) {
+        if(c == '#' && token->isEmpty()) {
+            while(file.getChar(&c) && c != '\n') {}
+            continue;
+        }
+
+        if(std::isspace(static_cast<unsigned char>(c))) {
+            // the single whitespace after the last token is part of the header
+            if(!token->isEmpty())
+                return true;
+            continue;
+        }
+
+        token->append(c);
+    }
+
+    return !token->isEmpty();
+}
+
+static int headerValue(QFile& file, bool* ok)
+{
+    QByteArray token;
+    *ok = readHeaderToken(file, &token);
+    return *ok ? QString::fromLatin1(token).toInt(ok) : 0;
+}
+
+static int bytesPerPixel(QImage::Format format)
+{
+    return format == QImage::Format_Grayscale8 ? 1 : 4;
+}
+
+// Bytes one row of a strip window costs: the prefetched window and everything the pipeline allocates
+static qint64 rowCost(const Filter::Pipeline& pipeline, int width, QImage::Format format)
+{
+    const int bytes = bytesPerPixel(format);
+    return static_cast<qint64>(width) * (bytes + pipeline.peakBytesPerPixel(bytes));
+}
+
+namespace {
+
+struct Window {
+    int firstRow = 0;
+    QImage image;
+    QString error;
+};
+
+/*
+ * Reads the windows of all strips in order on a worker thread, at most
+ * PrefetchWindows ahead of the strip the caller has taken last.
+*/
+class StripPrefetch : public QRunnable
+{
+public:
+    StripPrefetch(Streaming::StripReader* reader, int stripRows, int halo, int strips) :
+        m_reader(reader),
+        m_stripRows(stripRows),
+        m_halo(halo),
+        m_strips(strips),
+        m_free(PrefetchWindows)
+    {
+        setAutoDelete(false);
+    }
+
+    void run() override
+    {
+        for(int strip = 0; strip < m_strips; ++strip) {
+            m_free.acquire();
+
+            if(m_stop.loadAcquire())
+                break;
+
+            Window& window = m_windows[strip % PrefetchWindows];
+            const int first = qMax(0, strip * m_stripRows - m_halo);
+            const int last = qMin(m_reader->height(), (strip + 1) * m_stripRows + m_halo);
+
+            window.firstRow = first;
+            window.image = m_reader->readRows(first, last - first, &window.error);
+
+            // the window belongs to the caller once released
+            const bool failed = window.image.isNull();
+            m_filled.release();
+
+            if(failed)
+                break;
+        }
+    }
+
+    Window& take(int strip)
+    {
+        m_filled.acquire();
+        return m_windows[strip % PrefetchWindows];
+    }
+
+    // Hands the slot of the window taken last back to the reader
+    void recycle(Window& window)
+    {
+        window.image = QImage();
+        m_free.release();
+    }
+
+    void stop()
+    {
+        m_stop.storeRelease(1);
+        m_free.release(PrefetchWindows);
+    }
+
+private:
+    Streaming::StripReader* m_reader;
+    int m_stripRows;
+    int m_halo;
+    int m_strips;
+    Window m_windows[PrefetchWindows];
+    QSemaphore m_free;
+    QSemaphore m_filled;
+    QAtomicInt m_stop;
+};
+
+}
+
+Streaming::StripReader::StripReader() :
+    m_width(0),
+    m_height(0),
+    m_channels(0),
+    m_dataOffset(0)
+{
+}
+
+bool Streaming::StripReader::open(const QString &fileName, QString *errorMessage)
+{
+    if(RawImage::isRawImage(fileName)) {
+        m_mapped = RawImage::load(fileName, errorMessage);
+        m_width = m_mapped.width();
+        m_height = m_mapped.height();
+        return !m_mapped.isNull();
+    }
+
+    m_file.setFileName(fileName);
+
+    if(!m_file.open(QIODevice::ReadOnly)) {
+        *errorMessage = QStringLiteral("%1: %2").arg(fileName, m_file.errorString());
+        return false;
+    }
+
+    QByteArray magic;
+    bool ok = readHeaderToken(m_file, &magic);
+    m_channels = magic == QByteArray("P5") ? 1 : magic == QByteArray("P6") ? 3 : 0;
+
+    int maxValue = 0;
+    if(ok && m_channels > 0) {
+        m_width = headerValue(m_file, &ok);
+        if(ok)
+            m_height = headerValue(m_file, &ok);
+        if(ok)
+            maxValue = headerValue(m_file, &ok);
+    }
+
+    if(!ok || m_channels == 0 || m_width <= 0 || m_height <= 0 || maxValue != 255) {
+        *errorMessage = QStringLiteral("%1: not a binary 8-bit PGM or PPM file, nor an .ifr image").arg(fileName);
+        return false;
+    }
+
+    m_dataOffset = m_file.pos();
+
+    if(m_file.size() < m_dataOffset + static_cast<qint64>(m_width) * m_channels * m_height) {
+        *errorMessage = QStringLiteral("%1: file is truncated").arg(fileName);
+        return false;
+    }
+
+    return true;
+}
+
+int Streaming::StripReader::width() const
+{
+    return m_width;
+}
+
+int Streaming::StripReader::height() const
+{
+    return m_height;
+}
+
+QImage::Format Streaming::StripReader::format() const
+{
+    if(!m_mapped.isNull())
+        return m_mapped.format();
+
+    return m_channels == 1 ? QImage::Format_Grayscale8 : QImage::Format_RGB32;
+}
+
+QImage Streaming::StripReader::readRows(int firstRow, int rowCount, QString *errorMessage)
+{
+    if(!m_mapped.isNull()) {
+        const uchar* rows = m_mapped.constScanLine(firstRow);
+        const qint64 stride = m_mapped.bytesPerLine();
+
+        // faults the pages in here, on the prefetch thread, rather than in the filters
+        uchar sum = 0;
+        for(qint64 offset = 0; offset < stride * rowCount; offset += PageSize)
+            sum ^= *static_cast<const volatile uchar*>(rows + offset);
+        Q_UNUSED(sum);
+
+        return QImage(rows, m_width, rowCount, m_mapped.bytesPerLine(), m_mapped.format());
+    }
+
+    const qint64 rowBytes = static_cast<qint64>(m_width) * m_channels;
+
+    if(!m_file.seek(m_dataOffset + firstRow * rowBytes)) {
+        *errorMessage = QStringLiteral("%1: %2").arg(m_file.fileName(), m_file.errorString());
+        return QImage();
+    }
+
+    QImage rows(m_width, rowCount, format());
+    std::vector<uchar> line(m_channels == 1 ? 0 : static_cast<size_t>(rowBytes));
+
+    for(int i = 0; i < rowCount; ++i) {
+        uchar* target = m_channels == 1 ? rows.scanLine(i) : line.data();
+
+        if(m_file.read(reinterpret_cast<char*>(target), rowBytes) != rowBytes) {
+            *errorMessage = QStringLiteral("%1: read error at row %2").arg(m_file.fileName()).arg(firstRow + i);
+            return QImage();
+        }
+
+        if(m_channels == 1)
+            continue;
+
+        QRgb* pixels = reinterpret_cast<QRgb*>(rows.scanLine(i));
+        for(int j = 0; j < m_width; ++j)
+            pixels[j] = qRgb(target[3 * j], target[3 * j + 1], target[3 * j + 2]);
+    }
+
+    return rows;
+}
+
+Streaming::StripWriter::StripWriter(const QString &fileName) :
+    m_fileName(fileName),
+    m_file(fileName),
+    m_width(0),
+    m_height(0),
+    m_rowsWritten(0),
+    m_isRaw(QFileInfo(fileName).suffix().toLower() == RawImage::suffix()),
+    m_isGray(false)
+{
+}
+
+Streaming::StripWriter::~StripWriter()
+{
+    // uncommitted .ifr output is dropped, as QSaveFile drops PNM output
+    if(!m_target.isNull()) {
+        m_target = QImage();
+        QFile::remove(m_fileName + QStringLiteral(".part"));
+    }
+}
+
+bool Streaming::StripWriter::open(int width, int height, QImage::Format format, QString *errorMessage)
+{
+    m_width = width;
+    m_height = height;
+    m_isGray = format == QImage::Format_Grayscale8;
+
+    if(m_isRaw) {
+        m_target = RawImage::create(m_fileName + QStringLiteral(".part"), width, height, format, errorMessage);
+        return !m_target.isNull();
+    }
+
+    const QByteArray header = QStringLiteral("%1\n%2 %3\n255\n").arg(QLatin1String(m_isGray ? "P5" : "P6")).arg(width).arg(height).toLatin1();
+
+    if(!m_file.open(QIODevice::WriteOnly) || m_file.write(header) != header.size()) {
+        *errorMessage = QStringLiteral("%1: %2").arg(m_fileName, m_file.errorString());
+        return false;
+    }
+
+    return true;
+}
+
+bool Streaming::StripWriter::writeRows(const QImage &rows, int firstRow, int rowCount, QString *errorMessage)
+{
+    QImage source = rows;
+
+    if(m_isRaw) {
+        if(source.format() != m_target.format())
+            source = source.convertToFormat(m_target.format());
+
+        // straight into the mapping of the output file
+        const size_t rowBytes = static_cast<size_t>(m_width) * (source.depth() / 8);
+        for(int i = 0; i < rowCount; ++i)
+            std::memcpy(m_target.scanLine(m_rowsWritten + i), source.constScanLine(firstRow + i), rowBytes);
+
+        m_rowsWritten += rowCount;
+        return true;
+    }
+
+    if(m_isGray && source.format() != QImage::Format_Grayscale8)
+        source = source.convertToFormat(QImage::Format_Grayscale8);
+    else if(!m_isGray && source.format() != QImage::Format_RGB32 && source.format() != QImage::Format_ARGB32)
+        source = source.convertToFormat(QImage::Format_RGB32);
+
+    const qint64 rowBytes = static_cast<qint64>(m_width) * (m_isGray ? 1 : 3);
+    std::vector<uchar> line(m_isGray ? 0 : static_cast<size_t>(rowBytes));
+
+    for(int i = firstRow; i < firstRow + rowCount; ++i) {
+        const uchar* data = source.constScanLine(i);
+
+        if(!m_isGray) {
+            const QRgb* pixels = reinterpret_cast<const QRgb*>(data);
+            for(int j = 0; j < m_width; ++j) {
+                line[3 * j] = static_cast<uchar>(qRed(pixels[j]));
+                line[3 * j + 1] = static_cast<uchar>(qGreen(pixels[j]));
+                line[3 * j + 2] = static_cast<uchar>(qBlue(pixels[j]));
+            }
+            data = line.data();
+        }
+
+        if(m_file.write(reinterpret_cast<const char*>(data), rowBytes) != rowBytes) {
+            *errorMessage = QStringLiteral("%1: %2").arg(m_fileName, m_file.errorString());
+            return false;
+        }
+    }
+
+    m_rowsWritten += rowCount;
+    return true;
+}
+
+bool Streaming::StripWriter::filterRows(const Filter::Pipeline &pipeline, const QImage &window, int firstRow, int rowCount, QString *errorMessage)
+{
+    if(!m_isRaw) {
+        const QImage result = pipeline.apply(window);
+        return writeRows(result, firstRow, rowCount, errorMessage);
+    }
+
+    // the rows of the mapping this strip covers, written without passing through a result image
+    QImage target(m_target.scanLine(m_rowsWritten), m_width, rowCount, m_target.bytesPerLine(), m_target.format());
+
+    if(!pipeline.apply(window, firstRow, &target)) {
+        *errorMessage = QStringLiteral("%1: filtering rows %2 to %3 failed").arg(m_fileName).arg(m_rowsWritten).arg(m_rowsWritten + rowCount);
+        return false;
+    }
+
+    m_rowsWritten += rowCount;
+    return true;
+}
+
+bool Streaming::StripWriter::commit(QString *errorMessage)
+{
+    if(m_rowsWritten != m_height) {
+        *errorMessage = QStringLiteral("%1: %2 of %3 rows written").arg(m_fileName).arg(m_rowsWritten).arg(m_height);
+        return false;
+    }
+
+    if(m_isRaw) {
+        const QString partFileName = m_fileName + QStringLiteral(".part");
+
+        // unmaps the file
+        m_target = QImage();
+
+        // a failed replace keeps the old file, the new one is dropped
+        if(!RawImage::replaceFile(partFileName, m_fileName, errorMessage)) {
+            QFile::remove(partFileName);
+            return false;
+        }
+
+        return true;
+    }
+
+    if(!m_file.commit()) {
+        *errorMessage = QStringLiteral("%1: %2").arg(m_fileName, m_file.errorString());
+        return false;
+    }
+
+    return true;
+}
+
+qint64 Streaming::minimumBudget(const Filter::Pipeline &pipeline, int width, QImage::Format format)
+{
+    const int halo = pipeline.halo();
+    return halo < 0 ? -1 : rowCost(pipeline, width, format) * (2 * halo + 1);
+}
+
+bool Streaming::filterFile(const Filter::Pipeline &pipeline, const QString &inputFileName, const QString &outputFileName,
+                           qint64 memoryBudget, QString *errorMessage, Report *report)
+{
+    const int halo = pipeline.halo();
+
+    if(halo < 0) {
+        *errorMessage = QStringLiteral("The filter chain needs whole images (rotation, warps or Fourier filters) and cannot be streamed");
+        return false;
+    }
+
+    StripReader reader;
+    if(!reader.open(inputFileName, errorMessage))
+        return false;
+
+    const int width = reader.width();
+    const int height = reader.height();
+    const qint64 windowRows = memoryBudget / rowCost(pipeline, width, reader.format());
+
+    if(windowRows < 2 * halo + 1) {
+        *errorMessage = QStringLiteral("%1: a memory budget of %2 bytes is too small, the filter chain needs at least %3")
+                .arg(inputFileName).arg(memoryBudget).arg(minimumBudget(pipeline, width, reader.format()));
+        return false;
+    }
+
+    const int stripRows = static_cast<int>(qMin<qint64>(height, windowRows - 2 * halo));
+    const int strips = (height + stripRows - 1) / stripRows;
+
+    StripPrefetch prefetch(&reader, stripRows, halo, strips);
+    QThreadPool pool;
+    pool.setMaxThreadCount(1);
+    pool.start(&prefetch);
+
+    StripWriter writer(outputFileName);
+    bool ok = true;
+
+    for(int strip = 0; strip < strips && ok; ++strip) {
+        Window& window = prefetch.take(strip);
+
+        if(window.image.isNull()) {
+            *errorMessage = window.error;
+            ok = false;
+            break;
+        }
+
+        const int firstRow = strip * stripRows;
+        const int rowCount = qMin(stripRows, height - firstRow);
+
+        // the first result tells the output format, later strips are filtered straight into the output
+        if(strip == 0) {
+            const QImage result = pipeline.apply(window.image);
+            ok = writer.open(width, height, result.format(), errorMessage) &&
+                 writer.writeRows(result, firstRow - window.firstRow, rowCount, errorMessage);
+        }
+        else {
+            ok = writer.filterRows(pipeline, window.image, firstRow - window.firstRow, rowCount, errorMessage);
+        }
+
+        // frees the window for the strip after next
+        prefetch.recycle(window);
+    }
+
+    prefetch.stop();
+    pool.waitForDone();
+
+    if(!ok || !writer.commit(errorMessage))
+        return false;
+
+    if(report) {
+        report->width = width;
+        report->height = height;
+        report->strips = strips;
+        report->stripRows = stripRows;
+        report->halo = halo;
+        report->peakBytes = (stripRows + 2 * static_cast<qint64>(halo)) * rowCost(pipeline, width, reader.format());
+    }
+
+    return true;
+}
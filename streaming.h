@@ -0,0 +1,99 @@
+#ifndef STREAMING_H
+#define STREAMING_H
+
+#include <QFile>
+#include <QImage>
+#include <QSaveFile>
+#include <QString>
+#include "pipeline.h"
+
+/*
+ * Out-of-core filtering of images too large to hold in memory.
+ *
+ * The source is read as horizontal strips, each extended by Pipeline::halo()
+ * rows above and below, run through the pipeline on its own and the rows of
+ * the strip proper are appended to the output, so the result is the same as
+ * filtering the whole image. The strip height is the largest one whose
+ * buffers fit the memory budget; while one strip is filtered the next one is
+ * already being read on another thread.
+ *
+ * Only pipelines whose steps keep the image size and look at a bounded
+ * neighbourhood can stream; rotation, warps and the Fourier filters need the
+ * whole image. Files are binary 8-bit PGM (P5) or PPM (P6), which can be read
+ * and written a row at a time at known offsets, or .ifr images (see RawImage),
+ * whose strips are windows into a mapping of the file.
+*/
+namespace Streaming
+{
+class StripReader
+{
+public:
+    StripReader();
+
+    // PGM, PPM or .ifr, told apart by their header
+    bool open(const QString& fileName, QString* errorMessage);
+
+    int width() const;
+    int height() const;
+    // Grayscale8 for PGM, RGB32 for PPM, the stored format for .ifr
+    QImage::Format format() const;
+
+    // Rows [firstRow, firstRow + rowCount) in format(), a null image on read errors
+    QImage readRows(int firstRow, int rowCount, QString* errorMessage);
+
+private:
+    QFile m_file;
+    QImage m_mapped;
+    int m_width;
+    int m_height;
+    int m_channels;
+    qint64 m_dataOffset;
+};
+
+class StripWriter
+{
+public:
+    // .ifr when fileName has that suffix, PGM or PPM otherwise
+    explicit StripWriter(const QString& fileName);
+    ~StripWriter();
+
+    // PNM output is PGM for Grayscale8 and PPM otherwise, .ifr output keeps format
+    bool open(int width, int height, QImage::Format format, QString* errorMessage);
+    // Appends rows [firstRow, firstRow + rowCount) of rows
+    bool writeRows(const QImage& rows, int firstRow, int rowCount, QString* errorMessage);
+    /*
+     * Appends rows [firstRow, firstRow + rowCount) of the pipeline's result on
+     * window; .ifr output is filtered straight into the mapping of the file.
+    */
+    bool filterRows(const Filter::Pipeline& pipeline, const QImage& window, int firstRow, int rowCount, QString* errorMessage);
+    // Replaces the output file once every row has been written
+    bool commit(QString* errorMessage);
+
+private:
+    QString m_fileName;
+    QSaveFile m_file;
+    QImage m_target;
+    int m_width;
+    int m_height;
+    int m_rowsWritten;
+    bool m_isRaw;
+    bool m_isGray;
+};
+
+struct Report {
+    int width = 0;
+    int height = 0;
+    int strips = 0;
+    int stripRows = 0;
+    int halo = 0;
+    qint64 peakBytes = 0;
+};
+
+// Smallest memory budget filterFile() accepts for the pipeline on images of width pixels
+qint64 minimumBudget(const Filter::Pipeline& pipeline, int width, QImage::Format format);
+
+bool filterFile(const Filter::Pipeline& pipeline, const QString& inputFileName, const QString& outputFileName,
+                qint64 memoryBudget, QString* errorMessage, Report* report = nullptr);
+}
+
+#endif // STREAMING_H
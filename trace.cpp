@@ -0,0 +1,267 @@
+#include "trace.h"
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QTextStream>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Events kept for writeChromeTrace(), about 10 MB
+static const size_t MaximumEvents = 256 * 1024;
+
+struct Event {
+    const char* name;
+    qint64 begin;
+    qint64 duration;
+    qint64 pixels;
+    int thread;
+};
+
+struct Totals {
+    qint64 calls = 0;
+    qint64 nanoseconds = 0;
+    qint64 pixels = 0;
+};
+
+struct Recorder {
+    Recorder()
+    {
+        clock.start();
+    }
+
+    QMutex mutex;
+    QElapsedTimer clock;
+    // ring of the latest events, next is where the following one goes
+    std::vector<Event> events;
+    size_t next = 0;
+    std::unordered_map<const char*, Totals> totals;
+    std::vector<Trace::Counter*> counters;
+};
+
+static QAtomicInt s_enabled(1);
+static QAtomicInt s_threadCount(0);
+thread_local int t_thread = 0;
+
+// Never destroyed, scopes closing during static destruction still find it
+static Recorder& recorder()
+{
+    static Recorder* recorder = new Recorder;
+    return *recorder;
+}
+
+static int currentThread()
+{
+    if(t_thread == 0)
+        t_thread = s_threadCount.fetchAndAddRelaxed(1) + 1;
+
+    return t_thread;
+}
+
+static QString escaped(const char* name)
+{
+    QString text = QString::fromUtf8(name);
+    text.replace(QLatin1Char('\\'), QLatin1String("\\\\"));
+    text.replace(QLatin1Char('"'), QLatin1String("\\\""));
+    return text;
+}
+
+void Trace::setEnabled(bool enabled)
+{
+    s_enabled.storeRelease(enabled ? 1 : 0);
+}
+
+bool Trace::isEnabled()
+{
+    return s_enabled.loadAcquire() != 0;
+}
+
+Trace::Scope::Scope(const char *name, qint64 pixels) : m_name(nullptr), m_pixels(pixels), m_begin(0)
+{
+    if(!isEnabled())
+        return;
+
+    m_name = name;
+    m_begin = recorder().clock.nsecsElapsed();
+}
+
+Trace::Scope::~Scope()
+{
+    if(!m_name)
+        return;
+
+    Recorder& trace = recorder();
+    const qint64 end = trace.clock.nsecsElapsed();
+    const Event event = { m_name, m_begin, end - m_begin, m_pixels, currentThread() };
+
+    {
+        QMutexLocker locker(&trace.mutex);
+
+        if(trace.events.size() < MaximumEvents)
+            trace.events.push_back(event);
+        else
+            trace.events[trace.next] = event;
+        trace.next = (trace.next + 1) % MaximumEvents;
+
+        Totals& totals = trace.totals[m_name];
+        ++totals.calls;
+        totals.nanoseconds += event.duration;
+        totals.pixels += m_pixels;
+    }
+
+    if(m_pixels > 0)
+        pixelsProcessed().add(m_pixels);
+}
+
+Trace::Counter::Counter(const char *name) : m_name(name), m_value(0)
+{
+    Recorder& trace = recorder();
+    QMutexLocker locker(&trace.mutex);
+    trace.counters.push_back(this);
+}
+
+Trace::Counter &Trace::pixelsProcessed()
+{
+    static Counter counter("pixels processed");
+    return counter;
+}
+
+Trace::Counter &Trace::bytesAllocated()
+{
+    static Counter counter("bytes allocated");
+    return counter;
+}
+
+Trace::Counter &Trace::cacheHits()
+{
+    static Counter counter("cache hits");
+    return counter;
+}
+
+void Trace::clear()
+{
+    Recorder& trace = recorder();
+    QMutexLocker locker(&trace.mutex);
+
+    trace.events.clear();
+    trace.next = 0;
+    trace.totals.clear();
+
+    for(Counter* counter : trace.counters)
+        counter->m_value.storeRelease(0);
+}
+
+bool Trace::writeChromeTrace(const QString &fileName, QString *errorMessage)
+{
+    Recorder& trace = recorder();
+    std::vector<Event> events;
+    std::vector<Counter*> counters;
+    qint64 now;
+
+    {
+        QMutexLocker locker(&trace.mutex);
+
+        // oldest first once the ring has wrapped
+        if(trace.events.size() < MaximumEvents) {
+            events = trace.events;
+        }
+        else {
+            const auto split = trace.events.begin() + static_cast<std::ptrdiff_t>(trace.next);
+            events.assign(split, trace.events.end());
+            events.insert(events.end(), trace.events.begin(), split);
+        }
+        counters = trace.counters;
+        now = trace.clock.nsecsElapsed();
+    }
+
+    QSaveFile file(fileName);
+
+    if(!file.open(QIODevice::WriteOnly)) {
+        *errorMessage = QStringLiteral("%1: %2").arg(fileName, file.errorString());
+        return false;
+    }
+
+    QTextStream stream(&file);
+    stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+    // timestamps and durations are in microseconds
+    bool isFirst = true;
+    for(const Event& event : events) {
+        stream << (isFirst ? "" : ",\n") << "{\"name\":\"" << escaped(event.name) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread
+               << ",\"ts\":" << QString::number(event.begin / 1000.0, 'f', 3)
+               << ",\"dur\":" << QString::number(event.duration / 1000.0, 'f', 3);
+        if(event.pixels > 0)
+            stream << ",\"args\":{\"pixels\":" << event.pixels << '}';
+        stream << '}';
+        isFirst = false;
+    }
+
+    for(const Counter* counter : counters) {
+        stream << (isFirst ? "" : ",\n") << "{\"name\":\"" << escaped(counter->name()) << "\",\"ph\":\"C\",\"pid\":1,\"tid\":0,\"ts\":"
+               << QString::number(now / 1000.0, 'f', 3) << ",\"args\":{\"value\":" << counter->value() << "}}";
+        isFirst = false;
+    }
+
+    stream << "\n]}\n";
+    stream.flush();
+
+    if(stream.status() != QTextStream::Ok || !file.commit()) {
+        *errorMessage = QStringLiteral("%1: %2").arg(fileName, file.errorString());
+        return false;
+    }
+
+    return true;
+}
+
+QString Trace::summary()
+{
+    Recorder& trace = recorder();
+    // the same name may be spelled by several literals
+    std::map<std::string, Totals> totals;
+    std::vector<Counter*> counters;
+
+    {
+        QMutexLocker locker(&trace.mutex);
+
+        for(const auto& entry : trace.totals) {
+            Totals& merged = totals[entry.first];
+            merged.calls += entry.second.calls;
+            merged.nanoseconds += entry.second.nanoseconds;
+            merged.pixels += entry.second.pixels;
+        }
+
+        counters = trace.counters;
+    }
+
+    std::vector<std::pair<std::string, Totals>> rows(totals.begin(), totals.end());
+    std::sort(rows.begin(), rows.end(), [](const std::pair<std::string, Totals>& a, const std::pair<std::string, Totals>& b) {
+        return a.second.nanoseconds > b.second.nanoseconds;
+    });
+
+    QString text;
+    QTextStream stream(&text);
+    stream << QStringLiteral("scope").leftJustified(48) << QStringLiteral("calls").rightJustified(8)
+           << QStringLiteral("total ms").rightJustified(12) << QStringLiteral("mean ms").rightJustified(12)
+           << QStringLiteral("MP/s").rightJustified(10) << '\n';
+
+    for(const auto& row : rows) {
+        const Totals& totals = row.second;
+        const double milliseconds = totals.nanoseconds / 1e6;
+        const QString throughput = totals.pixels > 0 && totals.nanoseconds > 0
+                                   ? QString::number(totals.pixels * 1e3 / totals.nanoseconds, 'f', 1) : QStringLiteral("-");
+
+        stream << QString::fromStdString(row.first).leftJustified(48) << QString::number(totals.calls).rightJustified(8)
+               << QString::number(milliseconds, 'f', 2).rightJustified(12)
+               << QString::number(milliseconds / totals.calls, 'f', 3).rightJustified(12)
+               << throughput.rightJustified(10) << '\n';
+    }
+
+    for(const Counter* counter : counters)
+        stream << counter->name() << ": " << counter->value() << '\n';
+
+    stream.flush();
+    return text;
+}
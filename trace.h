@@ -0,0 +1,82 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QAtomicInteger>
+#include <QString>
+
+/*
+ * Built in instrumentation, cheap enough to stay on in production builds.
+ *
+ * A Scope times the block it lives in: the Filter:: entry points, their
+ * phases (conversion, transforms, masking, rescaling) and the window's slots
+ * each open one. Every scope adds a complete event to a bounded log, the
+ * oldest events making room for new ones, and to per name totals that are
+ * never dropped. Counters add up whatever is worth counting, pixels
+ * processed, bytes allocated, cache hits.
+ *
+ * writeChromeTrace() dumps the log as trace event JSON for chrome://tracing
+ * or ui.perfetto.dev, summary() tabulates the totals with the throughput of
+ * every scope that was given a pixel count.
+ *
+ * Names must be string literals or otherwise outlive the process' tracing,
+ * only their pointers are stored while recording.
+*/
+namespace Trace
+{
+// On by default; a disabled scope costs one atomic load
+void setEnabled(bool enabled);
+bool isEnabled();
+
+class Scope
+{
+public:
+    // pixels > 0 adds to the "pixels processed" counter and to the scope's throughput
+    explicit Scope(const char* name, qint64 pixels = 0);
+    ~Scope();
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+private:
+    const char* m_name;
+    qint64 m_pixels;
+    qint64 m_begin;
+};
+
+class Counter
+{
+public:
+    // Counters are meant to be statics, they register themselves for summary() and the trace
+    explicit Counter(const char* name);
+
+    void add(qint64 value)
+    {
+        if(isEnabled())
+            m_value.fetchAndAddRelaxed(value);
+    }
+
+    const char* name() const { return m_name; }
+    qint64 value() const { return m_value.loadAcquire(); }
+
+private:
+    friend void clear();
+
+    const char* m_name;
+    QAtomicInteger<qint64> m_value;
+};
+
+// Counters of the filter core
+Counter& pixelsProcessed();
+Counter& bytesAllocated();
+Counter& cacheHits();
+
+// Forgets the events, totals and counter values
+void clear();
+
+bool writeChromeTrace(const QString& fileName, QString* errorMessage);
+
+// Per scope calls, total and mean time and MP/s, followed by the counters
+QString summary();
+}
+
+#endif // TRACE_H